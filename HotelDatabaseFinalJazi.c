@@ -2,605 +2,533 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <pthread.h>
 #include <unistd.h>
-#define HashSize 100
-// indexing by id and string , hashing
+#include "hoteldb.h"
+
+// interactive front end: everything below goes through the hoteldb.h API
+
+// how the menu shows and prompts for the records of each table
 typedef struct
 {
-    void *data;
-    void *next;
-} Node;
+    void (*displayFunction)(FILE *, void *);
+    void (*inputFunction)(void *);
+} TableView;
 
-typedef struct HashNode
+void displayCustomer(FILE *out, void *data)
 {
-    void *data;
-    struct HashNode *next;
-} HashNode;
+    struct Customer *customer = (struct Customer *)data;
+    fprintf(out, "ID: %d, Name: %s, Email: %s, Phone: %s, Address: %s\n",
+            customer->customerID, customer->name, customer->email,
+            customer->phone, customer->address);
+}
 
-typedef struct
+void displayRoom(FILE *out, void *data)
 {
-    HashNode *buckets[HashSize];
-} HashTable;
+    struct Room *room = (struct Room *)data;
+    fprintf(out, "Room ID: %d, Room Type: %s, Price: %.2lf, Availability: %s\n",
+            room->roomID, room->roomType, room->price,
+            room->availability ? "Available" : "Not Available");
+}
 
-int hashFunction(int key)
+void displayReservation(FILE *out, void *data)
 {
-    return key % HashSize;
+    struct Reservation *reservation = (struct Reservation *)data;
+    char checkIn[16], checkOut[16];
+    formatDate(reservation->checkInDay, checkIn, sizeof(checkIn));
+    formatDate(reservation->checkOutDay, checkOut, sizeof(checkOut));
+    fprintf(out, "Reservation ID: %d, Check-in: %s, Check-out: %s, Customer ID: %d, Room ID: %d\n",
+            reservation->reservationID, checkIn, checkOut,
+            reservation->customerID, reservation->roomID);
 }
 
-typedef struct
+void displayAmenity(FILE *out, void *data)
 {
-    const char *name;
-    Node *head;
-    HashTable idHashTable;
-    HashTable nameHashTable;
-    // pthread_mutex_t mutex;
-    int lockCounter;
-    const char *filename;
-    size_t dataSize;
-    void (*displayFunction)(void *);
-    void (*inputFunction)(void *);
-    int (*idExtract)(void *);
-    const char *(*nameExtract)(void *);
-} Table;
+    struct Amenity *amenity = (struct Amenity *)data;
+    fprintf(out, "Room ID: %d, Amenity ID: %d\n", amenity->RoomID, amenity->AmenityID);
+}
 
-void lockTable(Table *table)
+void displayAmenityType(FILE *out, void *data)
 {
-    while (true)
-    {
-        if (table->lockCounter == 0)
-        {
-            table->lockCounter = 1;
-            break;
-        }
-        printf("Table %s is locked. Waiting...\n", table->name);
-        usleep(100);
-    }
-    printf("Table %s is now locked by thread %ld\n", table->name, (long)pthread_self());
+    struct Amenity_Type *amenityType = (struct Amenity_Type *)data;
+    fprintf(out, "Amenity ID: %d, Amenity Name: %s\n", amenityType->AmenityID, amenityType->AmenityName);
 }
 
-void unlockTable(Table *table)
+void displayCustomerPlacesRoom(FILE *out, void *data)
 {
-    table->lockCounter = 0;
-    printf("Table %s is now unlocked by thread %ld\n", table->name, (long)pthread_self());
+    struct CUTSOMER_PLACES_ROOM *cpr = (struct CUTSOMER_PLACES_ROOM *)data;
+    fprintf(out, "Customer ID: %d, Room ID: %d, Phone: %s\n", cpr->customerID, cpr->RoomID, cpr->phone);
 }
 
-int stringHashFunction(const char *key)
+void inputCustomer(void *data)
 {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *key++))
-    {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash % HashSize;
+    struct Customer *customer = (struct Customer *)data;
+    printf("Enter Customer ID: ");
+    scanf("%d", &customer->customerID);
+    printf("Enter Name: ");
+    scanf(" %[^\n]s", customer->name);
+    printf("Enter Email: ");
+    scanf(" %[^\n]s", customer->email);
+    printf("Enter Phone: ");
+    scanf(" %[^\n]s", customer->phone);
+    printf("Enter Address: ");
+    scanf(" %[^\n]s", customer->address);
 }
 
-struct Customer
+void inputRoom(void *data)
 {
-    int customerID;
-    char name[100];
-    char email[100];
-    char phone[20];
-    char address[200];
-};
+    struct Room *room = (struct Room *)data;
+    printf("Enter Room ID: ");
+    scanf("%d", &room->roomID);
+    printf("Enter Room Type: ");
+    scanf(" %[^\n]s", room->roomType);
+    printf("Enter Room Price: ");
+    scanf("%lf", &room->price);
+    printf("Enter Availability (1 for available, 0 for unavailable): ");
+    scanf("%d", &room->availability);
+}
 
-struct Room
+// prompts until a valid YYYY-MM-DD is entered, returns its day number
+int inputDate(const char *prompt)
 {
-    int roomID;
-    char roomType[50];
-    double price;
-    int availability;
-};
+    char text[20];
+    int days;
+    while (true)
+    {
+        printf("%s", prompt);
+        if (scanf(" %19[^\n]", text) != 1)
+        {
+            return 0;
+        }
+        if (parseDate(text, &days))
+        {
+            return days;
+        }
+        printf("Invalid date, use YYYY-MM-DD.\n");
+    }
+}
 
-struct Reservation
+void inputReservation(void *data)
 {
-    int reservationID;
-    char checkInDate[20];
-    char checkOutDate[20];
-    int customerID;
-    int roomID;
-};
+    struct Reservation *reservation = (struct Reservation *)data;
+    printf("Enter Reservation ID: ");
+    scanf("%d", &reservation->reservationID);
+    reservation->checkInDay = inputDate("Enter Check-in Date (YYYY-MM-DD): ");
+    reservation->checkOutDay = inputDate("Enter Check-out Date (YYYY-MM-DD): ");
+    while (reservation->checkOutDay <= reservation->checkInDay && !feof(stdin))
+    {
+        printf("Check-out must be after check-in.\n");
+        reservation->checkOutDay = inputDate("Enter Check-out Date (YYYY-MM-DD): ");
+    }
+    printf("Enter Customer ID: ");
+    scanf("%d", &reservation->customerID);
+    printf("Enter Room ID: ");
+    scanf("%d", &reservation->roomID);
+}
 
-struct Amenity
+void inputAmenity(void *data)
 {
-    int RoomID;
-    int AmenityID;
-};
+    struct Amenity *amenity = (struct Amenity *)data;
+    printf("Enter Room ID: ");
+    scanf("%d", &amenity->RoomID);
+    printf("Enter Amenity ID: ");
+    scanf("%d", &amenity->AmenityID);
+}
 
-struct Amenity_Type
+void inputAmenityType(void *data)
 {
-    int AmenityID;
-    char AmenityName[100];
-};
+    struct Amenity_Type *amenityType = (struct Amenity_Type *)data;
+    printf("Enter Amenity ID: ");
+    scanf("%d", &amenityType->AmenityID);
+    printf("Enter Amenity Name: ");
+    scanf(" %[^\n]s", amenityType->AmenityName);
+}
 
-struct CUTSOMER_PLACES_ROOM
+void inputCustomerPlacesRoom(void *data)
 {
-    int customerID;
-    int RoomID;
-    char phone[20];
-};
+    struct CUTSOMER_PLACES_ROOM *cpr = (struct CUTSOMER_PLACES_ROOM *)data;
+    printf("Enter Customer ID: ");
+    scanf("%d", &cpr->customerID);
+    printf("Enter Room ID: ");
+    scanf("%d", &cpr->RoomID);
+    printf("Enter Phone Number: ");
+    scanf(" %[^\n]s", cpr->phone);
+}
 
-//  tables
-Table tables[6];
+TableView views[TableCount] = {
+    [CustomerTable] = {displayCustomer, inputCustomer},
+    [RoomTable] = {displayRoom, inputRoom},
+    [ReservationTable] = {displayReservation, inputReservation},
+    [AmenityTable] = {displayAmenity, inputAmenity},
+    [AmenityTypeTable] = {displayAmenityType, inputAmenityType},
+    [CustomerPlacesRoomTable] = {displayCustomerPlacesRoom, inputCustomerPlacesRoom},
+};
 
-void displayCustomer(void *data);
-void displayRoom(void *data);
-void displayReservation(void *data);
-void displayAmenity(void *data);
-void displayAmenityType(void *data);
-void displayCustomerPlacesRoom(void *data);
-// void inputCustomer(void *data);
+// listing output is written a buffer at a time rather than a line at a time
+#define DisplayBufferBytes (1 << 16)
 
-void *backupTable(void *arg)
+void display(HotelTableId id)
 {
-    Table *table = (Table *)arg;
-    printf("\nBackup thread started for %s\n", table->name);
-    lockTable(table);
+    Table *table = hotelTable(id);
+    printf("\n%s List:\n", tableName(table));
+    size_t size = tableRecordSize(table);
+    TableCursor *cursor = tableCursorOpen(table);
+    char *records = malloc(CursorBatch * size);
+    if (!cursor || !records)
+    {
+        printf("Memory allocation failed!\n");
+        cursorClose(cursor);
+        free(records);
+        return;
+    }
 
-    FILE *file = fopen(table->filename, "wb");
-    if (file)
+    // the table is only locked inside cursorFetch, printing happens outside
+    fflush(stdout);
+    FILE *out = fdopen(dup(fileno(stdout)), "w");
+    if (!out || setvbuf(out, NULL, _IOFBF, DisplayBufferBytes) != 0)
     {
-        Node *current = table->head;
-        while (current)
+        if (out)
         {
-            fwrite(current->data, table->dataSize, 1, file);
-            current = current->next;
+            fclose(out);
         }
-        fclose(file);
-        printf("Backup completed for %s\n", table->name);
+        out = stdout;
     }
-
-    unlockTable(table);
-    return NULL;
-}
-
-void *findById(Table *table, int id)
-{
-    int hash_index = hashFunction(id);
-    HashNode *current = table->idHashTable.buckets[hash_index];
-
-    while (current)
+    size_t shown = 0, fetched;
+    while ((fetched = cursorFetch(cursor, records, CursorBatch)) > 0)
     {
-        if (table->idExtract(current->data) == id)
+        for (size_t i = 0; i < fetched; i++)
         {
-            return current->data;
+            views[id].displayFunction(out, records + i * size);
         }
-        current = current->next;
+        shown += fetched;
     }
-    return NULL;
-}
-
-void display(Table *table)
-{
-    lockTable(table);
-
-    printf("\n%s List:\n", table->name);
-    Node *current = table->head;
-
-    if (!current)
+    if (shown == 0)
     {
-        printf("No records found!\n");
+        fprintf(out, "No records found!\n");
     }
-    else
+    if (out != stdout)
     {
-        while (current)
-        {
-            table->displayFunction(current->data);
-            current = current->next;
-        }
+        fclose(out);
     }
-
-    unlockTable(table);
+    cursorClose(cursor);
+    free(records);
 }
 
-void insert(Table *table)
+// prints the outcome of a change the way the menu always has
+void reportChange(HotelStatus status, const void *record, Table *table, const char *done)
 {
-    lockTable(table);
-
-    void *newData = malloc(table->dataSize);
-    if (!newData)
+    switch (status)
     {
+    case HotelOk:
+        printf("%s\n", done);
+        break;
+    case HotelNotFound:
+        printf("Record not found!\n");
+        break;
+    case HotelDuplicate:
+        printf("Record with ID %d already exists! Retry again.\n", tableRecordId(table, record));
+        break;
+    case HotelNoMemory:
         printf("Memory allocation failed!\n");
-        unlockTable(table);
-        return;
+        break;
+    case HotelIoError:
+        printf("Warning: change to %s could not be saved to disk!\n", tableName(table));
+        break;
+    default:
+        printf("Record rejected: %s\n", hotelStatusText(status));
     }
+}
 
-    table->inputFunction(newData);
-
-    int id = table->idExtract(newData);
-
-    void *data = findById(table, id);
-    if (data)
+void insert(HotelTableId id)
+{
+    Table *table = hotelTable(id);
+    void *newData = calloc(1, tableRecordSize(table));
+    if (!newData)
     {
-        printf("Record with ID %d already exists! Retry again.\n", id);
-        free(newData);
-        unlockTable(table);
+        printf("Memory allocation failed!\n");
         return;
     }
+    views[id].inputFunction(newData);
+    reportChange(tableInsert(table, newData), newData, table, "Record added successfully!");
+    free(newData);
+}
 
-    // insert in linkedlist
-    Node *newNode = malloc(sizeof(Node));
-    if (!newNode)
+void update(HotelTableId id, int recordId)
+{
+    Table *table = hotelTable(id);
+    void *newData = calloc(1, tableRecordSize(table));
+    if (!newData)
     {
         printf("Memory allocation failed!\n");
-        free(newData);
-        unlockTable(table);
         return;
     }
-    newNode->data = newData;
-    newNode->next = table->head;
-    table->head = newNode;
-
-    // insert id in hash table
-    int idHashIndex = hashFunction(id);
-    HashNode *idHashNode = malloc(sizeof(HashNode));
-    if (!idHashNode)
+    if (tableGet(table, recordId, newData) != HotelOk)
     {
-        printf("Memory allocation failed!\n");
+        printf("Record not found!\n");
         free(newData);
-        free(newNode);
-        unlockTable(table);
         return;
     }
-    idHashNode->data = newData;
-    idHashNode->next = table->idHashTable.buckets[idHashIndex];
-    table->idHashTable.buckets[idHashIndex] = idHashNode;
+    views[id].inputFunction(newData);
+    reportChange(tableUpdate(table, recordId, newData), newData, table, "Record updated successfully!");
+    free(newData);
+}
+
+void delete(HotelTableId id, int recordId)
+{
+    reportChange(tableDelete(hotelTable(id), recordId), NULL, hotelTable(id), "Record deleted successfully!");
+}
 
-    // condition for name exist and insert it in hash table
-    if (table->nameExtract)
+// shows up to max matches copied into records, then how many were left out
+void showMatches(HotelTableId id, const char *records, size_t total, size_t max)
+{
+    size_t size = tableRecordSize(hotelTable(id));
+    size_t shown = total < max ? total : max;
+    for (size_t i = 0; i < shown; i++)
     {
-        const char *name = table->nameExtract(newData);
-        int nameHashIndex = stringHashFunction(name);
-        HashNode *nameHashNode = malloc(sizeof(HashNode));
-        if (!nameHashNode)
-        {
-            printf("Memory allocation failed!\n");
-            free(newData);
-            free(newNode);
-            free(idHashNode);
-            unlockTable(table);
-            return;
-        }
-        nameHashNode->data = newData;
-        nameHashNode->next = table->nameHashTable.buckets[nameHashIndex];
-        table->nameHashTable.buckets[nameHashIndex] = nameHashNode;
+        views[id].displayFunction(stdout, (void *)(records + i * size));
+    }
+    if (total == 0)
+    {
+        printf("Record not found");
+    }
+    else if (total > shown)
+    {
+        printf("... %zu more\n", total - shown);
     }
-
-    pthread_t thread;
-    pthread_create(&thread, NULL, backupTable, table);
-    pthread_detach(thread);
-
-    unlockTable(table);
-    printf("Record added successfully!\n");
 }
 
-void update(Table *table, int id)
+void importMenu()
 {
-    lockTable(table);
-
-    void *data = findById(table, id);
-    if (data)
+    int tableNumber, format;
+    char path[256];
+    printf("Import into which table?\n");
+    for (int i = 0; i < TableCount; i++)
     {
-
-        int old_id = table->idExtract(data);
-        int old_hash_index = hashFunction(old_id);
-        HashNode **prev_ptr = &table->idHashTable.buckets[old_hash_index];
-        HashNode *current = *prev_ptr;
-
-        while (current)
-        {
-            if (table->idExtract(current->data) == old_id)
-            {
-                *prev_ptr = current->next;
-                free(current);
-                break;
-            }
-            prev_ptr = &current->next;
-            current = current->next;
-        }
-
-        table->inputFunction(data);
-
-        int new_id = table->idExtract(data);
-        int new_hash_index = hashFunction(new_id);
-        HashNode *newNode = malloc(sizeof(HashNode));
-        if (!newNode)
-        {
-            printf("Memory allocation failed!\n");
-            unlockTable(table);
-            return;
-        }
-        newNode->data = data;
-        newNode->next = table->idHashTable.buckets[new_hash_index];
-        table->idHashTable.buckets[new_hash_index] = newNode;
-
-        pthread_t thread;
-        pthread_create(&thread, NULL, backupTable, table);
-        pthread_detach(thread);
-
-        printf("Record updated successfully!\n");
+        printf("%d- %s\n", i + 1, tableName(hotelTable(i)));
     }
-    else
+    scanf("%d", &tableNumber);
+    if (tableNumber < 1 || tableNumber > TableCount)
     {
-        printf("Record not found!\n");
+        printf("Invalid choice!\n");
+        return;
+    }
+    printf("Enter file path: ");
+    scanf(" %255[^\n]", path);
+    printf("Format: 1- CSV  2- Binary (.dat layout)\n");
+    scanf("%d", &format);
+
+    Table *table = hotelTable(tableNumber - 1);
+    ImportStats stats;
+    HotelStatus status = importTable(table, path, format == 2, &stats);
+    if (status != HotelOk && stats.rows == 0)
+    {
+        printf("Could not read %s!\n", path);
+        return;
+    }
+    for (size_t i = 0; i < stats.invalid && i < ImportBadRowsShown; i++)
+    {
+        printf("%s %zu rejected: expected %s columns in order\n", format == 2 ? "Record" : "Line",
+               stats.rejected[i], tableName(table));
+    }
+    printf("%s: %zu rows read, %zu imported, %zu invalid, %zu duplicate ids in %.2fs (%.0f rows/sec)\n",
+           tableName(table), stats.rows, stats.imported, stats.invalid, stats.duplicates, stats.seconds,
+           stats.seconds > 0 ? stats.rows / stats.seconds : 0.0);
+    if (status != HotelOk)
+    {
+        printf("Import stopped early (%s), %s may be incomplete!\n", hotelStatusText(status), tableName(table));
     }
-
-    unlockTable(table);
 }
 
-void delete(Table *table, int id)
+void availabilityMenu()
 {
-    lockTable(table);
-
-    int idHashIndex = hashFunction(id);
-    HashNode *id_current = table->idHashTable.buckets[idHashIndex];
-    HashNode *id_prev = NULL;
+    int fromDay = inputDate("Enter Check-in Date (YYYY-MM-DD): ");
+    int toDay = inputDate("Enter Check-out Date (YYYY-MM-DD): ");
+    if (toDay <= fromDay)
+    {
+        printf("Check-out must be after check-in.\n");
+        return;
+    }
 
-    Node *list_current = table->head;
-    Node *list_prev = NULL;
+    int roomIds[100];
+    size_t total = findAvailableRooms(fromDay, toDay, roomIds, 100);
+    size_t shown = total < 100 ? total : 100;
 
-    while (list_current)
+    printf("\nAvailable rooms:\n");
+    for (size_t i = 0; i < shown; i++)
     {
-        int current_id = table->idExtract(list_current->data);
-
-        if (current_id == id)
+        struct Room room;
+        if (tableGet(hotelTable(RoomTable), roomIds[i], &room) == HotelOk)
         {
-            // remove id hash table
-            while (id_current)
-            {
-                if (table->idExtract(id_current->data) == id)
-                {
-                    if (id_prev)
-                    {
-                        id_prev->next = id_current->next;
-                    }
-                    else
-                    {
-                        table->idHashTable.buckets[idHashIndex] = id_current->next;
-                    }
-                    free(id_current);
-                    break;
-                }
-                id_prev = id_current;
-                id_current = id_current->next;
-            }
-
-            // remove from linked list
-            if (list_prev)
-            {
-                list_prev->next = list_current->next;
-            }
-            else
-            {
-                table->head = list_current->next;
-            }
-
-            free(list_current->data);
-            free(list_current);
-
-            // rewrite the file
-            FILE *file = fopen(table->filename, "wb");
-            if (file)
-            {
-                Node *node = table->head;
-                while (node)
-                {
-                    fwrite(node->data, table->dataSize, 1, file);
-                    node = node->next;
-                }
-                fclose(file);
-            }
-
-            printf("Record deleted successfully!\n");
-            unlockTable(table);
-            return;
+            displayRoom(stdout, &room);
         }
-
-        list_prev = list_current;
-        list_current = list_current->next;
     }
-
-    printf("Record not found!\n");
-    unlockTable(table);
+    if (total == 0)
+    {
+        printf("No rooms available!\n");
+    }
+    else if (total > shown)
+    {
+        printf("... %zu more\n", total - shown);
+    }
 }
 
-void *findByName(Table *table, const char *name)
+void roomSearchMenu()
 {
-    int hash_index = stringHashFunction(name);
-    HashNode *current = table->nameHashTable.buckets[hash_index];
-
-    while (current)
+    char roomType[50];
+    RoomFilter filter;
+    printf("Enter Minimum Price: ");
+    scanf("%lf", &filter.minPrice);
+    printf("Enter Maximum Price: ");
+    scanf("%lf", &filter.maxPrice);
+    printf("Enter Availability (1 for available, 0 for unavailable, -1 for any): ");
+    scanf("%d", &filter.availability);
+    printf("Enter Room Type (* for any): ");
+    scanf(" %49[^\n]", roomType);
+    filter.roomType = strcmp(roomType, "*") == 0 ? NULL : roomType;
+
+    int roomIds[100];
+    size_t total = findRooms(&filter, roomIds, 100);
+    size_t shown = total < 100 ? total : 100;
+
+    printf("\nMatching rooms:\n");
+    for (size_t i = 0; i < shown; i++)
     {
-        if (strcmp(table->nameExtract(current->data), name) == 0)
+        struct Room room;
+        if (tableGet(hotelTable(RoomTable), roomIds[i], &room) == HotelOk)
         {
-            return current->data;
+            displayRoom(stdout, &room);
         }
-        current = current->next;
     }
-    return NULL;
-}
-const char *extractCustomerName(void *data)
-{
-    return ((struct Customer *)data)->name;
-}
-int extractCustomerId(void *data)
-{
-    return ((struct Customer *)data)->customerID;
-}
-const char *extractRoomType(void *data)
-{
-    return ((struct Room *)data)->roomType;
-}
-
-int extractRoomId(void *data)
-{
-    return ((struct Room *)data)->roomID;
-}
-
-int extractReservationId(void *data)
-{
-    return ((struct Reservation *)data)->reservationID;
-}
-
-int extractReservationCustomerId(void *data)
-{
-    return ((struct Reservation *)data)->customerID;
-}
-
-int extractReservationRoomId(void *data)
-{
-    return ((struct Reservation *)data)->roomID;
-}
-
-int extractAmenityRoomId(void *data)
-{
-    return ((struct Amenity *)data)->RoomID;
-}
-
-int extractAmenityAmenityId(void *data)
-{
-    return ((struct Amenity *)data)->AmenityID;
-}
-
-int extractAmenityTypeId(void *data)
-{
-    return ((struct Amenity_Type *)data)->AmenityID;
-}
-
-const char *extractAmenityTypeName(void *data)
-{
-    return ((struct Amenity_Type *)data)->AmenityName;
-}
-
-int extractCustomerPlacesRoomId(void *data)
-{
-    return ((struct CUTSOMER_PLACES_ROOM *)data)->RoomID;
-}
-
-int extractCustomerPlacesRoomCustomerId(void *data)
-{
-    return ((struct CUTSOMER_PLACES_ROOM *)data)->customerID;
-}
-
-void displayCustomer(void *data)
-{
-    struct Customer *customer = (struct Customer *)data;
-    printf("ID: %d, Name: %s, Email: %s, Phone: %s, Address: %s\n",
-           customer->customerID, customer->name, customer->email,
-           customer->phone, customer->address);
-}
-void displayRoom(void *data)
-{
-    struct Room *room = (struct Room *)data;
-    printf("Room ID: %d, Room Type: %s, Price: %.2lf, Availability: %s\n",
-           room->roomID, room->roomType, room->price,
-           room->availability ? "Available" : "Not Available");
-}
-
-void displayReservation(void *data)
-{
-    struct Reservation *reservation = (struct Reservation *)data;
-    printf("Reservation ID: %d, Check-in: %s, Check-out: %s, Customer ID: %d, Room ID: %d\n",
-           reservation->reservationID, reservation->checkInDate, reservation->checkOutDate,
-           reservation->customerID, reservation->roomID);
-}
-
-void displayAmenity(void *data)
-{
-    struct Amenity *amenity = (struct Amenity *)data;
-    printf("Room ID: %d, Amenity ID: %d\n", amenity->RoomID, amenity->AmenityID);
+    if (total == 0)
+    {
+        printf("No matching rooms!\n");
+    }
+    else if (total > shown)
+    {
+        printf("... %zu more\n", total - shown);
+    }
 }
 
-void displayAmenityType(void *data)
+// the reservation and the room's occupant are written in one transaction,
+// which other threads see whole but a crash may keep only half of; the
+// room record itself is not changed
+void bookingMenu()
 {
-    struct Amenity_Type *amenityType = (struct Amenity_Type *)data;
-    printf("Amenity ID: %d, Amenity Name: %s\n", amenityType->AmenityID, amenityType->AmenityName);
+    struct Reservation reservation;
+    inputReservation(&reservation);
+    HotelStatus status = bookRoom(&reservation);
+    switch (status)
+    {
+    case HotelOk:
+        printf("Room %d booked!\n", reservation.roomID);
+        break;
+    case HotelConflict:
+        printf("Room %d is not available!\n", reservation.roomID);
+        break;
+    case HotelNotFound:
+        printf("No such room or customer!\n");
+        break;
+    case HotelDuplicate:
+        printf("Reservation with ID %d already exists! Retry again.\n", reservation.reservationID);
+        break;
+    case HotelIoError:
+        printf("Warning: the booking could not be saved to disk!\n");
+        break;
+    default:
+        printf("Booking failed: %s\n", hotelStatusText(status));
+    }
 }
 
-void displayCustomerPlacesRoom(void *data)
+// reports: joins run by the query engine, rows are printed as they arrive
+bool arrivesOn(const void *record, void *context)
 {
-    struct CUTSOMER_PLACES_ROOM *cpr = (struct CUTSOMER_PLACES_ROOM *)data;
-    printf("Customer ID: %d, Room ID: %d, Phone: %s\n", cpr->customerID, cpr->RoomID, cpr->phone);
+    return ((const struct Reservation *)record)->checkInDay == *(int *)context;
 }
 
-void inputCustomer(void *data)
-{
-    struct Customer *customer = (struct Customer *)data;
-    printf("Enter Customer ID: ");
-    scanf("%d", &customer->customerID);
-    printf("Enter Name: ");
-    scanf(" %[^\n]s", customer->name);
-    printf("Enter Email: ");
-    scanf(" %[^\n]s", customer->email);
-    printf("Enter Phone: ");
-    scanf(" %[^\n]s", customer->phone);
-    printf("Enter Address: ");
-    scanf(" %[^\n]s", customer->address);
-}
-void inputRoom(void *data)
+bool occupiedOn(const void *record, void *context)
 {
-    struct Room *room = (struct Room *)data;
-    printf("Enter Room ID: ");
-    scanf("%d", &room->roomID);
-    printf("Enter Room Type: ");
-    scanf(" %[^\n]s", room->roomType);
-    printf("Enter Room Price: ");
-    scanf("%lf", &room->price);
-    printf("Enter Availability (1 for available, 0 for unavailable): ");
-    scanf("%d", &room->availability);
+    const struct Reservation *reservation = record;
+    int day = *(int *)context;
+    return reservation->checkInDay <= day && day < reservation->checkOutDay;
 }
 
-void inputReservation(void *data)
+bool printArrival(const void *const *records, void *context)
 {
-    struct Reservation *reservation = (struct Reservation *)data;
-    printf("Enter Reservation ID: ");
-    scanf("%d", &reservation->reservationID);
-    printf("Enter Check-in Date (YYYY-MM-DD): ");
-    scanf(" %[^\n]s", reservation->checkInDate);
-    printf("Enter Check-out Date (YYYY-MM-DD): ");
-    scanf(" %[^\n]s", reservation->checkOutDate);
-    printf("Enter Customer ID: ");
-    scanf("%d", &reservation->customerID);
-    printf("Enter Room ID: ");
-    scanf("%d", &reservation->roomID);
+    const struct Reservation *reservation = records[0];
+    const struct Customer *customer = records[1];
+    const struct Room *room = records[2];
+    printf("Reservation ID: %d, Customer: %s, Room ID: %d, Room Type: %s\n", reservation->reservationID,
+           customer->name, room->roomID, room->roomType);
+    (*(size_t *)context)++;
+    return true;
 }
 
-void inputAmenity(void *data)
+bool printAmenity(const void *const *records, void *context)
 {
-    struct Amenity *amenity = (struct Amenity *)data;
-    printf("Enter Room ID: ");
-    scanf("%d", &amenity->RoomID);
-    printf("Enter Amenity ID: ");
-    scanf("%d", &amenity->AmenityID);
+    const struct Reservation *reservation = records[0];
+    const struct Amenity_Type *amenityType = records[2];
+    printf("Room ID: %d, Amenity: %s\n", reservation->roomID, amenityType->AmenityName);
+    (*(size_t *)context)++;
+    return true;
 }
 
-void inputAmenityType(void *data)
+void reportsMenu()
 {
-    struct Amenity_Type *amenityType = (struct Amenity_Type *)data;
-    printf("Enter Amenity ID: ");
-    scanf("%d", &amenityType->AmenityID);
-    printf("Enter Amenity Name: ");
-    scanf(" %[^\n]s", amenityType->AmenityName);
-}
+    int choice;
+    printf("\n1. Arrivals\n");
+    printf("2. Amenities of Occupied Rooms\n");
+    printf("Enter choice: ");
+    scanf("%d", &choice);
+    if (choice != 1 && choice != 2)
+    {
+        printf("Invalid choice!\n");
+        return;
+    }
+    int day = inputDate("Enter Date (YYYY-MM-DD): ");
 
-void inputCustomerPlacesRoom(void *data)
-{
-    struct CUTSOMER_PLACES_ROOM *cpr = (struct CUTSOMER_PLACES_ROOM *)data;
-    printf("Enter Customer ID: ");
-    scanf("%d", &cpr->customerID);
-    printf("Enter Room ID: ");
-    scanf("%d", &cpr->RoomID);
-    printf("Enter Phone Number: ");
-    scanf(" %[^\n]s", cpr->phone);
+    Query query;
+    size_t rows = 0;
+    HotelStatus status;
+    if (choice == 1)
+    {
+        query = (Query){
+            .tables = {
+                {ReservationTable, arrivesOn, &day},
+                {CustomerTable, NULL, NULL, "customerID", 0, "customerID"},
+                {RoomTable, NULL, NULL, "roomID", 0, "roomID"},
+            },
+            .tableCount = 3,
+        };
+        status = runQuery(&query, printArrival, &rows);
+    }
+    else
+    {
+        query = (Query){
+            .tables = {
+                {ReservationTable, occupiedOn, &day},
+                {AmenityTable, NULL, NULL, "RoomID", 0, "roomID"},
+                {AmenityTypeTable, NULL, NULL, "AmenityID", 1, "AmenityID"},
+            },
+            .tableCount = 3,
+        };
+        status = runQuery(&query, printAmenity, &rows);
+    }
+    if (status != HotelOk)
+    {
+        printf("Report failed: %s\n", hotelStatusText(status));
+    }
+    else if (rows == 0)
+    {
+        printf("No records found!\n");
+    }
 }
 
-void menuCallFunction(Table *table)
+void menuCallFunction(HotelTableId tableId)
 {
+    Table *table = hotelTable(tableId);
     int choice;
     do
     {
-        printf("\n%s Operations:\n", table->name);
+        printf("\n%s Operations:\n", tableName(table));
         printf("1. Insert\n");
         printf("2. Display\n");
         printf("3. Update\n");
@@ -614,71 +542,46 @@ void menuCallFunction(Table *table)
         switch (choice)
         {
         case 1:
-            insert(table);
+            insert(tableId);
             break;
         case 2:
-            display(table);
+            display(tableId);
             break;
         case 3:
             printf("Enter ID to update: ");
             scanf("%d", &id);
-            update(table, id);
+            update(tableId, id);
             break;
         case 4:
             printf("Enter ID to delete: ");
             scanf("%d", &id);
-            delete (table, id);
+            delete (tableId, id);
             break;
         case 5:
-            // lockTable(table);
-
             printf("You want the search by id or name\n");
             printf("1- Id\n");
             printf("2- Name\n");
+            printf("3- Name prefix\n");
+            for (int i = 0; i < tableSecondaryCount(table); i++)
+            {
+                printf("%d- %s\n", i + 4, tableSecondaryName(table, i));
+            }
             int searchOption = 0;
             scanf("%d", &searchOption);
 
-            if (searchOption == 1)
+            char *records = malloc(100 * tableRecordSize(table));
+            if (!records)
+            {
+                printf("Memory allocation failed!\n");
+            }
+            else if (searchOption == 1)
             {
-
                 printf("Enter ID to search: ");
                 scanf("%d", &id);
-                printf("Searching by id in %s table....\n", table->name);
-                void *data = findById(table, id);
-
-                if (data)
+                printf("Searching by id in %s table....\n", tableName(table));
+                if (tableGet(table, id, records) == HotelOk)
                 {
-                    // printf("data");
-                    if (strcmp(table->name, "Customer") == 0)
-                    {
-                        displayCustomer(data);
-                    }
-                    else if (strcmp(table->name, "Room") == 0)
-                    {
-
-                        displayRoom(data);
-                    }
-                    else if (strcmp(table->name, "Amenity") == 0)
-                    {
-                        displayAmenity(data);
-                    }
-                    else if (strcmp(table->name, "Reservation") == 0)
-                    {
-                        printf("gggg");
-                        displayRoom(data);
-                    }
-                    else if (strcmp(table->name, "Amenity_Type") == 0)
-                    {
-                        displayAmenity(data);
-                    }
-                    else if (strcmp(table->name, "CUTSOMER_PLACES_ROOM") == 0)
-                    {
-                        displayAmenity(data);
-                    }
-                    //  struct Customer* customer = (struct Customer*)data;
-                    //   printf("  ->  ID: %d, Name: %s, Email: %s, Phone: %s, Address: %s\n",
-                    //   customer->customerID, customer->name, customer->email,
-                    //   customer->phone, customer->address);
+                    views[tableId].displayFunction(stdout, records);
                 }
                 else
                 {
@@ -690,40 +593,29 @@ void menuCallFunction(Table *table)
                 printf("Enter Name to search: ");
                 printf("Enter Name: ");
                 char name[100];
-                scanf(" %[^\n]s", name);
-                printf("Searching by name in %s table....\n", table->name);
-                void *data = findByName(table, name);
-
-                if (data)
-                {
-                    // printf("data");
-                    if (strcmp(table->name, "Customer") == 0)
-                    {
-                        displayCustomer(data);
-                    }
-                    else if (strcmp(table->name, "Room") == 0)
-                    {
-                        printf("gggg");
-                        displayRoom(data);
-                    }
-                    else if (strcmp(table->name, "Amenity") == 0)
-                    {
-                        displayAmenity(data);
-                    }
-                    //  struct Customer* customer = (struct Customer*)data;
-                    //   printf("  ->  ID: %d, Name: %s, Email: %s, Phone: %s, Address: %s\n",
-                    //   customer->customerID, customer->name, customer->email,
-                    //   customer->phone, customer->address);
-                }
-                else
-                {
-                    printf("Record not found");
-                }
+                scanf(" %99[^\n]", name);
+                printf("Searching by name in %s table....\n", tableName(table));
+                showMatches(tableId, records, tableFindByName(table, name, records, 100), 100);
+            }
+            else if (searchOption == 3)
+            {
+                printf("Enter the start of the name (any case): ");
+                char prefix[100];
+                scanf(" %99[^\n]", prefix);
+                showMatches(tableId, records, tableSearchByName(table, prefix, true, records, 20), 20);
+            }
+            else if (searchOption >= 4 && searchOption < tableSecondaryCount(table) + 4)
+            {
+                int indexNumber = searchOption - 4;
+                printf("Enter %s to search: ", tableSecondaryName(table, indexNumber));
+                scanf("%d", &id);
+                showMatches(tableId, records, tableFindBySecondary(table, indexNumber, id, records, 100), 100);
             }
             else
             {
                 printf("Invallid choice");
             }
+            free(records);
 
         case 6:
             return;
@@ -733,145 +625,57 @@ void menuCallFunction(Table *table)
     } while (choice != 5);
 }
 
-// Initialize tables
-
-void initializeTables()
-{
-    // Initialize Customer table
-    tables[0] = (Table){
-        .name = "Customer",
-        .head = NULL,
-        .filename = "customers.dat",
-        .dataSize = sizeof(struct Customer),
-        .displayFunction = displayCustomer,
-        .inputFunction = inputCustomer,
-        .idExtract = extractCustomerId,
-        .nameExtract = extractCustomerName,
-        .lockCounter = 0,
-
-    };
-    // pthread_mutex_init(&tables[0].mutex, NULL);
-
-    tables[1] = (Table){
-        .name = "Room",
-        .head = NULL,
-        .filename = "room.dat",
-        .dataSize = sizeof(struct Room),
-        .displayFunction = displayRoom,
-        .inputFunction = inputRoom,
-        .idExtract = extractRoomId,
-        .nameExtract = extractRoomType,
-        .lockCounter = 0,
-    };
-    // pthread_mutex_init(&tables[1].mutex, NULL);
-
-    tables[2] = (Table){
-        .name = "Reservation",
-        .head = NULL,
-        .filename = "reservation.dat",
-        .dataSize = sizeof(struct Reservation),
-        .displayFunction = displayReservation,
-        .inputFunction = inputReservation,
-        .idExtract = extractReservationId,
-        .nameExtract = NULL,
-        .lockCounter = 0,
-
-    };
-    // pthread_mutex_init(&tables[2].mutex, NULL);
-
-    tables[3] = (Table){
-        .name = "Amenity",
-        .head = NULL,
-        .filename = "amenity.dat",
-        .dataSize = sizeof(struct Amenity),
-        .displayFunction = displayAmenity,
-        .inputFunction = inputAmenity,
-        .idExtract = extractAmenityRoomId,
-        .nameExtract = NULL,
-        .lockCounter = 0,
-
-    };
-    // pthread_mutex_init(&tables[3].mutex, NULL);
-
-    tables[4] = (Table){
-        .name = "Amenity_Type",
-        .head = NULL,
-        .filename = "amenity_type.dat",
-        .dataSize = sizeof(struct Amenity_Type),
-        .displayFunction = displayAmenityType,
-        .inputFunction = inputAmenityType,
-        .idExtract = extractAmenityTypeId,
-        .nameExtract = extractAmenityTypeName,
-        .lockCounter = 0,
-    };
-    // pthread_mutex_init(&tables[4].mutex, NULL);
-
-    tables[5] = (Table){
-        .name = "CUTSOMER_PLACES_ROOM",
-        .head = NULL,
-        .filename = "CUTSOMER_PLACES_ROOM.dat",
-        .dataSize = sizeof(struct CUTSOMER_PLACES_ROOM),
-        .displayFunction = displayCustomerPlacesRoom,
-        .inputFunction = inputCustomerPlacesRoom,
-        .idExtract = extractCustomerPlacesRoomId,
-        .nameExtract = NULL,
-        .lockCounter = 0,
-    };
-    // pthread_mutex_init(&tables[5].mutex, NULL);
-
-    // retrieve data from files
-
-    for (int i = 0; i < 6; i++)
-    {
-        FILE *file = fopen(tables[i].filename, "rb");
-        if (file)
-        {
-            void *data = malloc(tables[i].dataSize);
-            while (fread(data, tables[i].dataSize, 1, file) == 1)
-            {
-                Node *node = malloc(sizeof(Node));
-                node->data = data;
-                node->next = tables[i].head;
-                tables[i].head = node;
-
-                int id = tables[i].idExtract(data);
-                int idHashIndex = hashFunction(id);
-                HashNode *idHashNode = malloc(sizeof(HashNode));
-                idHashNode->data = data;
-                idHashNode->next = tables[i].idHashTable.buckets[idHashIndex];
-                tables[i].idHashTable.buckets[idHashIndex] = idHashNode;
-
-                if (tables[i].nameExtract)
-                {
-                    const char *name = tables[i].nameExtract(data);
-                    int nameHashIndex = stringHashFunction(name);
-                    HashNode *nameHashNode = malloc(sizeof(HashNode));
-                    nameHashNode->data = data;
-                    nameHashNode->next = tables[i].nameHashTable.buckets[nameHashIndex];
-                    tables[i].nameHashTable.buckets[nameHashIndex] = nameHashNode;
-                }
-
-                data = malloc(tables[i].dataSize);
-            }
-            free(data);
-            fclose(file);
-        }
+void printStats()
+{
+    for (int i = 0; i < TableCount; i++)
+    {
+        TableMemoryStats memory;
+        TableLockStats lock;
+        tableMemoryStats(hotelTable(i), &memory);
+        tableLockStats(hotelTable(i), &lock);
+        printf("%s memory: %zu records, %.2f MB in slabs (%.2f MB used), %.2f MB id index, %.2f MB columns\n",
+               tableName(hotelTable(i)), memory.records, memory.slabBytes / 1048576.0,
+               memory.usedBytes / 1048576.0, memory.idIndexBytes / 1048576.0, memory.columnBytes / 1048576.0);
+        printf("%s lock: %llu acquired, %llu contended, %.3f ms waited, %.3f ms held\n",
+               tableName(hotelTable(i)), lock.acquired, lock.contended, lock.waitNanos / 1e6,
+               lock.holdNanos / 1e6);
     }
 }
 
-void cleanup()
+void metricsMenu()
 {
-    for (int i = 0; i < 6; i++)
+    for (int i = 0; i < TableCount; i++)
     {
-        Node *current = tables[i].head;
-        while (current)
+        TableMetrics metrics;
+        tableMetrics(hotelTable(i), &metrics);
+        printf("\n%s:\n", tableName(hotelTable(i)));
+        for (int op = 0; op < OperationCount; op++)
+        {
+            OperationStats *stats = &metrics.operations[op];
+            if (stats->count > 0)
+            {
+                printf("  %-16s %8llu calls, mean %.1f us, p50 < %.1f us, p99 < %.1f us\n", operationName(op),
+                       stats->count, stats->totalNanos / 1e3 / stats->count, metricsPercentile(stats, 0.50) / 1e3,
+                       metricsPercentile(stats, 0.99) / 1e3);
+            }
+        }
+        printf("  lock: %llu acquired, %llu contended, %.3f ms waited, %.3f ms held\n", metrics.lock.acquired,
+               metrics.lock.contended, metrics.lock.waitNanos / 1e6, metrics.lock.holdNanos / 1e6);
+        printf("  backups: %llu, %.2f MB written, %.3f ms total, %.3f ms in fsync\n", metrics.backups,
+               metrics.backupBytes / 1048576.0, metrics.backupNanos / 1e6, metrics.backupSyncNanos / 1e6);
+        printf("  log: %llu flushes, %.2f MB written, %.3f ms in fdatasync\n", metrics.logFlushes,
+               metrics.logBytes / 1048576.0, metrics.logSyncNanos / 1e6);
+        printf("  id probes (1..%d+):", ChainBuckets);
+        for (int b = 0; b < ChainBuckets; b++)
+        {
+            printf(" %llu", metrics.idProbeLengths[b]);
+        }
+        printf("\n  name chain positions (1..%d+):", ChainBuckets);
+        for (int b = 0; b < ChainBuckets; b++)
         {
-            Node *temp = current;
-            current = current->next;
-            free(temp->data);
-            free(temp);
+            printf(" %llu", metrics.nameChainLengths[b]);
         }
-        // pthread_mutex_destroy(&tables[i].mutex);
+        printf("\n");
     }
 }
 
@@ -888,7 +692,40 @@ int main()
     printf("\t\t*               Database Programming            *\n");
     printf("\t\t*************************************************\n\n\n");
 
-    initializeTables();
+    HotelOpenReport report;
+    HotelStatus status = hotelOpen(&report);
+    if (report.migratedReservations > 0)
+    {
+        printf("Migrated %zu reservations to packed dates (%zu with unreadable dates)\n",
+               report.migratedReservations, report.invalidDates);
+    }
+    for (int i = 0; i < TableCount; i++)
+    {
+        if (report.recovered[i] > 0)
+        {
+            printf("Recovered %zu logged changes for %s\n", report.recovered[i], tableName(hotelTable(i)));
+        }
+        if (report.damaged[i] > 0)
+        {
+            printf("Warning: %zu %s records could not be read, the file is kept as a .damaged copy!\n",
+                   report.damaged[i], tableName(hotelTable(i)));
+        }
+    }
+    if (status != HotelOk)
+    {
+        printf("Warning: %s while opening the database, some changes may not be saved!\n",
+               hotelStatusText(status));
+    }
+    if (enableRoomColumns() != HotelOk)
+    {
+        printf("Warning: room search will scan every record!\n");
+    }
+    // HOTEL_METRICS=path appends a metrics snapshot every ten seconds
+    const char *metricsPath = getenv("HOTEL_METRICS");
+    if (metricsPath && !startMetricsDump(metricsPath, 10000))
+    {
+        printf("Warning: could not write metrics to %s!\n", metricsPath);
+    }
 
     do
     {
@@ -898,32 +735,57 @@ int main()
         printf("3. Reservation Management\n");
         printf("5. Amenity type Management\n");
         printf("6. Customer Places Room Management\n");
+        printf("8. Find Available Rooms\n");
+        printf("9. Bulk Import\n");
+        printf("10. Statistics\n");
+        printf("11. Search Rooms\n");
+        printf("12. Reports\n");
+        printf("13. Book a Room\n");
         printf("7. Exit\n");
         printf("Enter choice: \n");
         scanf("%d", &choice);
         switch (choice)
         {
         case 1:
-            menuCallFunction(&tables[choice - 1]);
+            menuCallFunction(choice - 1);
             break;
         case 2:
-            menuCallFunction(&tables[choice - 1]);
+            menuCallFunction(choice - 1);
             break;
         case 3:
-            menuCallFunction(&tables[choice - 1]);
+            menuCallFunction(choice - 1);
             break;
         case 4:
-            menuCallFunction(&tables[choice - 1]);
+            menuCallFunction(choice - 1);
             break;
         case 5:
-            menuCallFunction(&tables[choice - 1]);
+            menuCallFunction(choice - 1);
             break;
         case 6:
-            menuCallFunction(&tables[choice - 1]);
+            menuCallFunction(choice - 1);
+            break;
+        case 8:
+            availabilityMenu();
+            break;
+        case 9:
+            importMenu();
+            break;
+        case 10:
+            metricsMenu();
+            break;
+        case 11:
+            roomSearchMenu();
+            break;
+        case 12:
+            reportsMenu();
+            break;
+        case 13:
+            bookingMenu();
             break;
         case 7:
             printf("Thank you for using Hotel Management System!\n");
-            cleanup();
+            printStats();
+            hotelClose();
             break;
         default:
             printf("Invalid choice!\n");
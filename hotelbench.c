@@ -0,0 +1,584 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include "hoteldb.h"
+
+// benchmark driver: fills each table with synthetic rows through the bulk
+// importer, then times every operation of the public API and prints one
+// line per measurement (CSV by default, JSON lines with -f json)
+#define DefaultSamples 1000
+#define DefaultThreads 4
+#define MaxRowCounts 16
+#define MaxBenchThreads 64
+
+typedef struct
+{
+    const char *format;
+    const char *directory;
+    size_t rowCounts[MaxRowCounts];
+    int rowCountCount;
+    size_t samples;
+    int threads;
+    int onlyTable;
+    unsigned int seed;
+} BenchOptions;
+
+typedef struct
+{
+    unsigned long long *nanos;
+    size_t count;
+    size_t capacity;
+} Latencies;
+
+BenchOptions options;
+bool headerPrinted = false;
+// calls that did not return HotelOk since the last report
+size_t failures = 0;
+
+unsigned long long benchNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// xorshift, one state per thread so the mixes do not share a generator
+unsigned int nextRandom(unsigned int *state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x ? x : 1;
+}
+
+bool latenciesInit(Latencies *latencies, size_t capacity)
+{
+    latencies->nanos = malloc((capacity + 1) * sizeof(unsigned long long));
+    latencies->count = 0;
+    latencies->capacity = capacity;
+    return latencies->nanos != NULL;
+}
+
+void latenciesAdd(Latencies *latencies, unsigned long long nanos)
+{
+    if (latencies->count < latencies->capacity)
+    {
+        latencies->nanos[latencies->count++] = nanos;
+    }
+}
+
+int compareNanos(const void *a, const void *b)
+{
+    unsigned long long left = *(const unsigned long long *)a, right = *(const unsigned long long *)b;
+    return (left > right) - (left < right);
+}
+
+double percentile(Latencies *latencies, double fraction)
+{
+    if (latencies->count == 0)
+    {
+        return 0;
+    }
+    size_t index = (size_t)(fraction * (latencies->count - 1) + 0.5);
+    return latencies->nanos[index] / 1e3;
+}
+
+void check(HotelStatus status)
+{
+    if (status != HotelOk)
+    {
+        failures++;
+    }
+}
+
+// prints one measurement; ops finished in seconds, latencies in microseconds
+void report(const char *table, size_t rows, int threads, const char *operation, size_t ops, double seconds,
+            Latencies *latencies)
+{
+    qsort(latencies->nanos, latencies->count, sizeof(unsigned long long), compareNanos);
+    double p50 = percentile(latencies, 0.50);
+    double p99 = percentile(latencies, 0.99);
+    double rate = seconds > 0 ? ops / seconds : 0;
+
+    if (strcmp(options.format, "json") == 0)
+    {
+        printf("{\"table\":\"%s\",\"rows\":%zu,\"threads\":%d,\"operation\":\"%s\",\"ops\":%zu,"
+               "\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"errors\":%zu}\n",
+               table, rows, threads, operation, ops, seconds, rate, p50, p99, failures);
+    }
+    else
+    {
+        if (!headerPrinted)
+        {
+            printf("table,rows,threads,operation,ops,seconds,ops_per_sec,p50_us,p99_us,errors\n");
+            headerPrinted = true;
+        }
+        printf("%s,%zu,%d,%s,%zu,%.6f,%.1f,%.2f,%.2f,%zu\n", table, rows, threads, operation, ops, seconds, rate,
+               p50, p99, failures);
+    }
+    fflush(stdout);
+    failures = 0;
+}
+
+// synthetic row number i of a table; ids are i so lookups can pick any row
+// below the populated count, names repeat every 1000 rows
+void makeRecord(HotelTableId id, size_t i, unsigned int salt, void *record)
+{
+    memset(record, 0, tableRecordSize(hotelTable(id)));
+    int key = (int)i;
+    switch (id)
+    {
+    case CustomerTable:
+    {
+        struct Customer *customer = record;
+        customer->customerID = key;
+        snprintf(customer->name, sizeof(customer->name), "Guest %zu", i % 1000);
+        snprintf(customer->email, sizeof(customer->email), "guest%zu.%u@example.com", i, salt);
+        snprintf(customer->phone, sizeof(customer->phone), "555-%04zu", i % 10000);
+        snprintf(customer->address, sizeof(customer->address), "%zu Harbour Road", i % 5000);
+        break;
+    }
+    case RoomTable:
+    {
+        struct Room *room = record;
+        room->roomID = key;
+        snprintf(room->roomType, sizeof(room->roomType), "Type %zu", i % 1000);
+        room->price = 50 + (i + salt) % 400;
+        room->availability = (i + salt) % 2;
+        break;
+    }
+    case ReservationTable:
+    {
+        struct Reservation *reservation = record;
+        reservation->reservationID = key;
+        reservation->checkInDay = 20000 + (int)((i * 7 + salt) % 1000);
+        reservation->checkOutDay = reservation->checkInDay + 1 + (int)(i % 14);
+        reservation->customerID = (int)(i % 100000);
+        reservation->roomID = (int)(i % 5000);
+        break;
+    }
+    case AmenityTable:
+    {
+        struct Amenity *amenity = record;
+        amenity->RoomID = key;
+        amenity->AmenityID = (int)((i + salt) % 50);
+        break;
+    }
+    case AmenityTypeTable:
+    {
+        struct Amenity_Type *amenityType = record;
+        amenityType->AmenityID = key;
+        snprintf(amenityType->AmenityName, sizeof(amenityType->AmenityName), "Amenity %zu", i % 1000);
+        break;
+    }
+    default:
+    {
+        struct CUTSOMER_PLACES_ROOM *cpr = record;
+        cpr->RoomID = key;
+        cpr->customerID = (int)((i + salt) % 100000);
+        snprintf(cpr->phone, sizeof(cpr->phone), "555-%04zu", i % 10000);
+        break;
+    }
+    }
+}
+
+bool hasNames(HotelTableId id)
+{
+    return id == CustomerTable || id == RoomTable || id == AmenityTypeTable;
+}
+
+void nameOf(HotelTableId id, size_t i, char *name, size_t size)
+{
+    snprintf(name, size, id == CustomerTable ? "Guest %zu" : id == RoomTable ? "Type %zu" : "Amenity %zu", i % 1000);
+}
+
+int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+// every measurement starts from an empty directory
+bool freshDirectory(const char *path)
+{
+    nftw(path, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    return mkdir(path, 0755) == 0 && chdir(path) == 0;
+}
+
+bool writeRows(HotelTableId id, size_t rows, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    size_t size = tableRecordSize(hotelTable(id));
+    char *record = malloc(size);
+    bool ok = file && record;
+    for (size_t i = 0; ok && i < rows; i++)
+    {
+        makeRecord(id, i, 0, record);
+        ok = fwrite(record, size, 1, file) == 1;
+    }
+    free(record);
+    if (file)
+    {
+        ok = fclose(file) == 0 && ok;
+    }
+    return ok;
+}
+
+typedef struct
+{
+    HotelTableId id;
+    size_t rows;
+    size_t ops;
+    int writePercent;
+    unsigned int seed;
+    size_t failures;
+    Latencies latencies;
+} MixTask;
+
+void *runMix(void *arg)
+{
+    MixTask *task = (MixTask *)arg;
+    Table *table = hotelTable(task->id);
+    char *record = malloc(tableRecordSize(table));
+    unsigned int state = task->seed;
+    for (size_t n = 0; record && n < task->ops; n++)
+    {
+        size_t i = nextRandom(&state) % task->rows;
+        bool write = (int)(nextRandom(&state) % 100) < task->writePercent;
+        unsigned long long start = benchNanos();
+        if (write)
+        {
+            makeRecord(task->id, i, state, record);
+            task->failures += tableUpdate(table, (int)i, record) != HotelOk;
+        }
+        else
+        {
+            task->failures += tableGet(table, (int)i, record) != HotelOk;
+        }
+        latenciesAdd(&task->latencies, benchNanos() - start);
+    }
+    free(record);
+    return NULL;
+}
+
+// threads run a read/write mix of tableGet and tableUpdate on random rows
+void benchMix(HotelTableId id, size_t rows, int writePercent)
+{
+    int threads = options.threads;
+    MixTask tasks[MaxBenchThreads];
+    pthread_t handles[MaxBenchThreads];
+    Latencies all;
+    if (!latenciesInit(&all, options.samples * threads))
+    {
+        return;
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        tasks[t] = (MixTask){
+            .id = id,
+            .rows = rows,
+            .ops = options.samples,
+            .writePercent = writePercent,
+            .seed = options.seed + 7919u * (t + 1),
+        };
+        latenciesInit(&tasks[t].latencies, options.samples);
+    }
+
+    unsigned long long start = benchNanos();
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_create(&handles[t], NULL, runMix, &tasks[t]);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(handles[t], NULL);
+    }
+    double seconds = (benchNanos() - start) / 1e9;
+
+    for (int t = 0; t < threads; t++)
+    {
+        for (size_t i = 0; i < tasks[t].latencies.count; i++)
+        {
+            latenciesAdd(&all, tasks[t].latencies.nanos[i]);
+        }
+        free(tasks[t].latencies.nanos);
+        failures += tasks[t].failures;
+    }
+    char operation[32];
+    snprintf(operation, sizeof(operation), "mix_%dr_%dw", 100 - writePercent, writePercent);
+    report(tableName(hotelTable(id)), rows, threads, operation, all.count, seconds, &all);
+    free(all.nanos);
+}
+
+bool countVisitor(const void *record, void *context)
+{
+    (void)record;
+    (*(size_t *)context)++;
+    return true;
+}
+
+void benchTable(HotelTableId id, size_t rows, const char *runDirectory)
+{
+    if (!freshDirectory(runDirectory) || hotelOpen(NULL) != HotelOk)
+    {
+        fprintf(stderr, "could not open a database in %s\n", runDirectory);
+        return;
+    }
+    Table *table = hotelTable(id);
+    const char *name = tableName(table);
+    size_t size = tableRecordSize(table);
+    size_t samples = options.samples < rows ? options.samples : rows;
+    char *record = malloc(size);
+    Latencies latencies;
+    if (!record || !latenciesInit(&latencies, options.samples * 4 + 16))
+    {
+        free(record);
+        hotelClose();
+        return;
+    }
+    unsigned int state = options.seed;
+
+    // populate through the bulk importer; the file is written beforehand
+    if (!writeRows(id, rows, "rows.bin"))
+    {
+        fprintf(stderr, "could not write rows for %s\n", name);
+        free(record);
+        free(latencies.nanos);
+        hotelClose();
+        return;
+    }
+    ImportStats stats;
+    check(importTable(table, "rows.bin", true, &stats));
+    failures += rows - stats.imported;
+    remove("rows.bin");
+    latencies.count = 0;
+    report(name, rows, 1, "import", stats.imported, stats.seconds, &latencies);
+
+    latencies.count = 0;
+    unsigned long long begin = benchNanos();
+    for (size_t n = 0; n < samples; n++)
+    {
+        size_t i = nextRandom(&state) % rows;
+        unsigned long long start = benchNanos();
+        check(tableGet(table, (int)i, record));
+        latenciesAdd(&latencies, benchNanos() - start);
+    }
+    report(name, rows, 1, "findById", samples, (benchNanos() - begin) / 1e9, &latencies);
+
+    if (hasNames(id))
+    {
+        void *matches = malloc(16 * size);
+        char text[64];
+        latencies.count = 0;
+        begin = benchNanos();
+        for (size_t n = 0; matches && n < samples; n++)
+        {
+            nameOf(id, nextRandom(&state) % rows, text, sizeof(text));
+            unsigned long long start = benchNanos();
+            failures += tableFindByName(table, text, matches, 16) == 0;
+            latenciesAdd(&latencies, benchNanos() - start);
+        }
+        report(name, rows, 1, "findByName", samples, (benchNanos() - begin) / 1e9, &latencies);
+        free(matches);
+    }
+
+    latencies.count = 0;
+    begin = benchNanos();
+    for (size_t n = 0; n < samples; n++)
+    {
+        size_t i = nextRandom(&state) % rows;
+        makeRecord(id, i, state, record);
+        unsigned long long start = benchNanos();
+        check(tableUpdate(table, (int)i, record));
+        latenciesAdd(&latencies, benchNanos() - start);
+    }
+    report(name, rows, 1, "update", samples, (benchNanos() - begin) / 1e9, &latencies);
+
+    latencies.count = 0;
+    begin = benchNanos();
+    for (size_t n = 0; n < samples; n++)
+    {
+        makeRecord(id, rows + n, 0, record);
+        unsigned long long start = benchNanos();
+        check(tableInsert(table, record));
+        latenciesAdd(&latencies, benchNanos() - start);
+    }
+    report(name, rows, 1, "insert", samples, (benchNanos() - begin) / 1e9, &latencies);
+
+    // delete the rows just inserted so the populated count is unchanged
+    latencies.count = 0;
+    begin = benchNanos();
+    for (size_t n = 0; n < samples; n++)
+    {
+        unsigned long long start = benchNanos();
+        check(tableDelete(table, (int)(rows + n)));
+        latenciesAdd(&latencies, benchNanos() - start);
+    }
+    report(name, rows, 1, "delete", samples, (benchNanos() - begin) / 1e9, &latencies);
+
+    size_t scans = samples / 100 > 0 ? (samples / 100 < 10 ? samples / 100 : 10) : 1;
+    latencies.count = 0;
+    begin = benchNanos();
+    for (size_t n = 0; n < scans; n++)
+    {
+        size_t visited = 0;
+        unsigned long long start = benchNanos();
+        tableScan(table, countVisitor, &visited);
+        latenciesAdd(&latencies, benchNanos() - start);
+        failures += visited != rows;
+    }
+    report(name, rows, 1, "scan", scans, (benchNanos() - begin) / 1e9, &latencies);
+
+    benchMix(id, rows, 10);
+    benchMix(id, rows, 50);
+
+    // backup: one change queues the table, flushNow waits for its checkpoint
+    latencies.count = 0;
+    begin = benchNanos();
+    for (int n = 0; n < 3; n++)
+    {
+        makeRecord(id, 0, state + n, record);
+        check(tableUpdate(table, 0, record));
+        unsigned long long start = benchNanos();
+        flushNow();
+        latenciesAdd(&latencies, benchNanos() - start);
+    }
+    report(name, rows, 1, "backup", 3, (benchNanos() - begin) / 1e9, &latencies);
+
+    // startup: reopen every table from the files just checkpointed
+    latencies.count = 0;
+    double startupSeconds = 0;
+    for (int n = 0; n < 3; n++)
+    {
+        hotelClose();
+        unsigned long long start = benchNanos();
+        check(hotelOpen(NULL));
+        unsigned long long elapsed = benchNanos() - start;
+        startupSeconds += elapsed / 1e9;
+        latenciesAdd(&latencies, elapsed);
+    }
+    report(name, rows, 1, "startup", 3, startupSeconds, &latencies);
+
+    hotelClose();
+    free(record);
+    free(latencies.nanos);
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-r rows]... [-s samples] [-t threads] [-T table] [-f csv|json] [-d directory] [-S seed]\n"
+            "  -r  rows to populate, repeatable, 1000 to 10000000 (default 1000 10000 100000)\n"
+            "  -s  operations timed per measurement (default %d)\n"
+            "  -t  threads in the read/write mixes (default %d)\n"
+            "  -T  only this table, 1-6 in menu order\n"
+            "  -d  scratch directory, emptied before every run (default ./bench-data)\n",
+            program, DefaultSamples, DefaultThreads);
+}
+
+int main(int argc, char **argv)
+{
+    options = (BenchOptions){
+        .format = "csv",
+        .directory = "bench-data",
+        .samples = DefaultSamples,
+        .threads = DefaultThreads,
+        .seed = 12345,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:t:T:f:d:S:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            if (options.rowCountCount < MaxRowCounts)
+            {
+                options.rowCounts[options.rowCountCount++] = strtoull(optarg, NULL, 10);
+            }
+            break;
+        case 's':
+            options.samples = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            options.threads = atoi(optarg);
+            break;
+        case 'T':
+            options.onlyTable = atoi(optarg);
+            break;
+        case 'f':
+            options.format = optarg;
+            break;
+        case 'd':
+            options.directory = optarg;
+            break;
+        case 'S':
+            options.seed = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.rowCountCount == 0)
+    {
+        size_t defaults[] = {1000, 10000, 100000};
+        memcpy(options.rowCounts, defaults, sizeof(defaults));
+        options.rowCountCount = 3;
+    }
+    if (options.threads < 1 || options.threads > MaxBenchThreads || options.samples == 0 ||
+        options.onlyTable < 0 || options.onlyTable > TableCount ||
+        (strcmp(options.format, "csv") != 0 && strcmp(options.format, "json") != 0))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    for (int r = 0; r < options.rowCountCount; r++)
+    {
+        if (options.rowCounts[r] < 1 || options.rowCounts[r] > 2147483647UL - options.samples)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        return 1;
+    }
+    char runDirectory[4096 + 64];
+    if (options.directory[0] == '/')
+    {
+        snprintf(runDirectory, sizeof(runDirectory), "%s", options.directory);
+    }
+    else
+    {
+        snprintf(runDirectory, sizeof(runDirectory), "%s/%s", cwd, options.directory);
+    }
+
+    for (int r = 0; r < options.rowCountCount; r++)
+    {
+        for (int id = 0; id < TableCount; id++)
+        {
+            if (!options.onlyTable || options.onlyTable == id + 1)
+            {
+                benchTable(id, options.rowCounts[r], runDirectory);
+            }
+        }
+    }
+    if (chdir(cwd) == 0)
+    {
+        nftw(runDirectory, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    return 0;
+}
@@ -0,0 +1,6682 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hoteldb.h"
+#define HashSize 100
+// indexing by id and string , hashing
+// every record shares its pool slot with its list node, which sits right in
+// front of it, so any index entry leads to the record's place in the list
+typedef struct Node
+{
+    void *data;
+    struct Node *next;
+    struct Node *prev;
+    // bumped on every write of the record, transactions validate against it
+    unsigned long long version;
+    // where the record sits in the base file, see pagePlace
+    uint32_t page;
+    uint32_t pageSlot;
+} Node;
+
+Node *recordNode(void *data)
+{
+    return (Node *)data - 1;
+}
+
+typedef struct HashNode
+{
+    void *data;
+    unsigned int hash;
+    struct HashNode *next;
+} HashNode;
+
+// chained name hash, starts at HashSize buckets and doubles as it fills
+typedef struct
+{
+    HashNode **buckets;
+    size_t bucketCount;
+    size_t count;
+} HashTable;
+
+// ordered name index: a skip list over case-folded names, duplicates ordered
+// by record address so every entry has a unique position
+#define SkipMaxLevel 24
+
+typedef struct SkipNode
+{
+    void *data;
+    const char *key;
+    int level;
+    struct SkipNode *next[];
+} SkipNode;
+
+typedef struct
+{
+    SkipNode *head;
+    int level;
+    unsigned int seed;
+} SkipList;
+
+// epochs: lock-free readers announce the epoch they started in while they
+// hold pointers found without the table lock. writers stamp everything they
+// unlink with a fresh epoch and free it only once every announced epoch is
+// later, so a reader never sees memory reused under it
+#define MaxEpochThreads 256
+// retired records a table collects before trying to free them
+#define LimboBatch 64
+
+typedef struct
+{
+    // 0 while the thread is not reading
+    atomic_ullong epoch;
+    atomic_bool owned;
+    // one slot per cache line so readers do not share lines
+    char padding[64 - sizeof(atomic_ullong) - sizeof(atomic_bool)];
+} EpochSlot;
+
+EpochSlot epochSlots[MaxEpochThreads];
+// slots ever claimed, the reclaim scans stop here
+atomic_int epochSlotsUsed;
+atomic_ullong globalEpoch = 1;
+pthread_once_t epochKeyOnce = PTHREAD_ONCE_INIT;
+pthread_key_t epochKey;
+__thread EpochSlot *threadEpochSlot;
+
+// memory other than records: slot arrays replaced by a resize
+typedef struct RetiredMemory
+{
+    void *memory;
+    unsigned long long epoch;
+    struct RetiredMemory *next;
+} RetiredMemory;
+
+pthread_mutex_t retiredMemoryMutex = PTHREAD_MUTEX_INITIALIZER;
+RetiredMemory *retiredMemory;
+
+// hands the slot back when its thread exits
+void releaseEpochSlot(void *slot)
+{
+    atomic_store(&((EpochSlot *)slot)->owned, false);
+}
+
+void createEpochKey()
+{
+    pthread_key_create(&epochKey, releaseEpochSlot);
+}
+
+// false when every slot is taken; the caller then reads under the lock
+bool epochEnter()
+{
+    EpochSlot *slot = threadEpochSlot;
+    if (!slot)
+    {
+        pthread_once(&epochKeyOnce, createEpochKey);
+        for (int i = 0; i < MaxEpochThreads && !slot; i++)
+        {
+            bool expected = false;
+            if (atomic_compare_exchange_strong(&epochSlots[i].owned, &expected, true))
+            {
+                slot = &epochSlots[i];
+                int used = atomic_load(&epochSlotsUsed);
+                while (used <= i && !atomic_compare_exchange_weak(&epochSlotsUsed, &used, i + 1))
+                {
+                }
+            }
+        }
+        if (!slot)
+        {
+            return false;
+        }
+        pthread_setspecific(epochKey, slot);
+        threadEpochSlot = slot;
+    }
+    atomic_store(&slot->epoch, atomic_load(&globalEpoch));
+    atomic_thread_fence(memory_order_seq_cst);
+    return true;
+}
+
+void epochExit()
+{
+    atomic_store_explicit(&threadEpochSlot->epoch, 0, memory_order_release);
+}
+
+// called after the memory is unlinked; anything stamped below the oldest
+// announced epoch can be freed
+unsigned long long epochStamp()
+{
+    return atomic_fetch_add(&globalEpoch, 1);
+}
+
+unsigned long long epochOldestReader()
+{
+    unsigned long long oldest = atomic_load(&globalEpoch);
+    int used = atomic_load(&epochSlotsUsed);
+    for (int i = 0; i < used; i++)
+    {
+        unsigned long long epoch = atomic_load(&epochSlots[i].epoch);
+        if (epoch && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+void freeRetiredMemory(bool all)
+{
+    pthread_mutex_lock(&retiredMemoryMutex);
+    unsigned long long oldest = all ? (unsigned long long)-1 : epochOldestReader();
+    RetiredMemory **link = &retiredMemory;
+    while (*link)
+    {
+        RetiredMemory *retired = *link;
+        if (retired->epoch < oldest)
+        {
+            *link = retired->next;
+            free(retired->memory);
+            free(retired);
+        }
+        else
+        {
+            link = &retired->next;
+        }
+    }
+    pthread_mutex_unlock(&retiredMemoryMutex);
+}
+
+// frees malloc'd memory once no lock-free reader can still hold it
+void retireMemory(void *memory)
+{
+    if (!memory)
+    {
+        return;
+    }
+    unsigned long long epoch = epochStamp();
+    RetiredMemory *retired = malloc(sizeof(RetiredMemory));
+    if (!retired)
+    {
+        // nowhere to park it: wait the readers out
+        while (epochOldestReader() <= epoch)
+        {
+            sched_yield();
+        }
+        free(memory);
+        return;
+    }
+    retired->memory = memory;
+    retired->epoch = epoch;
+    pthread_mutex_lock(&retiredMemoryMutex);
+    retired->next = retiredMemory;
+    retiredMemory = retired;
+    pthread_mutex_unlock(&retiredMemoryMutex);
+    freeRetiredMemory(false);
+}
+
+// id index: open addressing with the key stored inline, resized incrementally.
+// lock-free readers go through the published copy of the array pointers; a
+// slot's data is stored last, and arrays replaced by a resize are retired
+#define IdIndexMinCapacity 16
+#define IdIndexMigrateStep 64
+
+typedef struct
+{
+    int key;
+    void *data;
+} IdSlot;
+
+typedef struct
+{
+    IdSlot *slots;
+    size_t capacity;
+    IdSlot *oldSlots;
+    size_t oldCapacity;
+} IdIndexArrays;
+
+typedef struct
+{
+    IdSlot *slots;
+    size_t capacity;
+    size_t count;
+    size_t used;
+    // previous slot array, drained a few slots per write while a resize is running
+    IdSlot *oldSlots;
+    size_t oldCapacity;
+    size_t oldCount;
+    size_t migrated;
+    // the arrays as lock-free readers see them, NULL sends them to the lock
+    IdIndexArrays *published;
+} IdIndex;
+
+// marks a deleted slot so probe sequences running through it stay intact
+char idIndexTombstoneMarker;
+#define IdIndexTombstone ((void *)&idIndexTombstoneMarker)
+
+size_t idIndexHash(int key)
+{
+    unsigned int h = (unsigned int)key * 2654435769u;
+    return h ^ (h >> 16);
+}
+
+IdSlot *idSlotsFind(IdSlot *slots, size_t capacity, int key)
+{
+    if (!slots)
+    {
+        return NULL;
+    }
+    size_t mask = capacity - 1;
+    for (size_t i = idIndexHash(key) & mask;; i = (i + 1) & mask)
+    {
+        IdSlot *slot = &slots[i];
+        if (!slot->data)
+        {
+            return NULL;
+        }
+        if (slot->key == key && slot->data != IdIndexTombstone)
+        {
+            return slot;
+        }
+    }
+}
+
+// caller guarantees the key is absent and a free slot exists
+void idSlotsPut(IdSlot *slots, size_t capacity, int key, void *data)
+{
+    size_t mask = capacity - 1;
+    size_t i = idIndexHash(key) & mask;
+    while (slots[i].data && slots[i].data != IdIndexTombstone)
+    {
+        i = (i + 1) & mask;
+    }
+    __atomic_store_n(&slots[i].key, key, __ATOMIC_RELAXED);
+    __atomic_store_n(&slots[i].data, data, __ATOMIC_RELEASE);
+}
+
+void idSlotClear(IdSlot *slot)
+{
+    __atomic_store_n(&slot->data, IdIndexTombstone, __ATOMIC_RELEASE);
+}
+
+// a reused slot can pair a new record with a stale key, so the record's own
+// id has the final say
+void *idSlotsFindShared(IdSlot *slots, size_t capacity, int key, int (*idExtract)(void *))
+{
+    if (!slots)
+    {
+        return NULL;
+    }
+    size_t mask = capacity - 1;
+    for (size_t i = idIndexHash(key) & mask;; i = (i + 1) & mask)
+    {
+        void *data = __atomic_load_n(&slots[i].data, __ATOMIC_ACQUIRE);
+        if (!data)
+        {
+            return NULL;
+        }
+        if (data != IdIndexTombstone && __atomic_load_n(&slots[i].key, __ATOMIC_RELAXED) == key &&
+            idExtract(data) == key)
+        {
+            return data;
+        }
+    }
+}
+
+// called whenever the arrays change; the previous copy is retired
+void idIndexPublish(IdIndex *index)
+{
+    IdIndexArrays *arrays = malloc(sizeof(IdIndexArrays));
+    if (arrays)
+    {
+        *arrays = (IdIndexArrays){index->slots, index->capacity, index->oldSlots, index->oldCapacity};
+    }
+    retireMemory(__atomic_exchange_n(&index->published, arrays, __ATOMIC_ACQ_REL));
+}
+
+// for readers inside an epoch: false when nothing is published and the
+// lookup has to take the lock. a key moves to the new array before it is
+// cleared from the old one, so the old array is probed first; a miss while
+// the arrays were swapped is retried on the new ones
+bool idIndexFindShared(IdIndex *index, int key, int (*idExtract)(void *), void **data)
+{
+    IdIndexArrays *arrays = __atomic_load_n(&index->published, __ATOMIC_ACQUIRE);
+    while (arrays)
+    {
+        *data = idSlotsFindShared(arrays->oldSlots, arrays->oldCapacity, key, idExtract);
+        if (!*data)
+        {
+            *data = idSlotsFindShared(arrays->slots, arrays->capacity, key, idExtract);
+        }
+        IdIndexArrays *current = __atomic_load_n(&index->published, __ATOMIC_ACQUIRE);
+        if (*data || current == arrays)
+        {
+            return true;
+        }
+        arrays = current;
+    }
+    return false;
+}
+
+void idIndexMigrate(IdIndex *index, size_t steps)
+{
+    if (!index->oldSlots)
+    {
+        return;
+    }
+    while (steps-- > 0 && index->migrated < index->oldCapacity)
+    {
+        IdSlot *slot = &index->oldSlots[index->migrated++];
+        if (slot->data && slot->data != IdIndexTombstone)
+        {
+            idSlotsPut(index->slots, index->capacity, slot->key, slot->data);
+            idSlotClear(slot);
+            index->count++;
+            index->used++;
+            index->oldCount--;
+        }
+    }
+    if (index->migrated == index->oldCapacity)
+    {
+        IdSlot *oldSlots = index->oldSlots;
+        index->oldSlots = NULL;
+        index->oldCapacity = 0;
+        index->oldCount = 0;
+        idIndexPublish(index);
+        retireMemory(oldSlots);
+    }
+}
+
+bool idIndexStartResize(IdIndex *index)
+{
+    // finish any resize still in flight so at most two arrays exist
+    idIndexMigrate(index, (size_t)-1);
+
+    size_t capacity = IdIndexMinCapacity;
+    while (capacity < index->count * 2 + 2 || capacity < index->capacity / 2)
+    {
+        capacity *= 2;
+    }
+    IdSlot *slots = calloc(capacity, sizeof(IdSlot));
+    if (!slots)
+    {
+        return false;
+    }
+
+    index->oldSlots = index->slots;
+    index->oldCapacity = index->capacity;
+    index->oldCount = index->count;
+    index->migrated = 0;
+    index->slots = slots;
+    index->capacity = capacity;
+    index->count = 0;
+    index->used = 0;
+    idIndexPublish(index);
+    return true;
+}
+
+// sizes an empty index for count keys so a bulk load never resizes
+bool idIndexReserve(IdIndex *index, size_t count)
+{
+    if (index->slots || count == 0)
+    {
+        return true;
+    }
+    size_t capacity = IdIndexMinCapacity;
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+    }
+    index->slots = calloc(capacity, sizeof(IdSlot));
+    if (!index->slots)
+    {
+        return false;
+    }
+    index->capacity = capacity;
+    idIndexPublish(index);
+    return true;
+}
+
+IdSlot *idIndexFindSlot(IdIndex *index, int key)
+{
+    IdSlot *slot = idSlotsFind(index->slots, index->capacity, key);
+    if (!slot && index->oldSlots)
+    {
+        slot = idSlotsFind(index->oldSlots, index->oldCapacity, key);
+    }
+    return slot;
+}
+
+void *idIndexFind(IdIndex *index, int key)
+{
+    IdSlot *slot = idIndexFindSlot(index, key);
+    return slot ? slot->data : NULL;
+}
+
+// points a present key at new data
+void idIndexSwap(IdIndex *index, int key, void *data)
+{
+    IdSlot *slot = idIndexFindSlot(index, key);
+    if (slot)
+    {
+        __atomic_store_n(&slot->data, data, __ATOMIC_RELEASE);
+    }
+}
+
+// key must not already be present
+bool idIndexInsert(IdIndex *index, int key, void *data)
+{
+    idIndexMigrate(index, IdIndexMigrateStep);
+    if ((index->used + 1) * 4 > index->capacity * 3)
+    {
+        if (!idIndexStartResize(index))
+        {
+            return false;
+        }
+        idIndexMigrate(index, IdIndexMigrateStep);
+    }
+    idSlotsPut(index->slots, index->capacity, key, data);
+    index->count++;
+    index->used++;
+    return true;
+}
+
+bool idIndexRemove(IdIndex *index, int key)
+{
+    idIndexMigrate(index, IdIndexMigrateStep);
+    IdSlot *slot = idSlotsFind(index->slots, index->capacity, key);
+    if (slot)
+    {
+        idSlotClear(slot);
+        index->count--;
+        return true;
+    }
+    slot = idSlotsFind(index->oldSlots, index->oldCapacity, key);
+    if (slot)
+    {
+        idSlotClear(slot);
+        index->oldCount--;
+        return true;
+    }
+    return false;
+}
+
+// no lock-free reader may still be using the index
+void idIndexFree(IdIndex *index)
+{
+    free(index->published);
+    free(index->slots);
+    free(index->oldSlots);
+    memset(index, 0, sizeof(*index));
+}
+
+size_t idIndexBytes(const IdIndex *index)
+{
+    return (index->capacity + index->oldCapacity) * sizeof(IdSlot);
+}
+
+// secondary index: any int column mapped to every record holding that value,
+// the id index machinery stores one posting list per distinct key
+#define MaxSecondaryIndexes 4
+
+typedef struct
+{
+    size_t count;
+    size_t capacity;
+    void *records[];
+} Posting;
+
+typedef struct
+{
+    const char *name;
+    // the field extract reads
+    const char *column;
+    int (*extract)(void *);
+    IdIndex keys;
+} SecondaryIndex;
+
+bool secondaryAdd(SecondaryIndex *index, void *data)
+{
+    int key = index->extract(data);
+    IdSlot *slot = idIndexFindSlot(&index->keys, key);
+    Posting *posting = slot ? slot->data : NULL;
+    if (posting && posting->count < posting->capacity)
+    {
+        posting->records[posting->count++] = data;
+        return true;
+    }
+
+    size_t capacity = posting ? posting->capacity * 2 : 4;
+    Posting *grown = realloc(posting, sizeof(Posting) + capacity * sizeof(void *));
+    if (!grown)
+    {
+        return false;
+    }
+    grown->capacity = capacity;
+    if (slot)
+    {
+        slot->data = grown;
+    }
+    else
+    {
+        grown->count = 0;
+        if (!idIndexInsert(&index->keys, key, grown))
+        {
+            free(grown);
+            return false;
+        }
+    }
+    grown->records[grown->count++] = data;
+    return true;
+}
+
+void secondaryRemove(SecondaryIndex *index, void *data)
+{
+    int key = index->extract(data);
+    Posting *posting = idIndexFind(&index->keys, key);
+    if (!posting)
+    {
+        return;
+    }
+    for (size_t i = 0; i < posting->count; i++)
+    {
+        if (posting->records[i] == data)
+        {
+            posting->records[i] = posting->records[--posting->count];
+            break;
+        }
+    }
+    if (posting->count == 0)
+    {
+        idIndexRemove(&index->keys, key);
+        free(posting);
+    }
+}
+
+void secondaryFree(SecondaryIndex *index)
+{
+    IdSlot *arrays[] = {index->keys.slots, index->keys.oldSlots};
+    size_t capacities[] = {index->keys.capacity, index->keys.oldCapacity};
+    for (int a = 0; a < 2; a++)
+    {
+        for (size_t i = 0; arrays[a] && i < capacities[a]; i++)
+        {
+            if (arrays[a][i].data && arrays[a][i].data != IdIndexTombstone)
+            {
+                free(arrays[a][i].data);
+            }
+        }
+    }
+    idIndexFree(&index->keys);
+}
+
+// interval index: per key (a room) a timeline of [start, end) day ranges
+// sorted by start, with a running maximum of end so an overlap test is one
+// binary search
+typedef struct
+{
+    int start;
+    int end;
+    void *data;
+} Interval;
+
+typedef struct
+{
+    size_t count;
+    size_t capacity;
+    Interval *intervals;
+    int *maxEnd;
+} Timeline;
+
+typedef struct
+{
+    int (*keyExtract)(void *);
+    int (*startExtract)(void *);
+    int (*endExtract)(void *);
+    IdIndex timelines;
+} IntervalIndex;
+
+// first position whose start is >= day
+size_t timelineLowerBound(const Timeline *timeline, int day)
+{
+    size_t low = 0, high = timeline->count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (timeline->intervals[mid].start < day)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void timelineRefreshMaxEnd(Timeline *timeline, size_t from)
+{
+    for (size_t i = from; i < timeline->count; i++)
+    {
+        int previous = i > 0 ? timeline->maxEnd[i - 1] : timeline->intervals[i].end;
+        timeline->maxEnd[i] = previous > timeline->intervals[i].end ? previous : timeline->intervals[i].end;
+    }
+}
+
+// with deferSort the interval is appended and intervalSort must run before
+// the index is queried
+bool intervalAdd(IntervalIndex *index, void *data, bool deferSort)
+{
+    int key = index->keyExtract(data);
+    Timeline *timeline = idIndexFind(&index->timelines, key);
+    if (!timeline)
+    {
+        timeline = calloc(1, sizeof(Timeline));
+        if (!timeline || !idIndexInsert(&index->timelines, key, timeline))
+        {
+            free(timeline);
+            return false;
+        }
+    }
+    if (timeline->count == timeline->capacity)
+    {
+        size_t capacity = timeline->capacity ? timeline->capacity * 2 : 4;
+        Interval *intervals = realloc(timeline->intervals, capacity * sizeof(Interval));
+        if (!intervals)
+        {
+            return false;
+        }
+        timeline->intervals = intervals;
+        int *maxEnd = realloc(timeline->maxEnd, capacity * sizeof(int));
+        if (!maxEnd)
+        {
+            return false;
+        }
+        timeline->maxEnd = maxEnd;
+        timeline->capacity = capacity;
+    }
+
+    Interval interval = {index->startExtract(data), index->endExtract(data), data};
+    if (deferSort)
+    {
+        timeline->intervals[timeline->count++] = interval;
+        return true;
+    }
+    size_t position = timelineLowerBound(timeline, interval.start);
+    memmove(&timeline->intervals[position + 1], &timeline->intervals[position],
+            (timeline->count - position) * sizeof(Interval));
+    timeline->intervals[position] = interval;
+    timeline->count++;
+    timelineRefreshMaxEnd(timeline, position);
+    return true;
+}
+
+int intervalOrder(const void *a, const void *b)
+{
+    const Interval *left = a, *right = b;
+    return (left->start > right->start) - (left->start < right->start);
+}
+
+// sorts every timeline filled with deferSort and recomputes its running maximum
+void intervalSort(IntervalIndex *index)
+{
+    IdSlot *arrays[] = {index->timelines.slots, index->timelines.oldSlots};
+    size_t capacities[] = {index->timelines.capacity, index->timelines.oldCapacity};
+    for (int a = 0; a < 2; a++)
+    {
+        for (size_t i = 0; arrays[a] && i < capacities[a]; i++)
+        {
+            Timeline *timeline = arrays[a][i].data;
+            if (timeline && arrays[a][i].data != IdIndexTombstone)
+            {
+                qsort(timeline->intervals, timeline->count, sizeof(Interval), intervalOrder);
+                timelineRefreshMaxEnd(timeline, 0);
+            }
+        }
+    }
+}
+
+void intervalRemove(IntervalIndex *index, void *data)
+{
+    int key = index->keyExtract(data);
+    Timeline *timeline = idIndexFind(&index->timelines, key);
+    if (!timeline)
+    {
+        return;
+    }
+    size_t position = timelineLowerBound(timeline, index->startExtract(data));
+    while (position < timeline->count && timeline->intervals[position].data != data)
+    {
+        position++;
+    }
+    if (position == timeline->count)
+    {
+        return;
+    }
+    memmove(&timeline->intervals[position], &timeline->intervals[position + 1],
+            (timeline->count - position - 1) * sizeof(Interval));
+    timeline->count--;
+    timelineRefreshMaxEnd(timeline, position);
+}
+
+// true when some interval under key intersects [start, end)
+bool intervalOverlaps(IntervalIndex *index, int key, int start, int end)
+{
+    Timeline *timeline = idIndexFind(&index->timelines, key);
+    if (!timeline || timeline->count == 0)
+    {
+        return false;
+    }
+    size_t before = timelineLowerBound(timeline, end);
+    return before > 0 && timeline->maxEnd[before - 1] > start;
+}
+
+void intervalFree(IntervalIndex *index)
+{
+    IdSlot *arrays[] = {index->timelines.slots, index->timelines.oldSlots};
+    size_t capacities[] = {index->timelines.capacity, index->timelines.oldCapacity};
+    for (int a = 0; a < 2; a++)
+    {
+        for (size_t i = 0; arrays[a] && i < capacities[a]; i++)
+        {
+            Timeline *timeline = arrays[a][i].data;
+            if (timeline && arrays[a][i].data != IdIndexTombstone)
+            {
+                free(timeline->intervals);
+                free(timeline->maxEnd);
+                free(timeline);
+            }
+        }
+    }
+    idIndexFree(&index->timelines);
+}
+
+// fixed-size slot pool: slots are carved from large slabs and recycled through
+// a free list; callers hold the table lock
+#define PoolSlabBytes (256 * 1024)
+
+typedef struct PoolSlab
+{
+    struct PoolSlab *next;
+    max_align_t align;
+} PoolSlab;
+
+typedef struct
+{
+    size_t slotSize;
+    size_t slabBytes;
+    PoolSlab *slabs;
+    void *freeList;
+    char *bump;
+    char *bumpEnd;
+    size_t slabCount;
+    size_t inUse;
+} Pool;
+
+void poolInit(Pool *pool, size_t slotSize)
+{
+    memset(pool, 0, sizeof(*pool));
+    // every slot must hold the free list link and keep records aligned
+    slotSize = (slotSize + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    pool->slotSize = slotSize;
+    pool->slabBytes = PoolSlabBytes;
+    while (pool->slabBytes < offsetof(PoolSlab, align) + slotSize * 16)
+    {
+        pool->slabBytes *= 2;
+    }
+}
+
+void *poolAlloc(Pool *pool)
+{
+    void *slot = pool->freeList;
+    if (slot)
+    {
+        pool->freeList = *(void **)slot;
+    }
+    else
+    {
+        if (pool->bump + pool->slotSize > pool->bumpEnd)
+        {
+            PoolSlab *slab = malloc(pool->slabBytes);
+            if (!slab)
+            {
+                return NULL;
+            }
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->slabCount++;
+            pool->bump = (char *)&slab->align;
+            pool->bumpEnd = (char *)slab + pool->slabBytes;
+        }
+        slot = pool->bump;
+        pool->bump += pool->slotSize;
+    }
+    pool->inUse++;
+    return slot;
+}
+
+void poolFree(Pool *pool, void *slot)
+{
+    *(void **)slot = pool->freeList;
+    pool->freeList = slot;
+    pool->inUse--;
+}
+
+void poolDestroy(Pool *pool)
+{
+    PoolSlab *slab = pool->slabs;
+    while (slab)
+    {
+        PoolSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    poolInit(pool, pool->slotSize);
+}
+
+size_t poolBytes(const Pool *pool)
+{
+    return pool->slabCount * pool->slabBytes;
+}
+
+// write-ahead log: every mutation is appended and group-committed here,
+// the base .dat file is only written when the log is compacted
+#define LogInsert 1
+#define LogUpdate 2
+#define LogDelete 3
+#define WalCompactBytes (4 * 1024 * 1024)
+
+typedef struct
+{
+    int op;
+    int key;
+    unsigned int length;
+    unsigned int checksum;
+} LogRecordHeader;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t durable;
+    int fd;
+    // writers append to buffer while the commit leader writes out flushBuffer
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    char *flushBuffer;
+    size_t flushCapacity;
+    unsigned long long appendedLsn;
+    unsigned long long durableLsn;
+    // set when a flush fails: the log file may hold part of it, so nothing
+    // after durableLsn counts as durable until a checkpoint covering
+    // failedLsn, the last record of that flush, lets the log start over
+    bool failed;
+    unsigned long long failedLsn;
+    bool flushing;
+    size_t logBytes;
+} WriteAheadLog;
+
+// metrics: each thread adds to its own shard with relaxed atomics, so
+// counting never takes a lock or bounces a shared cache line; readers sum
+// the shards
+#define MetricsShards 16
+#define MaxHeldLocks 8
+
+typedef struct
+{
+    _Alignas(64) atomic_ullong opCount[OperationCount];
+    atomic_ullong opNanos[OperationCount];
+    atomic_ullong opBuckets[OperationCount][MetricsBuckets];
+    atomic_ullong lockAcquired;
+    atomic_ullong lockContended;
+    atomic_ullong lockWaitNanos;
+    atomic_ullong lockHoldNanos;
+    atomic_ullong backups;
+    atomic_ullong backupBytes;
+    atomic_ullong backupNanos;
+    atomic_ullong backupSyncNanos;
+    atomic_ullong logFlushes;
+    atomic_ullong logBytes;
+    atomic_ullong logSyncNanos;
+} MetricsShard;
+
+unsigned int stringHashFunction(const char *key)
+{
+    unsigned int hash = 5381;
+    int c;
+    while ((c = *key++))
+    {
+        hash = ((hash << 5) + hash) + c;
+    }
+    return hash;
+}
+
+// dictionary: distinct strings numbered in first-seen order. each code
+// counts the records holding it; once none does the string goes and the
+// code is handed out again, so churning values do not grow the dictionary
+#define DictionaryMinSlots 16
+
+typedef struct
+{
+    // NULL for a free code
+    char **names;
+    unsigned int *refs;
+    size_t count;
+    size_t capacity;
+    // open addressing over the names, each slot holds code + 1, 0 is empty
+    int *slots;
+    size_t slotCount;
+    // free codes, the last one freed on top
+    int *freeCodes;
+    size_t freeCount;
+} Dictionary;
+
+int *dictionarySlot(const Dictionary *dictionary, const char *name)
+{
+    if (!dictionary->slots)
+    {
+        return NULL;
+    }
+    size_t mask = dictionary->slotCount - 1;
+    for (size_t i = stringHashFunction(name) & mask;; i = (i + 1) & mask)
+    {
+        int *slot = &dictionary->slots[i];
+        if (*slot == 0 || strcmp(dictionary->names[*slot - 1], name) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+bool dictionaryGrow(Dictionary *dictionary)
+{
+    size_t slotCount = dictionary->slotCount ? dictionary->slotCount * 2 : DictionaryMinSlots;
+    int *slots = calloc(slotCount, sizeof(int));
+    if (!slots)
+    {
+        return false;
+    }
+    free(dictionary->slots);
+    dictionary->slots = slots;
+    dictionary->slotCount = slotCount;
+    for (size_t code = 0; code < dictionary->count; code++)
+    {
+        if (dictionary->names[code])
+        {
+            *dictionarySlot(dictionary, dictionary->names[code]) = (int)code + 1;
+        }
+    }
+    return true;
+}
+
+// code of name, or -1 if no record holds it
+int dictionaryFind(const Dictionary *dictionary, const char *name)
+{
+    int *slot = dictionarySlot(dictionary, name);
+    return slot && *slot ? *slot - 1 : -1;
+}
+
+// room for one more code
+bool dictionaryReserve(Dictionary *dictionary)
+{
+    if ((dictionary->count + 1) * 2 > dictionary->slotCount && !dictionaryGrow(dictionary))
+    {
+        return false;
+    }
+    if (dictionary->count < dictionary->capacity)
+    {
+        return true;
+    }
+    size_t capacity = dictionary->capacity ? dictionary->capacity * 2 : DictionaryMinSlots;
+    char **names = realloc(dictionary->names, capacity * sizeof(char *));
+    dictionary->names = names ? names : dictionary->names;
+    unsigned int *refs = names ? realloc(dictionary->refs, capacity * sizeof(unsigned int)) : NULL;
+    dictionary->refs = refs ? refs : dictionary->refs;
+    int *freeCodes = refs ? realloc(dictionary->freeCodes, capacity * sizeof(int)) : NULL;
+    if (!freeCodes)
+    {
+        return false;
+    }
+    dictionary->freeCodes = freeCodes;
+    dictionary->capacity = capacity;
+    return true;
+}
+
+// gives name a new code, the one on top of the free stack when reuse is
+// set; a NULL name appends a free code. -1 when out of memory
+int dictionaryAdd(Dictionary *dictionary, const char *name, bool reuse)
+{
+    char *copy = NULL;
+    if (!dictionaryReserve(dictionary) || (name && !(copy = strdup(name))))
+    {
+        return -1;
+    }
+    int code;
+    if (reuse && copy)
+    {
+        code = dictionary->freeCodes[--dictionary->freeCount];
+    }
+    else
+    {
+        code = (int)dictionary->count++;
+        if (!copy)
+        {
+            dictionary->freeCodes[dictionary->freeCount++] = code;
+        }
+    }
+    dictionary->names[code] = copy;
+    dictionary->refs[code] = 0;
+    if (copy)
+    {
+        *dictionarySlot(dictionary, copy) = code + 1;
+    }
+    return code;
+}
+
+// frees a code no record holds; the slots after it that probed past it
+// move back, so lookups still find them without tombstones
+void dictionaryRemove(Dictionary *dictionary, int code)
+{
+    size_t mask = dictionary->slotCount - 1;
+    size_t hole = dictionarySlot(dictionary, dictionary->names[code]) - dictionary->slots;
+    for (size_t i = (hole + 1) & mask; dictionary->slots[i]; i = (i + 1) & mask)
+    {
+        size_t home = stringHashFunction(dictionary->names[dictionary->slots[i] - 1]) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            dictionary->slots[hole] = dictionary->slots[i];
+            hole = i;
+        }
+    }
+    dictionary->slots[hole] = 0;
+    free(dictionary->names[code]);
+    dictionary->names[code] = NULL;
+    dictionary->freeCodes[dictionary->freeCount++] = code;
+}
+
+void dictionaryFree(Dictionary *dictionary)
+{
+    for (size_t i = 0; i < dictionary->count; i++)
+    {
+        free(dictionary->names[i]);
+    }
+    free(dictionary->names);
+    free(dictionary->refs);
+    free(dictionary->slots);
+    free(dictionary->freeCodes);
+    memset(dictionary, 0, sizeof(*dictionary));
+}
+
+typedef struct RoomColumns RoomColumns;
+
+// column layout of a record, used to encode it compactly in the base file
+typedef enum
+{
+    FieldInt,
+    FieldDouble,
+    FieldText,
+    // text with few distinct values: the table's dictionary numbers them and
+    // the base file stores the numbers; at most one per table
+    FieldCoded
+} FieldType;
+
+typedef struct
+{
+    FieldType type;
+    // the struct member, which queries use to name join columns
+    const char *name;
+    size_t offset;
+    size_t size;
+} Field;
+
+#define RecordField(fieldType, type, member) \
+    {fieldType, #member, offsetof(type, member), sizeof(((type *)0)->member)}
+
+struct Table
+{
+    const char *name;
+    Node *head;
+    IdIndex idIndex;
+    HashTable nameHashTable;
+    SkipList nameOrder;
+    // set while loading or importing so the ordered indexes are built once afterwards
+    bool bulkLoad;
+    SecondaryIndex secondary[MaxSecondaryIndexes];
+    int secondaryCount;
+    IntervalIndex intervalIndex;
+    // Room only, NULL until enableRoomColumns
+    RoomColumns *roomColumns;
+    // readers share the lock, writers are preferred so they are not starved
+    pthread_rwlock_t lock;
+    // open snapshots: while any is open records are copied rather than
+    // overwritten, and removed ones wait on the retired list
+    atomic_int snapshots;
+    Node *retired;
+    // retired records in the order they were stamped, each node's version
+    // now holding its epoch
+    Node *limbo;
+    Node *limboTail;
+    size_t limboCount;
+    // last row version handed out, under the write lock
+    unsigned long long versions;
+    // one checkpoint per table at a time
+    pthread_mutex_t checkpointMutex;
+    MetricsShard metrics[MetricsShards];
+    const char *filename;
+    // slots hold a Node followed by the record, and by its code in a table
+    // with a FieldCoded column
+    Pool recordPool;
+    Pool nameNodePool;
+    const char *logFilename;
+    WriteAheadLog wal;
+    // persistence queue links, guarded by the worker mutex
+    struct Table *nextDirty;
+    struct Table *nextFlush;
+    bool queued;
+    size_t dataSize;
+    // bulk import: fills a record from CSV fields, then checks it as stored
+    bool (*parseFunction)(char **, int, void *);
+    bool (*validateFunction)(const void *);
+    int (*idExtract)(void *);
+    const char *(*nameExtract)(void *);
+    const Field *fields;
+    int fieldCount;
+    // the field idExtract reads
+    const char *idColumn;
+    // the FieldCoded column, which is also the name column, or NULL; names
+    // are found by code through codeIndex instead of the name hash table.
+    // codes below codesInFile, free ones included, are listed in the base
+    // file's header page, taking codeBytes there; other values are written
+    // out in full
+    const Field *codedField;
+    Dictionary strings;
+    SecondaryIndex codeIndex;
+    size_t codesInFile;
+    size_t codeBytes;
+    // base file pages, each with the records placed on it; the dirty bitmap
+    // marks pages changed since the last checkpoint and the free stack holds
+    // pages with room left, so deleted space is filled before the file grows
+    struct Page *pages;
+    size_t pageCount;
+    size_t pageCapacity;
+    uint64_t *dirtyPages;
+    size_t dirtyCount;
+    uint32_t *freePages;
+    size_t freePageCount;
+    // the next checkpoint writes a whole new file: the base file is missing,
+    // in an older format, damaged, or an in-place write failed
+    bool rewriteBase;
+    uint32_t baseGeneration;
+};
+
+unsigned long long nowNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+void initTableLock(Table *table)
+{
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&table->lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&table->checkpointMutex, NULL);
+    memset(table->metrics, 0, sizeof(table->metrics));
+}
+
+atomic_uint nextMetricsShard;
+_Thread_local int metricsShard = -1;
+
+// locks this thread holds with the time each was taken, for hold time
+_Thread_local struct
+{
+    Table *table;
+    unsigned long long since;
+} heldLocks[MaxHeldLocks];
+_Thread_local int heldLockCount;
+
+MetricsShard *shardOf(Table *table)
+{
+    if (metricsShard < 0)
+    {
+        metricsShard = (int)(atomic_fetch_add_explicit(&nextMetricsShard, 1, memory_order_relaxed) % MetricsShards);
+    }
+    return &table->metrics[metricsShard];
+}
+
+void countMetric(atomic_ullong *counter, unsigned long long amount)
+{
+    atomic_fetch_add_explicit(counter, amount, memory_order_relaxed);
+}
+
+int latencyBucket(unsigned long long nanos)
+{
+    int bucket = nanos ? 64 - __builtin_clzll(nanos) : 0;
+    return bucket < MetricsBuckets ? bucket : MetricsBuckets - 1;
+}
+
+void recordOperation(Table *table, HotelOperation operation, unsigned long long start)
+{
+    unsigned long long nanos = nowNanos() - start;
+    MetricsShard *shard = shardOf(table);
+    countMetric(&shard->opCount[operation], 1);
+    countMetric(&shard->opNanos[operation], nanos);
+    countMetric(&shard->opBuckets[operation][latencyBucket(nanos)], 1);
+}
+
+// wait is only timed for a contended acquire, hold time for every one
+void lockAcquired(Table *table, unsigned long long waitStart)
+{
+    unsigned long long now = nowNanos();
+    MetricsShard *shard = shardOf(table);
+    countMetric(&shard->lockAcquired, 1);
+    if (waitStart)
+    {
+        countMetric(&shard->lockContended, 1);
+        countMetric(&shard->lockWaitNanos, now - waitStart);
+    }
+    if (heldLockCount < MaxHeldLocks)
+    {
+        heldLocks[heldLockCount].table = table;
+        heldLocks[heldLockCount].since = now;
+    }
+    heldLockCount++;
+}
+
+// shared lock for lookups and scans
+void lockTableRead(Table *table)
+{
+    unsigned long long waitStart = 0;
+    if (pthread_rwlock_tryrdlock(&table->lock) != 0)
+    {
+        waitStart = nowNanos();
+        pthread_rwlock_rdlock(&table->lock);
+    }
+    lockAcquired(table, waitStart);
+}
+
+// exclusive lock for mutations
+void lockTable(Table *table)
+{
+    unsigned long long waitStart = 0;
+    if (pthread_rwlock_trywrlock(&table->lock) != 0)
+    {
+        waitStart = nowNanos();
+        pthread_rwlock_wrlock(&table->lock);
+    }
+    lockAcquired(table, waitStart);
+}
+
+void unlockTable(Table *table)
+{
+    int top = heldLockCount < MaxHeldLocks ? heldLockCount : MaxHeldLocks;
+    for (int i = top - 1; i >= 0; i--)
+    {
+        if (heldLocks[i].table == table)
+        {
+            countMetric(&shardOf(table)->lockHoldNanos, nowNanos() - heldLocks[i].since);
+            heldLocks[i] = heldLocks[top - 1];
+            break;
+        }
+    }
+    if (heldLockCount > 0)
+    {
+        heldLockCount--;
+    }
+    pthread_rwlock_unlock(&table->lock);
+}
+
+unsigned long long sumShards(Table *table, size_t offset)
+{
+    unsigned long long total = 0;
+    for (int i = 0; i < MetricsShards; i++)
+    {
+        total += atomic_load_explicit((atomic_ullong *)((char *)&table->metrics[i] + offset), memory_order_relaxed);
+    }
+    return total;
+}
+
+void tableLockStats(Table *table, TableLockStats *stats)
+{
+    stats->acquired = sumShards(table, offsetof(MetricsShard, lockAcquired));
+    stats->contended = sumShards(table, offsetof(MetricsShard, lockContended));
+    stats->waitNanos = sumShards(table, offsetof(MetricsShard, lockWaitNanos));
+    stats->holdNanos = sumShards(table, offsetof(MetricsShard, lockHoldNanos));
+}
+
+void foldName(const char *name, char *out)
+{
+    while (*name)
+    {
+        *out++ = (char)tolower((unsigned char)*name++);
+    }
+    *out = '\0';
+}
+
+bool hashTableGrow(HashTable *hashTable)
+{
+    size_t bucketCount = hashTable->bucketCount ? hashTable->bucketCount * 2 : HashSize;
+    HashNode **buckets = calloc(bucketCount, sizeof(HashNode *));
+    if (!buckets)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < hashTable->bucketCount; i++)
+    {
+        HashNode *current = hashTable->buckets[i];
+        while (current)
+        {
+            HashNode *next = current->next;
+            size_t index = current->hash % bucketCount;
+            current->next = buckets[index];
+            buckets[index] = current;
+            current = next;
+        }
+    }
+    free(hashTable->buckets);
+    hashTable->buckets = buckets;
+    hashTable->bucketCount = bucketCount;
+    return true;
+}
+
+void hashTableInsert(HashTable *hashTable, HashNode *node)
+{
+    // a failed grow just leaves the chains longer
+    if (hashTable->count >= hashTable->bucketCount * 2)
+    {
+        hashTableGrow(hashTable);
+    }
+    size_t index = node->hash % hashTable->bucketCount;
+    node->next = hashTable->buckets[index];
+    hashTable->buckets[index] = node;
+    hashTable->count++;
+}
+
+int skipCompare(const SkipNode *node, const char *key, const void *data)
+{
+    int order = strcmp(node->key, key);
+    if (order != 0)
+    {
+        return order;
+    }
+    return (node->data > data) - (node->data < data);
+}
+
+int skipRandomLevel(SkipList *list)
+{
+    int level = 1;
+    unsigned int x = list->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    list->seed = x;
+    while (level < SkipMaxLevel && (x & 3) == 0)
+    {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+bool skipInit(SkipList *list)
+{
+    if (!list->head)
+    {
+        list->head = calloc(1, sizeof(SkipNode) + SkipMaxLevel * sizeof(SkipNode *));
+        if (!list->head)
+        {
+            return false;
+        }
+        list->level = 1;
+        list->seed = 2463534242u;
+    }
+    return true;
+}
+
+// links and the folded key share one allocation
+SkipNode *skipNewNode(SkipList *list, const char *name, void *data)
+{
+    int level = skipRandomLevel(list);
+    SkipNode *node = malloc(sizeof(SkipNode) + level * sizeof(SkipNode *) + strlen(name) + 1);
+    if (!node)
+    {
+        return NULL;
+    }
+    char *key = (char *)&node->next[level];
+    foldName(name, key);
+    node->key = key;
+    node->data = data;
+    node->level = level;
+    return node;
+}
+
+bool skipInsert(SkipList *list, const char *name, void *data)
+{
+    SkipNode *node = skipInit(list) ? skipNewNode(list, name, data) : NULL;
+    if (!node)
+    {
+        return false;
+    }
+    const char *key = node->key;
+    int level = node->level;
+
+    SkipNode *update[SkipMaxLevel];
+    SkipNode *current = list->head;
+    for (int i = list->level - 1; i >= 0; i--)
+    {
+        while (current->next[i] && skipCompare(current->next[i], key, data) < 0)
+        {
+            current = current->next[i];
+        }
+        update[i] = current;
+    }
+    for (int i = list->level; i < level; i++)
+    {
+        update[i] = list->head;
+    }
+    if (level > list->level)
+    {
+        list->level = level;
+    }
+    for (int i = 0; i < level; i++)
+    {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+    return true;
+}
+
+void skipRemove(SkipList *list, const char *name, void *data)
+{
+    if (!list->head)
+    {
+        return;
+    }
+    char key[strlen(name) + 1];
+    foldName(name, key);
+
+    SkipNode *update[SkipMaxLevel];
+    SkipNode *current = list->head;
+    for (int i = list->level - 1; i >= 0; i--)
+    {
+        while (current->next[i] && skipCompare(current->next[i], key, data) < 0)
+        {
+            current = current->next[i];
+        }
+        update[i] = current;
+    }
+    SkipNode *target = current->next[0];
+    if (!target || target->data != data)
+    {
+        return;
+    }
+    for (int i = 0; i < list->level && update[i]->next[i] == target; i++)
+    {
+        update[i]->next[i] = target->next[i];
+    }
+    free(target);
+    while (list->level > 1 && !list->head->next[list->level - 1])
+    {
+        list->level--;
+    }
+}
+
+// walks entries whose folded key starts with (or, if !prefix, equals) folded,
+// keeping up to maxResults of them; returns how many matched in all
+size_t skipSearch(SkipList *list, const char *folded, bool prefix, void **results, size_t maxResults)
+{
+    if (!list->head)
+    {
+        return 0;
+    }
+    SkipNode *current = list->head;
+    for (int i = list->level - 1; i >= 0; i--)
+    {
+        while (current->next[i] && strcmp(current->next[i]->key, folded) < 0)
+        {
+            current = current->next[i];
+        }
+    }
+    current = current->next[0];
+
+    size_t length = strlen(folded);
+    size_t found = 0;
+    // matches past maxResults are counted but not kept
+    while (current && (prefix ? strncmp(current->key, folded, length) == 0 : strcmp(current->key, folded) == 0))
+    {
+        if (found < maxResults)
+        {
+            results[found] = current->data;
+        }
+        found++;
+        current = current->next[0];
+    }
+    return found;
+}
+
+int skipNodeOrder(const void *a, const void *b)
+{
+    const SkipNode *left = *(SkipNode *const *)a;
+    const SkipNode *right = *(SkipNode *const *)b;
+    return skipCompare(left, right->key, right->data);
+}
+
+// builds an empty list from unordered entries: one sort, then every level is
+// linked in a single pass instead of searching for each insert position
+bool skipBuild(SkipList *list, const char **names, void **data, size_t count)
+{
+    SkipNode **nodes = malloc((count + 1) * sizeof(SkipNode *));
+    if (!nodes || !skipInit(list))
+    {
+        free(nodes);
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        nodes[i] = skipNewNode(list, names[i], data[i]);
+        if (!nodes[i])
+        {
+            while (i-- > 0)
+            {
+                free(nodes[i]);
+            }
+            free(nodes);
+            return false;
+        }
+    }
+    qsort(nodes, count, sizeof(SkipNode *), skipNodeOrder);
+
+    SkipNode *last[SkipMaxLevel];
+    for (int i = 0; i < SkipMaxLevel; i++)
+    {
+        last[i] = list->head;
+        list->head->next[i] = NULL;
+    }
+    list->level = 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int j = 0; j < nodes[i]->level; j++)
+        {
+            nodes[i]->next[j] = NULL;
+            last[j]->next[j] = nodes[i];
+            last[j] = nodes[i];
+        }
+        if (nodes[i]->level > list->level)
+        {
+            list->level = nodes[i]->level;
+        }
+    }
+    free(nodes);
+    return true;
+}
+
+void skipFree(SkipList *list)
+{
+    SkipNode *current = list->head;
+    while (current)
+    {
+        SkipNode *next = current->next[0];
+        free(current);
+        current = next;
+    }
+    memset(list, 0, sizeof(*list));
+}
+
+// layout of reservation.dat before dates were packed, read once to migrate
+struct LegacyReservation
+{
+    int reservationID;
+    char checkInDate[20];
+    char checkOutDate[20];
+    int customerID;
+    int roomID;
+};
+
+int daysFromCivil(int year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = (unsigned)(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (int)dayOfEra - 719468;
+}
+
+void civilFromDays(int days, int *year, int *month, int *day)
+{
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = (unsigned)(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+    *day = (int)(dayOfYear - (153 * shiftedMonth + 2) / 5 + 1);
+    *month = (int)(shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9);
+    *year = (int)yearOfEra + era * 400 + (*month <= 2);
+}
+
+bool parseDate(const char *text, int *days)
+{
+    int year, month, day;
+    if (sscanf(text, "%d-%d-%d", &year, &month, &day) != 3 || month < 1 || month > 12 || day < 1)
+    {
+        return false;
+    }
+    int parsed = daysFromCivil(year, (unsigned)month, (unsigned)day);
+    int checkYear, checkMonth, checkDay;
+    civilFromDays(parsed, &checkYear, &checkMonth, &checkDay);
+    if (checkYear != year || checkMonth != month || checkDay != day)
+    {
+        return false;
+    }
+    *days = parsed;
+    return true;
+}
+
+void formatDate(int days, char *buffer, size_t size)
+{
+    int year, month, day;
+    civilFromDays(days, &year, &month, &day);
+    snprintf(buffer, size, "%04d-%02d-%02d", year, month, day);
+}
+
+// columnar copy of the Room table: one dense array per filtered column so a
+// search streams through memory instead of chasing list nodes, rows are kept
+// dense by moving the last row into a deleted one
+#define FilterLanes 4
+
+typedef double PriceLanes __attribute__((vector_size(FilterLanes * sizeof(double))));
+typedef long long PriceMask __attribute__((vector_size(FilterLanes * sizeof(long long))));
+typedef int IntLanes __attribute__((vector_size(FilterLanes * sizeof(int))));
+
+struct RoomColumns
+{
+    int *ids;
+    double *prices;
+    int *available;
+    int *types;
+    size_t count;
+    size_t capacity;
+    // the Room table's dictionary, which numbers the types
+    const Dictionary *typeNames;
+    // room id to row + 1
+    IdIndex rows;
+};
+
+bool roomColumnsReserve(RoomColumns *columns)
+{
+    if (columns->count < columns->capacity)
+    {
+        return true;
+    }
+    size_t capacity = columns->capacity ? columns->capacity * 2 : 64;
+    int *ids = realloc(columns->ids, capacity * sizeof(int));
+    if (ids)
+    {
+        columns->ids = ids;
+    }
+    double *prices = realloc(columns->prices, capacity * sizeof(double));
+    if (prices)
+    {
+        columns->prices = prices;
+    }
+    int *available = realloc(columns->available, capacity * sizeof(int));
+    if (available)
+    {
+        columns->available = available;
+    }
+    int *types = realloc(columns->types, capacity * sizeof(int));
+    if (types)
+    {
+        columns->types = types;
+    }
+    if (!ids || !prices || !available || !types)
+    {
+        return false;
+    }
+    columns->capacity = capacity;
+    return true;
+}
+
+bool roomColumnsAdd(RoomColumns *columns, const struct Room *room, int type)
+{
+    if (!roomColumnsReserve(columns) ||
+        !idIndexInsert(&columns->rows, room->roomID, (void *)(uintptr_t)(columns->count + 1)))
+    {
+        return false;
+    }
+    size_t row = columns->count++;
+    columns->ids[row] = room->roomID;
+    columns->prices[row] = room->price;
+    columns->available[row] = room->availability;
+    columns->types[row] = type;
+    return true;
+}
+
+// overwrites the row of a room that kept its id; never allocates
+void roomColumnsSet(RoomColumns *columns, const struct Room *room, int type)
+{
+    void *found = idIndexFind(&columns->rows, room->roomID);
+    if (!found)
+    {
+        return;
+    }
+    size_t row = (uintptr_t)found - 1;
+    columns->prices[row] = room->price;
+    columns->available[row] = room->availability;
+    columns->types[row] = type;
+}
+
+void roomColumnsRemove(RoomColumns *columns, int roomId)
+{
+    void *found = idIndexFind(&columns->rows, roomId);
+    if (!found)
+    {
+        return;
+    }
+    size_t row = (uintptr_t)found - 1;
+    size_t last = --columns->count;
+    idIndexRemove(&columns->rows, roomId);
+    if (row != last)
+    {
+        columns->ids[row] = columns->ids[last];
+        columns->prices[row] = columns->prices[last];
+        columns->available[row] = columns->available[last];
+        columns->types[row] = columns->types[last];
+        idIndexFindSlot(&columns->rows, columns->ids[row])->data = (void *)(uintptr_t)(row + 1);
+    }
+}
+
+void roomColumnsFree(RoomColumns *columns)
+{
+    if (!columns)
+    {
+        return;
+    }
+    free(columns->ids);
+    free(columns->prices);
+    free(columns->available);
+    free(columns->types);
+    idIndexFree(&columns->rows);
+    free(columns);
+}
+
+size_t roomColumnsBytes(const RoomColumns *columns)
+{
+    if (!columns)
+    {
+        return 0;
+    }
+    return columns->capacity * (2 * sizeof(int) + sizeof(double) + sizeof(int)) + idIndexBytes(&columns->rows);
+}
+
+// bit k set when row begin + k passes the filter, FilterLanes rows per call;
+// a -1 availability or type turns that test off
+unsigned int roomFilterLanes(const RoomColumns *columns, size_t begin, double minPrice, double maxPrice,
+                             int availability, int type)
+{
+    PriceLanes prices;
+    IntLanes available, types;
+    memcpy(&prices, &columns->prices[begin], sizeof(prices));
+    memcpy(&available, &columns->available[begin], sizeof(available));
+    memcpy(&types, &columns->types[begin], sizeof(types));
+
+    PriceMask priceOk = (prices >= minPrice) & (prices <= maxPrice);
+    IntLanes matches = __builtin_convertvector(priceOk, IntLanes) &
+                       ((available == availability) | (availability < 0 ? -1 : 0)) &
+                       ((types == type) | (type < 0 ? -1 : 0));
+
+    unsigned int bits = 0;
+    for (int k = 0; k < FilterLanes; k++)
+    {
+        bits |= (unsigned int)(matches[k] & 1) << k;
+    }
+    return bits;
+}
+
+bool roomFilterRow(const RoomColumns *columns, size_t row, double minPrice, double maxPrice, int availability,
+                   int type)
+{
+    return columns->prices[row] >= minPrice && columns->prices[row] <= maxPrice &&
+           (availability < 0 || columns->available[row] == availability) &&
+           (type < 0 || columns->types[row] == type);
+}
+
+size_t roomColumnsFilter(const RoomColumns *columns, const RoomFilter *filter, int *roomIds, size_t maxRooms)
+{
+    int type = -1;
+    if (filter->roomType)
+    {
+        type = dictionaryFind(columns->typeNames, filter->roomType);
+        if (type < 0)
+        {
+            return 0;
+        }
+    }
+
+    size_t total = 0;
+    size_t row = 0;
+    for (; row + FilterLanes <= columns->count; row += FilterLanes)
+    {
+        unsigned int bits =
+            roomFilterLanes(columns, row, filter->minPrice, filter->maxPrice, filter->availability, type);
+        while (bits)
+        {
+            int k = __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (total < maxRooms)
+            {
+                roomIds[total] = columns->ids[row + k];
+            }
+            total++;
+        }
+    }
+    for (; row < columns->count; row++)
+    {
+        if (roomFilterRow(columns, row, filter->minPrice, filter->maxPrice, filter->availability, type))
+        {
+            if (total < maxRooms)
+            {
+                roomIds[total] = columns->ids[row];
+            }
+            total++;
+        }
+    }
+    return total;
+}
+
+//  tables
+Table tables[TableCount];
+
+void *findById(Table *table, int id)
+{
+    return idIndexFind(&table->idIndex, id);
+}
+
+// code of a stored record of a table with a FieldCoded column, -1 while the
+// record has none
+int *recordCode(const Table *table, const void *data)
+{
+    return (int *)((char *)data + table->dataSize);
+}
+
+// finds the table's FieldCoded column, whose codes extract reads
+void initTableCodes(Table *table, int (*extract)(void *))
+{
+    for (int i = 0; i < table->fieldCount; i++)
+    {
+        if (table->fields[i].type == FieldCoded)
+        {
+            table->codedField = &table->fields[i];
+            table->codeIndex = (SecondaryIndex){
+                .name = "code",
+                .column = table->fields[i].name,
+                .extract = extract,
+            };
+        }
+    }
+}
+
+void initTablePools(Table *table)
+{
+    poolInit(&table->recordPool, sizeof(Node) + table->dataSize + (table->codedField ? sizeof(int) : 0));
+    poolInit(&table->nameNodePool, sizeof(HashNode));
+}
+
+// a slot for one record, not yet linked or indexed
+void *allocRecord(Table *table)
+{
+    Node *node = poolAlloc(&table->recordPool);
+    if (!node)
+    {
+        return NULL;
+    }
+    node->data = node + 1;
+    if (table->codedField)
+    {
+        *recordCode(table, node->data) = -1;
+    }
+    return node->data;
+}
+
+void freeRecord(Table *table, void *data)
+{
+    poolFree(&table->recordPool, recordNode(data));
+}
+
+void linkNode(Table *table, Node *node)
+{
+    node->version = ++table->versions;
+    node->prev = NULL;
+    node->next = table->head;
+    if (table->head)
+    {
+        table->head->prev = node;
+    }
+    table->head = node;
+}
+
+void unlinkNode(Table *table, Node *node)
+{
+    if (node->prev)
+    {
+        node->prev->next = node->next;
+    }
+    else
+    {
+        table->head = node->next;
+    }
+    if (node->next)
+    {
+        node->next->prev = node->prev;
+    }
+}
+
+// frees the limbo records no lock-free reader can still be copying
+void reclaimLimbo(Table *table)
+{
+    unsigned long long oldest = epochOldestReader();
+    while (table->limbo && table->limbo->version < oldest)
+    {
+        Node *node = table->limbo;
+        table->limbo = node->next;
+        if (!table->limbo)
+        {
+            table->limboTail = NULL;
+        }
+        table->limboCount--;
+        freeRecord(table, node->data);
+    }
+    if (retiredMemory)
+    {
+        freeRetiredMemory(false);
+    }
+}
+
+// stamps a record no index reaches any more and queues it behind the
+// records retired before it
+void addToLimbo(Table *table, Node *node)
+{
+    node->version = epochStamp();
+    node->next = NULL;
+    if (table->limboTail)
+    {
+        table->limboTail->next = node;
+    }
+    else
+    {
+        table->limbo = node;
+    }
+    table->limboTail = node;
+    if (++table->limboCount >= LimboBatch)
+    {
+        reclaimLimbo(table);
+    }
+}
+
+// a record unlinked from the list waits on the retired list for the open
+// snapshots that may still be reading it, then in limbo for lock-free
+// readers; callers hold the write lock
+void retireNode(Table *table, Node *node)
+{
+    if (atomic_load(&table->snapshots) > 0)
+    {
+        node->next = table->retired;
+        table->retired = node;
+        return;
+    }
+    addToLimbo(table, node);
+}
+
+void reclaimRetired(Table *table)
+{
+    while (table->retired)
+    {
+        Node *node = table->retired;
+        table->retired = node->next;
+        addToLimbo(table, node);
+    }
+}
+
+void tableMemoryStats(Table *table, TableMemoryStats *stats)
+{
+    lockTableRead(table);
+    stats->records = table->idIndex.count + table->idIndex.oldCount;
+    stats->slabBytes = poolBytes(&table->recordPool) + poolBytes(&table->nameNodePool);
+    stats->usedBytes = table->recordPool.inUse * table->recordPool.slotSize +
+                       table->nameNodePool.inUse * table->nameNodePool.slotSize;
+    stats->idIndexBytes = idIndexBytes(&table->idIndex);
+    stats->columnBytes = roomColumnsBytes(table->roomColumns);
+    unlockTable(table);
+}
+
+void addChainLength(unsigned long long *histogram, size_t length)
+{
+    histogram[length < ChainBuckets ? length - 1 : ChainBuckets - 1]++;
+}
+
+// probe lengths of the id index: how far each key sits from its home slot
+void idProbeHistogram(const IdSlot *slots, size_t capacity, unsigned long long *histogram)
+{
+    size_t mask = capacity - 1;
+    for (size_t i = 0; slots && i < capacity; i++)
+    {
+        if (slots[i].data && slots[i].data != IdIndexTombstone)
+        {
+            addChainLength(histogram, ((i - idIndexHash(slots[i].key)) & mask) + 1);
+        }
+    }
+}
+
+void tableMetrics(Table *table, TableMetrics *metrics)
+{
+    memset(metrics, 0, sizeof(*metrics));
+    for (int op = 0; op < OperationCount; op++)
+    {
+        OperationStats *stats = &metrics->operations[op];
+        stats->count = sumShards(table, offsetof(MetricsShard, opCount[op]));
+        stats->totalNanos = sumShards(table, offsetof(MetricsShard, opNanos[op]));
+        for (int b = 0; b < MetricsBuckets; b++)
+        {
+            stats->buckets[b] = sumShards(table, offsetof(MetricsShard, opBuckets[op][b]));
+        }
+    }
+    tableLockStats(table, &metrics->lock);
+    metrics->backups = sumShards(table, offsetof(MetricsShard, backups));
+    metrics->backupBytes = sumShards(table, offsetof(MetricsShard, backupBytes));
+    metrics->backupNanos = sumShards(table, offsetof(MetricsShard, backupNanos));
+    metrics->backupSyncNanos = sumShards(table, offsetof(MetricsShard, backupSyncNanos));
+    metrics->logFlushes = sumShards(table, offsetof(MetricsShard, logFlushes));
+    metrics->logBytes = sumShards(table, offsetof(MetricsShard, logBytes));
+    metrics->logSyncNanos = sumShards(table, offsetof(MetricsShard, logSyncNanos));
+
+    lockTableRead(table);
+    idProbeHistogram(table->idIndex.slots, table->idIndex.capacity, metrics->idProbeLengths);
+    idProbeHistogram(table->idIndex.oldSlots, table->idIndex.oldCapacity, metrics->idProbeLengths);
+    HashTable *names = &table->nameHashTable;
+    for (size_t b = 0; names->buckets && b < names->bucketCount; b++)
+    {
+        size_t length = 0;
+        for (HashNode *node = names->buckets[b]; node; node = node->next)
+        {
+            addChainLength(metrics->nameChainLengths, ++length);
+        }
+    }
+    unlockTable(table);
+}
+
+unsigned long long metricsPercentile(const OperationStats *stats, double fraction)
+{
+    unsigned long long wanted = (unsigned long long)(fraction * stats->count + 0.5);
+    unsigned long long seen = 0;
+    for (int b = 0; b < MetricsBuckets; b++)
+    {
+        seen += stats->buckets[b];
+        if (seen >= wanted && seen > 0)
+        {
+            return 1ULL << b;
+        }
+    }
+    return 0;
+}
+
+const char *operationName(HotelOperation operation)
+{
+    static const char *names[OperationCount] = {
+        "insert", "get", "update", "delete", "scan", "findByName", "searchByName", "findBySecondary", "import",
+        "query", "commit",
+    };
+    return operation >= 0 && operation < OperationCount ? names[operation] : "unknown";
+}
+
+void removeNameNode(Table *table, void *data)
+{
+    const char *name = table->nameExtract(data);
+    skipRemove(&table->nameOrder, name, data);
+    if (table->codedField)
+    {
+        secondaryRemove(&table->codeIndex, data);
+        return;
+    }
+
+    HashTable *hashTable = &table->nameHashTable;
+    if (!hashTable->buckets)
+    {
+        return;
+    }
+    HashNode **prev_ptr = &hashTable->buckets[stringHashFunction(name) % hashTable->bucketCount];
+    while (*prev_ptr)
+    {
+        HashNode *current = *prev_ptr;
+        if (current->data == data)
+        {
+            *prev_ptr = current->next;
+            poolFree(&table->nameNodePool, current);
+            hashTable->count--;
+            break;
+        }
+        prev_ptr = &current->next;
+    }
+}
+
+// every index of the table is maintained here and in unindexRecord
+// puts the record's name in the hash table, or a coded name under its code,
+// and in the ordered index unless a bulk load builds that once afterwards
+bool addNameNode(Table *table, void *data)
+{
+    const char *name = table->nameExtract(data);
+    if (table->codedField)
+    {
+        if (!secondaryAdd(&table->codeIndex, data))
+        {
+            return false;
+        }
+        if (!table->bulkLoad && !skipInsert(&table->nameOrder, name, data))
+        {
+            secondaryRemove(&table->codeIndex, data);
+            return false;
+        }
+        return true;
+    }
+    HashNode *nameHashNode = poolAlloc(&table->nameNodePool);
+    if (!nameHashNode || (!table->nameHashTable.buckets && !hashTableGrow(&table->nameHashTable)))
+    {
+        if (nameHashNode)
+        {
+            poolFree(&table->nameNodePool, nameHashNode);
+        }
+        return false;
+    }
+    if (!table->bulkLoad && !skipInsert(&table->nameOrder, name, data))
+    {
+        poolFree(&table->nameNodePool, nameHashNode);
+        return false;
+    }
+    nameHashNode->data = data;
+    nameHashNode->hash = stringHashFunction(name);
+    hashTableInsert(&table->nameHashTable, nameHashNode);
+    return true;
+}
+
+// the indexes that hold the record itself rather than its id: names,
+// secondaries and intervals, undone on failure
+bool indexRecordKeys(Table *table, void *data)
+{
+    // condition for name exist and insert it in hash table and ordered index
+    if (table->nameExtract && !addNameNode(table, data))
+    {
+        return false;
+    }
+
+    int added = 0;
+    while (added < table->secondaryCount && secondaryAdd(&table->secondary[added], data))
+    {
+        added++;
+    }
+    if (added == table->secondaryCount &&
+        (!table->intervalIndex.keyExtract || intervalAdd(&table->intervalIndex, data, table->bulkLoad)))
+    {
+        return true;
+    }
+
+    while (added-- > 0)
+    {
+        secondaryRemove(&table->secondary[added], data);
+    }
+    if (table->nameExtract)
+    {
+        removeNameNode(table, data);
+    }
+    return false;
+}
+
+void unindexRecordKeys(Table *table, void *data)
+{
+    if (table->nameExtract)
+    {
+        removeNameNode(table, data);
+    }
+
+    for (int i = 0; i < table->secondaryCount; i++)
+    {
+        secondaryRemove(&table->secondary[i], data);
+    }
+
+    if (table->intervalIndex.keyExtract)
+    {
+        intervalRemove(&table->intervalIndex, data);
+    }
+}
+
+// every index but the id index, undone on failure
+bool indexRecordFields(Table *table, void *data)
+{
+    if (!indexRecordKeys(table, data))
+    {
+        return false;
+    }
+    if (!table->roomColumns || roomColumnsAdd(table->roomColumns, data, *recordCode(table, data)))
+    {
+        return true;
+    }
+    unindexRecordKeys(table, data);
+    return false;
+}
+
+bool indexRecord(Table *table, void *data)
+{
+    int id = table->idExtract(data);
+    if (!idIndexInsert(&table->idIndex, id, data))
+    {
+        return false;
+    }
+    if (!indexRecordFields(table, data))
+    {
+        idIndexRemove(&table->idIndex, id);
+        return false;
+    }
+    return true;
+}
+
+void unindexRecordFields(Table *table, void *data)
+{
+    unindexRecordKeys(table, data);
+    if (table->roomColumns)
+    {
+        roomColumnsRemove(table->roomColumns, table->idExtract(data));
+    }
+}
+
+void unindexRecord(Table *table, void *data)
+{
+    idIndexRemove(&table->idIndex, table->idExtract(data));
+    unindexRecordFields(table, data);
+}
+
+// rebuilds the ordered name index from every record in one bulk pass
+bool rebuildNameOrder(Table *table)
+{
+    if (!table->nameExtract)
+    {
+        return true;
+    }
+    size_t count = table->idIndex.count + table->idIndex.oldCount;
+    const char **names = malloc((count + 1) * sizeof(char *));
+    void **records = malloc((count + 1) * sizeof(void *));
+    if (!names || !records)
+    {
+        free(names);
+        free(records);
+        return false;
+    }
+    size_t n = 0;
+    for (Node *current = table->head; current; current = current->next)
+    {
+        names[n] = table->nameExtract(current->data);
+        records[n++] = current->data;
+    }
+    skipFree(&table->nameOrder);
+    bool ok = skipBuild(&table->nameOrder, names, records, n);
+    free(names);
+    free(records);
+    return ok;
+}
+
+// builds the ordered indexes skipped while bulkLoad was set
+bool finishBulkLoad(Table *table)
+{
+    table->bulkLoad = false;
+    if (table->intervalIndex.keyExtract)
+    {
+        intervalSort(&table->intervalIndex);
+    }
+    return rebuildNameOrder(table);
+}
+
+// declares a secondary index on an int column, returns its number or -1
+int addSecondaryIndex(Table *table, const char *name, const char *column, int (*extract)(void *))
+{
+    if (table->secondaryCount == MaxSecondaryIndexes)
+    {
+        return -1;
+    }
+    SecondaryIndex *index = &table->secondary[table->secondaryCount];
+    *index = (SecondaryIndex){.name = name, .column = column, .extract = extract};
+    for (Node *current = table->head; current; current = current->next)
+    {
+        if (!secondaryAdd(index, current->data))
+        {
+            secondaryFree(index);
+            return -1;
+        }
+    }
+    return table->secondaryCount++;
+}
+
+// declares the interval index; must run before records are loaded
+void addIntervalIndex(Table *table, int (*keyExtract)(void *), int (*startExtract)(void *),
+                      int (*endExtract)(void *))
+{
+    table->intervalIndex = (IntervalIndex){
+        .keyExtract = keyExtract,
+        .startExtract = startExtract,
+        .endExtract = endExtract,
+    };
+}
+
+// fills results with up to maxResults records whose column equals key and
+// returns the total number of matches; callers hold the table lock
+size_t findAllBySecondary(Table *table, int indexNumber, int key, void **results, size_t maxResults)
+{
+    Posting *posting = idIndexFind(&table->secondary[indexNumber].keys, key);
+    if (!posting)
+    {
+        return 0;
+    }
+    size_t count = posting->count < maxResults ? posting->count : maxResults;
+    memcpy(results, posting->records, count * sizeof(void *));
+    return posting->count;
+}
+
+// base file format: a header page, then fixed-size pages of encoded records,
+// each page a block with its own checksum; integers are zigzag varints,
+// strings are length-prefixed and doubles keep their 8 bytes. a FieldCoded
+// column is its code + 1, or 0 and the string. after the file header comes
+// a block with the dictionary, each string's length + 1 and its bytes in
+// code order, 0 for a free code. multi-byte header fields use host byte
+// order. older versions are still read and get rewritten: version 1 holds
+// the blocks back to back
+#define BaseFileMagic "HDB\x01"
+#define BaseFileVersion 4
+// dictionary entries are plain lengths, there are no free codes
+#define BaseDenseCodesVersion 3
+// pages with FieldCoded columns written out in full
+#define BaseTextPagesVersion 2
+#define BaseBlockFileVersion 1
+#define BasePageBytes 16384
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    // the record layout the file was written for
+    uint32_t recordSize;
+    uint32_t fieldCount;
+    uint64_t recordCount;
+    // bumped by every whole-file rewrite, so a page journal written for the
+    // file it replaced is never replayed onto it
+    uint32_t generation;
+    uint32_t checksum;
+} BaseFileHeader;
+
+typedef struct
+{
+    uint32_t records;
+    uint32_t length;
+    uint32_t checksum;
+} BaseBlockHeader;
+
+#define PagePayload (BasePageBytes - sizeof(BaseBlockHeader))
+#define DictionaryPayload (BasePageBytes - sizeof(BaseFileHeader) - sizeof(BaseBlockHeader))
+
+// a record stays on the page it was placed on, at the same file offset,
+// until it is deleted or outgrows the page
+typedef struct Page
+{
+    void **records;
+    uint32_t count;
+    uint32_t capacity;
+    // encoded size of the records
+    uint32_t bytes;
+    // on the free stack
+    bool listed;
+} Page;
+
+// worst case encoded size of one record
+size_t maxEncodedSize(const Table *table)
+{
+    return table->dataSize + (size_t)table->fieldCount * 5;
+}
+
+size_t varintSize(unsigned int value)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+// the bytes encodeRecord writes for a stored record, given the codes in
+// the file as they are now
+size_t encodedSize(const Table *table, const void *record)
+{
+    const char *base = record;
+    size_t size = 0;
+    for (int i = 0; i < table->fieldCount; i++)
+    {
+        const Field *field = &table->fields[i];
+        const char *value = base + field->offset;
+        if (field->type == FieldInt)
+        {
+            int number;
+            memcpy(&number, value, sizeof(number));
+            size += varintSize(((unsigned int)number << 1) ^ (unsigned int)(number >> 31));
+        }
+        else if (field->type == FieldDouble)
+        {
+            size += sizeof(double);
+        }
+        else if (field->type == FieldCoded && (size_t)*recordCode(table, record) < table->codesInFile)
+        {
+            size += varintSize((unsigned int)*recordCode(table, record) + 1);
+        }
+        else
+        {
+            size_t length = strnlen(value, field->size);
+            size += (field->type == FieldCoded) + varintSize((unsigned int)length) + length;
+        }
+    }
+    return size;
+}
+
+// bytes of one entry of the base file's dictionary, 1 for a free code
+size_t codeEntrySize(const char *name)
+{
+    size_t length = name ? strlen(name) : 0;
+    return name ? varintSize((unsigned int)length + 1) + length : 1;
+}
+
+// numbers the record's FieldCoded value. a new value takes a free code when
+// there is one, unless the file lists that code and the value would no
+// longer fit there; a new code joins the file's list while it fits
+bool codeRecord(Table *table, void *data)
+{
+    if (!table->codedField)
+    {
+        return true;
+    }
+    Dictionary *strings = &table->strings;
+    const char *value = (const char *)data + table->codedField->offset;
+    int code = dictionaryFind(strings, value);
+    if (code < 0)
+    {
+        size_t bytes = codeEntrySize(value);
+        int reused = strings->freeCount > 0 ? strings->freeCodes[strings->freeCount - 1] : -1;
+        code = dictionaryAdd(strings, value,
+                             reused >= 0 && ((size_t)reused >= table->codesInFile ||
+                                             table->codeBytes - 1 + bytes <= DictionaryPayload));
+        if (code < 0)
+        {
+            return false;
+        }
+        if ((size_t)code < table->codesInFile)
+        {
+            table->codeBytes += bytes - 1;
+        }
+        else if ((size_t)code == table->codesInFile && table->codeBytes + bytes <= DictionaryPayload)
+        {
+            table->codesInFile++;
+            table->codeBytes += bytes;
+        }
+    }
+    strings->refs[code]++;
+    *recordCode(table, data) = code;
+    return true;
+}
+
+// frees a code no record holds; the file lists it as free until reused
+void releaseCode(Table *table, int code)
+{
+    if ((size_t)code < table->codesInFile)
+    {
+        table->codeBytes -= codeEntrySize(table->strings.names[code]) - 1;
+    }
+    dictionaryRemove(&table->strings, code);
+}
+
+// counts a loaded record's hold on the code decoded from the file, or
+// numbers a value that was written out in full
+bool holdCode(Table *table, void *data)
+{
+    if (table->codedField && *recordCode(table, data) >= 0)
+    {
+        table->strings.refs[*recordCode(table, data)]++;
+        return true;
+    }
+    return codeRecord(table, data);
+}
+
+// drops the hold of a record that left the table on its code. the record
+// keeps the number, which a checkpoint that captured it still encodes
+void uncodeRecord(Table *table, void *data)
+{
+    if (table->codedField && *recordCode(table, data) >= 0 && --table->strings.refs[*recordCode(table, data)] == 0)
+    {
+        releaseCode(table, *recordCode(table, data));
+    }
+}
+
+void markPageDirty(Table *table, uint32_t page)
+{
+    uint64_t bit = 1ULL << (page % 64);
+    if (!(table->dirtyPages[page / 64] & bit))
+    {
+        table->dirtyPages[page / 64] |= bit;
+        table->dirtyCount++;
+    }
+}
+
+bool pageHasRoom(const Table *table, const Page *page)
+{
+    return page->bytes + maxEncodedSize(table) <= PagePayload;
+}
+
+// appends an empty page; it reaches the file once a record is placed on it
+bool addPage(Table *table)
+{
+    if (table->pageCount == table->pageCapacity)
+    {
+        size_t capacity = table->pageCapacity ? table->pageCapacity * 2 : 64;
+        Page *pages = realloc(table->pages, capacity * sizeof(Page));
+        table->pages = pages ? pages : table->pages;
+        uint32_t *freePages = pages ? realloc(table->freePages, capacity * sizeof(uint32_t)) : NULL;
+        table->freePages = freePages ? freePages : table->freePages;
+        uint64_t *dirtyPages = freePages ? realloc(table->dirtyPages, capacity / 64 * sizeof(uint64_t)) : NULL;
+        if (!dirtyPages)
+        {
+            return false;
+        }
+        memset(dirtyPages + table->pageCapacity / 64, 0, (capacity - table->pageCapacity) / 64 * sizeof(uint64_t));
+        table->dirtyPages = dirtyPages;
+        table->pageCapacity = capacity;
+    }
+    table->pages[table->pageCount++] = (Page){0};
+    return true;
+}
+
+// room for one more record in the page's list
+bool growPage(Page *page)
+{
+    if (page->count < page->capacity)
+    {
+        return true;
+    }
+    uint32_t capacity = page->capacity ? page->capacity * 2 : 16;
+    void **records = realloc(page->records, capacity * sizeof(void *));
+    if (!records)
+    {
+        return false;
+    }
+    page->records = records;
+    page->capacity = capacity;
+    return true;
+}
+
+// puts the record at the end of the given page without marking it dirty
+bool pageAppend(Table *table, void *data, uint32_t number)
+{
+    Page *page = &table->pages[number];
+    if (!growPage(page))
+    {
+        return false;
+    }
+    Node *node = recordNode(data);
+    node->page = number;
+    node->pageSlot = page->count;
+    page->records[page->count++] = data;
+    page->bytes += (uint32_t)encodedSize(table, data);
+    return true;
+}
+
+// makes sure the top of the free stack has room for one more record of any
+// size, so pagePlace cannot fail halfway through a write
+bool pageReserve(Table *table)
+{
+    while (table->freePageCount > 0 &&
+           !pageHasRoom(table, &table->pages[table->freePages[table->freePageCount - 1]]))
+    {
+        table->pages[table->freePages[--table->freePageCount]].listed = false;
+    }
+    if (table->freePageCount == 0)
+    {
+        if (!addPage(table))
+        {
+            return false;
+        }
+        table->pages[table->pageCount - 1].listed = true;
+        table->freePages[table->freePageCount++] = (uint32_t)(table->pageCount - 1);
+    }
+    return growPage(&table->pages[table->freePages[table->freePageCount - 1]]);
+}
+
+// places a record on the page at the top of the free stack; pageReserve
+// must have run since the stack last changed
+void pagePlace(Table *table, void *data)
+{
+    uint32_t number = table->freePages[table->freePageCount - 1];
+    pageAppend(table, data, number);
+    markPageDirty(table, number);
+}
+
+void pageRemove(Table *table, void *data)
+{
+    Node *node = recordNode(data);
+    Page *page = &table->pages[node->page];
+    void *last = page->records[--page->count];
+    page->records[node->pageSlot] = last;
+    recordNode(last)->pageSlot = node->pageSlot;
+    page->bytes -= (uint32_t)encodedSize(table, data);
+    markPageDirty(table, node->page);
+    if (!page->listed && pageHasRoom(table, page))
+    {
+        page->listed = true;
+        table->freePages[table->freePageCount++] = node->page;
+    }
+}
+
+// the copy takes the record's place on its page, and moves to another page
+// if it no longer fits; pageReserve must have run first
+void pageReplace(Table *table, void *data, void *copy)
+{
+    Node *old = recordNode(data);
+    Node *node = recordNode(copy);
+    Page *page = &table->pages[old->page];
+    node->page = old->page;
+    node->pageSlot = old->pageSlot;
+    page->records[old->pageSlot] = copy;
+    page->bytes = page->bytes - (uint32_t)encodedSize(table, data) + (uint32_t)encodedSize(table, copy);
+    markPageDirty(table, old->page);
+    if (page->bytes > PagePayload)
+    {
+        pageRemove(table, copy);
+        pagePlace(table, copy);
+    }
+}
+
+void pagesFree(Table *table)
+{
+    for (size_t p = 0; p < table->pageCount; p++)
+    {
+        free(table->pages[p].records);
+    }
+    free(table->pages);
+    free(table->freePages);
+    free(table->dirtyPages);
+    table->pages = NULL;
+    table->freePages = NULL;
+    table->dirtyPages = NULL;
+    table->pageCount = table->pageCapacity = table->freePageCount = table->dirtyCount = 0;
+}
+
+// copies a record into the table's pool and links it into the list and
+// indexes, returns the stored record or NULL when out of memory
+void *addRecord(Table *table, const void *record)
+{
+    void *data = pageReserve(table) ? allocRecord(table) : NULL;
+    if (!data)
+    {
+        return NULL;
+    }
+    memcpy(data, record, table->dataSize);
+    if (!codeRecord(table, data))
+    {
+        freeRecord(table, data);
+        return NULL;
+    }
+    if (!indexRecord(table, data))
+    {
+        // the id index may have published it to lock-free readers already
+        uncodeRecord(table, data);
+        addToLimbo(table, recordNode(data));
+        return NULL;
+    }
+    linkNode(table, recordNode(data));
+    pagePlace(table, data);
+    return data;
+}
+
+// unlinks a record found through any index, without walking the list
+void removeRecord(Table *table, void *data)
+{
+    unindexRecord(table, data);
+    pageRemove(table, data);
+    uncodeRecord(table, data);
+    Node *node = recordNode(data);
+    unlinkNode(table, node);
+    retireNode(table, node);
+}
+
+// re-keys a record in every index under its new contents. records are never
+// overwritten, since snapshots and lock-free readers may be copying them: a
+// copy takes the record's place and the old version is retired. while the
+// id stays the same its id slot is repointed in one store, so lookups never
+// miss it. the copy is indexed beside the old version, which leaves the
+// indexes only once that worked, so running out of memory changes nothing.
+// returns where the record now lives
+void *replaceRecord(Table *table, void *data, const void *newData)
+{
+    void *copy = pageReserve(table) ? allocRecord(table) : NULL;
+    if (!copy)
+    {
+        return NULL;
+    }
+    memcpy(copy, newData, table->dataSize);
+    if (!codeRecord(table, copy))
+    {
+        freeRecord(table, copy);
+        return NULL;
+    }
+    int id = table->idExtract(data);
+    bool sameId = table->idExtract(copy) == id;
+    // a room keeping its id keeps its column row, which is overwritten
+    if (!(sameId ? indexRecordKeys(table, copy) : indexRecord(table, copy)))
+    {
+        uncodeRecord(table, copy);
+        addToLimbo(table, recordNode(copy));
+        return NULL;
+    }
+    if (sameId)
+    {
+        unindexRecordKeys(table, data);
+        if (table->roomColumns)
+        {
+            roomColumnsSet(table->roomColumns, copy, *recordCode(table, copy));
+        }
+        idIndexSwap(&table->idIndex, id, copy);
+    }
+    else
+    {
+        unindexRecordFields(table, data);
+        idIndexRemove(&table->idIndex, id);
+    }
+    Node *old = recordNode(data);
+    Node *node = recordNode(copy);
+    node->version = ++table->versions;
+    node->prev = old->prev;
+    node->next = old->next;
+    if (old->prev)
+    {
+        old->prev->next = node;
+    }
+    else
+    {
+        table->head = node;
+    }
+    if (old->next)
+    {
+        old->next->prev = node;
+    }
+    pageReplace(table, data, copy);
+    uncodeRecord(table, data);
+    retireNode(table, old);
+    return copy;
+}
+
+unsigned int fnv1a(unsigned int hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned int logChecksum(const LogRecordHeader *header, const void *payload)
+{
+    LogRecordHeader copy = *header;
+    copy.checksum = 0;
+    unsigned int hash = fnv1a(2166136261u, &copy, sizeof(copy));
+    return fnv1a(hash, payload, header->length);
+}
+
+bool writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+void walInit(Table *table)
+{
+    WriteAheadLog *wal = &table->wal;
+    pthread_mutex_init(&wal->mutex, NULL);
+    pthread_cond_init(&wal->durable, NULL);
+    wal->fd = -1;
+}
+
+void walFree(Table *table)
+{
+    WriteAheadLog *wal = &table->wal;
+    if (wal->fd >= 0)
+    {
+        close(wal->fd);
+    }
+    free(wal->buffer);
+    free(wal->flushBuffer);
+    pthread_mutex_destroy(&wal->mutex);
+    pthread_cond_destroy(&wal->durable);
+}
+
+// called with the table lock held so log order matches mutation order,
+// returns the record's sequence number or 0 if it could not be buffered
+unsigned long long walAppend(Table *table, int op, int key, const void *data)
+{
+    WriteAheadLog *wal = &table->wal;
+    LogRecordHeader header = {
+        .op = op,
+        .key = key,
+        .length = op == LogDelete ? 0 : (unsigned int)table->dataSize,
+    };
+    header.checksum = logChecksum(&header, data);
+    size_t recordSize = sizeof(header) + header.length;
+
+    pthread_mutex_lock(&wal->mutex);
+    if (wal->length + recordSize > wal->capacity)
+    {
+        size_t capacity = wal->capacity ? wal->capacity * 2 : 4096;
+        while (capacity < wal->length + recordSize)
+        {
+            capacity *= 2;
+        }
+        char *buffer = realloc(wal->buffer, capacity);
+        if (!buffer)
+        {
+            pthread_mutex_unlock(&wal->mutex);
+            return 0;
+        }
+        wal->buffer = buffer;
+        wal->capacity = capacity;
+    }
+    memcpy(wal->buffer + wal->length, &header, sizeof(header));
+    if (header.length)
+    {
+        memcpy(wal->buffer + wal->length + sizeof(header), data, header.length);
+    }
+    wal->length += recordSize;
+    wal->logBytes += recordSize;
+    unsigned long long lsn = ++wal->appendedLsn;
+    pthread_mutex_unlock(&wal->mutex);
+    return lsn;
+}
+
+// waits until lsn is on disk; whoever finds no flush running becomes the
+// leader and writes every record buffered so far with a single fdatasync.
+// false once a flush has failed, until a checkpoint resets the log
+bool walCommit(Table *table, unsigned long long lsn)
+{
+    WriteAheadLog *wal = &table->wal;
+    pthread_mutex_lock(&wal->mutex);
+    while (wal->durableLsn < lsn && !wal->failed)
+    {
+        if (wal->flushing)
+        {
+            pthread_cond_wait(&wal->durable, &wal->mutex);
+            continue;
+        }
+
+        char *buffer = wal->buffer;
+        size_t length = wal->length;
+        size_t capacity = wal->capacity;
+        unsigned long long target = wal->appendedLsn;
+        wal->buffer = wal->flushBuffer;
+        wal->capacity = wal->flushCapacity;
+        wal->length = 0;
+        wal->flushing = true;
+        pthread_mutex_unlock(&wal->mutex);
+
+        bool ok = writeAll(wal->fd, buffer, length);
+        unsigned long long syncStart = nowNanos();
+        ok = ok && fdatasync(wal->fd) == 0;
+        MetricsShard *shard = shardOf(table);
+        countMetric(&shard->logFlushes, 1);
+        countMetric(&shard->logBytes, length);
+        countMetric(&shard->logSyncNanos, nowNanos() - syncStart);
+
+        pthread_mutex_lock(&wal->mutex);
+        wal->flushBuffer = buffer;
+        wal->flushCapacity = capacity;
+        wal->flushing = false;
+        if (ok)
+        {
+            wal->durableLsn = target;
+        }
+        else
+        {
+            wal->failed = true;
+            wal->failedLsn = target;
+        }
+        pthread_cond_broadcast(&wal->durable);
+    }
+    bool ok = wal->durableLsn >= lsn;
+    pthread_mutex_unlock(&wal->mutex);
+    return ok;
+}
+
+// replay must be idempotent: a crash between compaction's rename and the log
+// truncation leaves records that are already reflected in the base file
+void applyLogRecord(Table *table, const LogRecordHeader *header, void *payload)
+{
+    void *existing = findById(table, header->key);
+    if (header->op == LogDelete)
+    {
+        if (existing)
+        {
+            removeRecord(table, existing);
+        }
+        return;
+    }
+
+    void *other = findById(table, table->idExtract(payload));
+    if (other && other != existing)
+    {
+        removeRecord(table, other);
+    }
+    if (existing)
+    {
+        replaceRecord(table, existing, payload);
+        return;
+    }
+
+    addRecord(table, payload);
+}
+
+// applies the intact prefix of the log and cuts off a torn tail, counting
+// the records replayed; fails only if the tail could not be cut off
+bool walReplay(Table *table, size_t *replayed)
+{
+    *replayed = 0;
+    FILE *file = fopen(table->logFilename, "rb");
+    if (!file)
+    {
+        return true;
+    }
+
+    void *payload = malloc(table->dataSize);
+    LogRecordHeader header;
+    long good = 0;
+    while (payload && fread(&header, sizeof(header), 1, file) == 1)
+    {
+        if (header.op < LogInsert || header.op > LogDelete)
+        {
+            break;
+        }
+        size_t expected = header.op == LogDelete ? 0 : table->dataSize;
+        if (header.length != expected || (expected && fread(payload, expected, 1, file) != 1))
+        {
+            break;
+        }
+        if (header.checksum != logChecksum(&header, payload))
+        {
+            break;
+        }
+        applyLogRecord(table, &header, payload);
+        good = ftell(file);
+        (*replayed)++;
+    }
+    free(payload);
+    fclose(file);
+
+    // the replayed records count as written, so the next checkpoint cuts them
+    table->wal.logBytes = (size_t)good;
+    return truncate(table->logFilename, good) == 0;
+}
+
+unsigned int baseHeaderChecksum(BaseFileHeader header)
+{
+    header.checksum = 0;
+    return fnv1a(2166136261u, &header, sizeof(header));
+}
+
+unsigned char *putVarint(unsigned char *out, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+const unsigned char *getVarint(const unsigned char *in, const unsigned char *end, unsigned int *value)
+{
+    *value = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7)
+    {
+        unsigned char byte = *in++;
+        *value |= (unsigned int)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+// a stored record; codes are the dictionary codes the file being written holds
+unsigned char *encodeRecord(const Table *table, const void *record, size_t codes, unsigned char *out)
+{
+    const char *base = record;
+    for (int i = 0; i < table->fieldCount; i++)
+    {
+        const Field *field = &table->fields[i];
+        const char *value = base + field->offset;
+        if (field->type == FieldInt)
+        {
+            int number;
+            memcpy(&number, value, sizeof(number));
+            out = putVarint(out, ((unsigned int)number << 1) ^ (unsigned int)(number >> 31));
+        }
+        else if (field->type == FieldDouble)
+        {
+            memcpy(out, value, sizeof(double));
+            out += sizeof(double);
+        }
+        else if (field->type == FieldCoded && (size_t)*recordCode(table, record) < codes)
+        {
+            out = putVarint(out, (unsigned int)*recordCode(table, record) + 1);
+        }
+        else
+        {
+            size_t length = strnlen(value, field->size);
+            if (field->type == FieldCoded)
+            {
+                *out++ = 0;
+            }
+            out = putVarint(out, (unsigned int)length);
+            memcpy(out, value, length);
+            out += length;
+        }
+    }
+    return out;
+}
+
+// returns NULL if the bytes do not hold a whole record. record is a stored
+// record: a coded value found in codes, the dictionary read from the file,
+// leaves its code in the record's slot, one written out in full still needs
+// a code. codes is NULL for files that write every value out
+const unsigned char *decodeRecord(const Table *table, const unsigned char *in, const unsigned char *end,
+                                  const Dictionary *codes, void *record)
+{
+    char *base = record;
+    memset(record, 0, table->dataSize);
+    for (int i = 0; i < table->fieldCount && in; i++)
+    {
+        const Field *field = &table->fields[i];
+        char *value = base + field->offset;
+        unsigned int number;
+        if (field->type == FieldInt)
+        {
+            in = getVarint(in, end, &number);
+            int decoded = (int)(number >> 1) ^ -(int)(number & 1);
+            memcpy(value, &decoded, sizeof(decoded));
+        }
+        else if (field->type == FieldDouble)
+        {
+            if ((size_t)(end - in) < sizeof(double))
+            {
+                return NULL;
+            }
+            memcpy(value, in, sizeof(double));
+            in += sizeof(double);
+        }
+        else if (field->type == FieldCoded && codes && (in = getVarint(in, end, &number)) && number > 0)
+        {
+            // dictionary strings were checked against the column size
+            if (number > codes->count || !codes->names[number - 1])
+            {
+                return NULL;
+            }
+            strcpy(value, codes->names[number - 1]);
+            *recordCode(table, record) = (int)number - 1;
+        }
+        else if (in)
+        {
+            in = getVarint(in, end, &number);
+            // the stored string must leave room for its terminator
+            if (!in || number >= field->size || number > (size_t)(end - in))
+            {
+                return NULL;
+            }
+            memcpy(value, in, number);
+            in += number;
+        }
+    }
+    return in;
+}
+
+// lays out one page: its block header, the encoded records and zeros up to
+// BasePageBytes; image has room for BasePageBytes + maxEncodedSize bytes
+bool encodePage(const Table *table, void **records, size_t count, size_t codes, unsigned char *image)
+{
+    unsigned char *payload = image + sizeof(BaseBlockHeader);
+    unsigned char *out = payload;
+    for (size_t i = 0; i < count && (size_t)(out - payload) <= PagePayload; i++)
+    {
+        out = encodeRecord(table, records[i], codes, out);
+    }
+    if ((size_t)(out - payload) > PagePayload)
+    {
+        return false;
+    }
+    BaseBlockHeader block = {
+        .records = (uint32_t)count,
+        .length = (uint32_t)(out - payload),
+        .checksum = fnv1a(2166136261u, payload, out - payload),
+    };
+    memcpy(image, &block, sizeof(block));
+    memset(out, 0, image + BasePageBytes - out);
+    return true;
+}
+
+// the dictionary block of the header page, with the strings of the codes
+// the file holds; takes the write lock and room for sizeof(BaseBlockHeader)
+// + DictionaryPayload bytes, returns the bytes used
+size_t encodeDictionary(const Table *table, unsigned char *block)
+{
+    unsigned char *payload = block + sizeof(BaseBlockHeader);
+    unsigned char *out = payload;
+    for (size_t code = 0; code < table->codesInFile; code++)
+    {
+        const char *name = table->strings.names[code];
+        if (!name)
+        {
+            *out++ = 0;
+            continue;
+        }
+        size_t length = strlen(name);
+        out = putVarint(out, (unsigned int)length + 1);
+        memcpy(out, name, length);
+        out += length;
+    }
+    BaseBlockHeader header = {
+        .records = (uint32_t)table->codesInFile,
+        .length = (uint32_t)(out - payload),
+        .checksum = fnv1a(2166136261u, payload, out - payload),
+    };
+    memcpy(block, &header, sizeof(header));
+    return out - block;
+}
+
+// the first page of the file holds the header and the dictionary block
+void encodeHeaderPage(const Table *table, size_t records, uint32_t generation, const unsigned char *dictionary,
+                      size_t dictionaryBytes, unsigned char *image)
+{
+    BaseFileHeader header = {
+        .magic = BaseFileMagic,
+        .version = BaseFileVersion,
+        .recordSize = (uint32_t)table->dataSize,
+        .fieldCount = (uint32_t)table->fieldCount,
+        .recordCount = records,
+        .generation = generation,
+    };
+    header.checksum = baseHeaderChecksum(header);
+    memset(image, 0, BasePageBytes);
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + sizeof(header), dictionary, dictionaryBytes);
+}
+
+// copies the log from offset onwards into a fresh log file that replaces it;
+// called with the wal mutex held and no flush running
+bool walRewriteFrom(Table *table, size_t offset, size_t length)
+{
+    char tmpName[256];
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", table->logFilename);
+    int in = open(table->logFilename, O_RDONLY);
+    int out = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = in >= 0 && out >= 0;
+    char buffer[65536];
+    while (ok && length > 0)
+    {
+        size_t chunk = length < sizeof(buffer) ? length : sizeof(buffer);
+        ok = pread(in, buffer, chunk, (off_t)offset) == (ssize_t)chunk && writeAll(out, buffer, chunk);
+        offset += chunk;
+        length -= chunk;
+    }
+    ok = ok && fsync(out) == 0;
+    if (out >= 0)
+    {
+        ok = close(out) == 0 && ok;
+    }
+    if (in >= 0)
+    {
+        close(in);
+    }
+    ok = ok && rename(tmpName, table->logFilename) == 0;
+    if (!ok)
+    {
+        remove(tmpName);
+        return false;
+    }
+
+    int fd = open(table->logFilename, O_WRONLY | O_APPEND);
+    if (fd >= 0)
+    {
+        close(table->wal.fd);
+        table->wal.fd = fd;
+    }
+    return fd >= 0;
+}
+
+// drops the first bytes of the log once the base file reflects them; later
+// records stay, so writers can keep appending while a checkpoint runs
+bool walTrim(Table *table, size_t bytes, unsigned long long lsn)
+{
+    WriteAheadLog *wal = &table->wal;
+    if (lsn)
+    {
+        walCommit(table, lsn);
+    }
+
+    pthread_mutex_lock(&wal->mutex);
+    while (wal->flushing)
+    {
+        pthread_cond_wait(&wal->durable, &wal->mutex);
+    }
+    if (wal->failed)
+    {
+        // the base file holds every record up to lsn, the lost flush
+        // included, so the log starts over with the records still buffered
+        bool reset = lsn >= wal->failedLsn && wal->fd >= 0 && ftruncate(wal->fd, 0) == 0;
+        if (reset)
+        {
+            wal->failed = false;
+            wal->durableLsn = lsn;
+            wal->logBytes = wal->length;
+        }
+        pthread_mutex_unlock(&wal->mutex);
+        return reset;
+    }
+    // records still buffered are replayed harmlessly if they are covered too
+    size_t written = wal->logBytes - wal->length;
+    size_t drop = bytes < written ? bytes : written;
+    bool ok = true;
+    if (wal->fd >= 0 && drop > 0)
+    {
+        // only drop the log once it is cut, a stale prefix replayed over the
+        // newer base file is harmless but one that is lost is not
+        ok = drop == written ? ftruncate(wal->fd, 0) == 0 : walRewriteFrom(table, drop, written - drop);
+    }
+    if (ok)
+    {
+        wal->logBytes -= drop;
+    }
+    pthread_mutex_unlock(&wal->mutex);
+    return ok;
+}
+
+// snapshots: a frozen list of record pointers taken under the read lock;
+// writers copy instead of overwriting and retire instead of freeing until
+// the last snapshot of the table is released
+struct TableSnapshot
+{
+    Table *table;
+    void **records;
+    size_t count;
+    // log length and last log record when the snapshot was taken
+    size_t logBytes;
+    unsigned long long lsn;
+};
+
+TableSnapshot *tableSnapshot(Table *table)
+{
+    TableSnapshot *snapshot = malloc(sizeof(TableSnapshot));
+    if (!snapshot)
+    {
+        return NULL;
+    }
+    snapshot->table = table;
+
+    lockTableRead(table);
+    size_t count = table->idIndex.count + table->idIndex.oldCount;
+    snapshot->records = malloc((count + 1) * sizeof(void *));
+    if (!snapshot->records)
+    {
+        unlockTable(table);
+        free(snapshot);
+        return NULL;
+    }
+    snapshot->count = 0;
+    for (Node *current = table->head; current; current = current->next)
+    {
+        snapshot->records[snapshot->count++] = current->data;
+    }
+    pthread_mutex_lock(&table->wal.mutex);
+    snapshot->logBytes = table->wal.logBytes;
+    snapshot->lsn = table->wal.appendedLsn;
+    pthread_mutex_unlock(&table->wal.mutex);
+    atomic_fetch_add(&table->snapshots, 1);
+    unlockTable(table);
+    return snapshot;
+}
+
+size_t snapshotRecordCount(const TableSnapshot *snapshot)
+{
+    return snapshot->count;
+}
+
+HotelStatus snapshotScan(TableSnapshot *snapshot, TableVisitor visit, void *context)
+{
+    unsigned long long start = nowNanos();
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        if (!visit(snapshot->records[i], context))
+        {
+            break;
+        }
+    }
+    recordOperation(snapshot->table, OpScan, start);
+    return HotelOk;
+}
+
+void snapshotRelease(TableSnapshot *snapshot)
+{
+    if (!snapshot)
+    {
+        return;
+    }
+    Table *table = snapshot->table;
+    lockTable(table);
+    if (atomic_fetch_sub(&table->snapshots, 1) == 1)
+    {
+        reclaimRetired(table);
+    }
+    unlockTable(table);
+    free(snapshot->records);
+    free(snapshot);
+}
+
+// what a checkpoint writes, captured under the write lock: the records of
+// the captured pages sit in snapshot->records one page after another, and
+// stay pinned until the snapshot is released
+typedef struct
+{
+    TableSnapshot *snapshot;
+    uint32_t *pages;
+    // end of each captured page's records in snapshot->records
+    size_t *ends;
+    size_t count;
+    size_t records;
+    // the dictionary block and the codes it holds
+    unsigned char *dictionary;
+    size_t dictionaryBytes;
+    size_t codes;
+    // every page was captured and goes to a new file
+    bool whole;
+} PageCheckpoint;
+
+// takes the dirty pages, or every page when the file must be rewritten or
+// most pages changed anyway, and clears the dirty bitmap
+bool capturePages(Table *table, PageCheckpoint *checkpoint)
+{
+    lockTable(table);
+    bool whole = table->rewriteBase || table->dirtyCount * 2 > table->pageCount;
+    size_t count = whole ? table->pageCount : table->dirtyCount;
+    size_t pinned = 0;
+    for (size_t p = 0; p < table->pageCount; p++)
+    {
+        if (whole || (table->dirtyPages[p / 64] >> (p % 64) & 1))
+        {
+            pinned += table->pages[p].count;
+        }
+    }
+    *checkpoint = (PageCheckpoint){
+        .snapshot = malloc(sizeof(TableSnapshot)),
+        .pages = malloc((count + 1) * sizeof(uint32_t)),
+        .ends = malloc((count + 1) * sizeof(size_t)),
+        .records = table->idIndex.count + table->idIndex.oldCount,
+        .dictionary = malloc(sizeof(BaseBlockHeader) + DictionaryPayload),
+        .codes = table->codesInFile,
+        .whole = whole,
+    };
+    TableSnapshot *snapshot = checkpoint->snapshot;
+    void **records = malloc((pinned + 1) * sizeof(void *));
+    if (!snapshot || !checkpoint->pages || !checkpoint->ends || !checkpoint->dictionary || !records)
+    {
+        unlockTable(table);
+        free(snapshot);
+        free(checkpoint->pages);
+        free(checkpoint->ends);
+        free(checkpoint->dictionary);
+        free(records);
+        return false;
+    }
+    checkpoint->dictionaryBytes = encodeDictionary(table, checkpoint->dictionary);
+
+    *snapshot = (TableSnapshot){.table = table, .records = records};
+    for (size_t p = 0; p < table->pageCount; p++)
+    {
+        if (whole || (table->dirtyPages[p / 64] >> (p % 64) & 1))
+        {
+            Page *page = &table->pages[p];
+            memcpy(records + snapshot->count, page->records, page->count * sizeof(void *));
+            snapshot->count += page->count;
+            checkpoint->pages[checkpoint->count] = (uint32_t)p;
+            checkpoint->ends[checkpoint->count++] = snapshot->count;
+        }
+    }
+    memset(table->dirtyPages, 0, table->pageCapacity / 64 * sizeof(uint64_t));
+    table->dirtyCount = 0;
+    table->rewriteBase = false;
+    pthread_mutex_lock(&table->wal.mutex);
+    snapshot->logBytes = table->wal.logBytes;
+    snapshot->lsn = table->wal.appendedLsn;
+    pthread_mutex_unlock(&table->wal.mutex);
+    atomic_fetch_add(&table->snapshots, 1);
+    unlockTable(table);
+    return true;
+}
+
+void releasePages(PageCheckpoint *checkpoint)
+{
+    snapshotRelease(checkpoint->snapshot);
+    free(checkpoint->pages);
+    free(checkpoint->ends);
+    free(checkpoint->dictionary);
+}
+
+void pageJournalName(const Table *table, char *name, size_t size)
+{
+    snprintf(name, size, "%s.pages", table->filename);
+}
+
+// empties the journal durably before removing it, so it cannot come back
+void clearPageJournal(const Table *table)
+{
+    char name[256];
+    pageJournalName(table, name, sizeof(name));
+    int fd = open(name, O_WRONLY | O_TRUNC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+        unlink(name);
+    }
+}
+
+// writes every captured page into <file>.tmp after the header page, syncs it
+// and renames it over the base file
+bool writeBaseFile(Table *table, const PageCheckpoint *checkpoint)
+{
+    char tmpName[256];
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", table->filename);
+    unsigned char *image = malloc(BasePageBytes + maxEncodedSize(table));
+    FILE *file = image ? fopen(tmpName, "wb") : NULL;
+    if (!file)
+    {
+        free(image);
+        return false;
+    }
+
+    uint32_t generation = table->baseGeneration + 1;
+    encodeHeaderPage(table, checkpoint->records, generation, checkpoint->dictionary, checkpoint->dictionaryBytes,
+                     image);
+    bool ok = fwrite(image, BasePageBytes, 1, file) == 1;
+    void **records = checkpoint->snapshot->records;
+    for (size_t i = 0, first = 0; i < checkpoint->count && ok; first = checkpoint->ends[i++])
+    {
+        ok = encodePage(table, records + first, checkpoint->ends[i] - first, checkpoint->codes, image) &&
+             fwrite(image, BasePageBytes, 1, file) == 1;
+    }
+    free(image);
+
+    ok = ok && fflush(file) == 0;
+    unsigned long long syncStart = nowNanos();
+    ok = ok && fsync(fileno(file)) == 0;
+    MetricsShard *shard = shardOf(table);
+    countMetric(&shard->backupBytes, (unsigned long long)ftell(file));
+    countMetric(&shard->backupSyncNanos, nowNanos() - syncStart);
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tmpName, table->filename) == 0;
+    if (!ok)
+    {
+        remove(tmpName);
+        return false;
+    }
+    table->baseGeneration = generation;
+    clearPageJournal(table);
+    return true;
+}
+
+// page journal: the images of the pages a checkpoint is about to overwrite,
+// with the file position of each
+#define PageJournalMagic "HDBJ"
+
+typedef struct
+{
+    char magic[4];
+    // generation of the base file the pages belong to
+    uint32_t generation;
+    uint32_t pages;
+    // of the positions and the images
+    uint32_t checksum;
+} PageJournalHeader;
+
+// writes positions[i] * BasePageBytes onwards from the images, a run of
+// consecutive positions in one call
+bool writePages(int fd, const uint32_t *positions, const unsigned char *images, size_t count)
+{
+    for (size_t i = 0, run; i < count; i += run)
+    {
+        run = 1;
+        while (i + run < count && positions[i + run] == positions[i] + run)
+        {
+            run++;
+        }
+        ssize_t length = (ssize_t)(run * BasePageBytes);
+        if (pwrite(fd, images + i * BasePageBytes, length, (off_t)positions[i] * BasePageBytes) != length)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// journals the captured pages and the header page, syncs the journal, then
+// overwrites them in place: a crash leaves the old pages with a torn journal,
+// or a journal that openTable replays
+bool writeDirtyPages(Table *table, const PageCheckpoint *checkpoint)
+{
+    if (checkpoint->count == 0)
+    {
+        return true;
+    }
+    size_t count = checkpoint->count + 1;
+    uint32_t *positions = malloc(count * sizeof(uint32_t));
+    unsigned char *images = malloc(count * BasePageBytes + maxEncodedSize(table));
+    bool ok = positions && images;
+    if (ok)
+    {
+        positions[0] = 0;
+        encodeHeaderPage(table, checkpoint->records, table->baseGeneration, checkpoint->dictionary,
+                         checkpoint->dictionaryBytes, images);
+    }
+    void **records = checkpoint->snapshot->records;
+    for (size_t i = 0, first = 0; i < checkpoint->count && ok; first = checkpoint->ends[i++])
+    {
+        positions[i + 1] = checkpoint->pages[i] + 1;
+        ok = encodePage(table, records + first, checkpoint->ends[i] - first, checkpoint->codes,
+                        images + (i + 1) * BasePageBytes);
+    }
+
+    char name[256];
+    pageJournalName(table, name, sizeof(name));
+    int journal = ok ? open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    int fd = journal >= 0 ? open(table->filename, O_WRONLY) : -1;
+    ok = fd >= 0;
+    if (ok)
+    {
+        PageJournalHeader header = {
+            .magic = PageJournalMagic,
+            .generation = table->baseGeneration,
+            .pages = (uint32_t)count,
+        };
+        header.checksum = fnv1a(fnv1a(2166136261u, positions, count * sizeof(uint32_t)), images, count * BasePageBytes);
+        unsigned long long syncStart = nowNanos();
+        ok = writeAll(journal, (const char *)&header, sizeof(header)) &&
+             writeAll(journal, (const char *)positions, count * sizeof(uint32_t)) &&
+             writeAll(journal, (const char *)images, count * BasePageBytes) && fsync(journal) == 0 &&
+             writePages(fd, positions, images, count) && fsync(fd) == 0;
+        MetricsShard *shard = shardOf(table);
+        countMetric(&shard->backupBytes, 2 * count * BasePageBytes);
+        countMetric(&shard->backupSyncNanos, nowNanos() - syncStart);
+    }
+    if (journal >= 0)
+    {
+        close(journal);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (ok)
+    {
+        clearPageJournal(table);
+    }
+    free(positions);
+    free(images);
+    return ok;
+}
+
+// finishes a checkpoint cut short after its journal was synced by writing
+// the journaled pages again, unless a whole-file rewrite replaced the file
+// they were meant for. a torn journal is dropped: the base file was not
+// touched yet
+bool replayPageJournal(Table *table)
+{
+    char name[256];
+    pageJournalName(table, name, sizeof(name));
+    int journal = open(name, O_RDONLY);
+    if (journal < 0)
+    {
+        return true;
+    }
+    PageJournalHeader header;
+    uint32_t *positions = NULL;
+    unsigned char *images = NULL;
+    bool valid = read(journal, &header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header.magic, PageJournalMagic, 4) == 0 && header.pages > 0 &&
+                 (positions = malloc(header.pages * sizeof(uint32_t))) &&
+                 (images = malloc((size_t)header.pages * BasePageBytes));
+    valid = valid && read(journal, positions, header.pages * sizeof(uint32_t)) ==
+                         (ssize_t)(header.pages * sizeof(uint32_t));
+    for (size_t i = 0; valid && i < header.pages; i++)
+    {
+        valid = pread(journal, images + i * BasePageBytes, BasePageBytes,
+                      (off_t)(sizeof(header) + header.pages * sizeof(uint32_t) + i * BasePageBytes)) == BasePageBytes;
+    }
+    valid = valid && header.checksum == fnv1a(fnv1a(2166136261u, positions, header.pages * sizeof(uint32_t)),
+                                              images, (size_t)header.pages * BasePageBytes);
+    close(journal);
+
+    bool ok = true;
+    int fd = valid ? open(table->filename, O_RDWR) : -1;
+    if (fd >= 0)
+    {
+        BaseFileHeader base;
+        bool stale = pread(fd, &base, sizeof(base), 0) == sizeof(base) &&
+                     base.checksum == baseHeaderChecksum(base) && base.generation != header.generation;
+        ok = stale || (writePages(fd, positions, images, header.pages) && fsync(fd) == 0);
+        close(fd);
+    }
+    free(positions);
+    free(images);
+    if (ok)
+    {
+        clearPageJournal(table);
+    }
+    return ok;
+}
+
+// checkpoint: write the pages changed since the last checkpoint, or a whole
+// new base file, and cut the log records they cover; the table lock is held
+// only while the pages are captured. a failed checkpoint leaves the file in
+// a state the next one replaces whole
+bool checkpointTable(Table *table)
+{
+    unsigned long long start = nowNanos();
+    pthread_mutex_lock(&table->checkpointMutex);
+    PageCheckpoint checkpoint;
+    bool ok = capturePages(table, &checkpoint);
+    if (ok)
+    {
+        ok = (checkpoint.whole ? writeBaseFile(table, &checkpoint) : writeDirtyPages(table, &checkpoint)) &&
+             walTrim(table, checkpoint.snapshot->logBytes, checkpoint.snapshot->lsn);
+        if (!ok)
+        {
+            lockTable(table);
+            table->rewriteBase = true;
+            unlockTable(table);
+        }
+        releasePages(&checkpoint);
+    }
+    pthread_mutex_unlock(&table->checkpointMutex);
+    countMetric(&shardOf(table)->backups, 1);
+    countMetric(&shardOf(table)->backupNanos, nowNanos() - start);
+    return ok;
+}
+
+void *backupTable(void *arg)
+{
+    checkpointTable((Table *)arg);
+    return NULL;
+}
+
+// persistence worker: one long-lived thread compacts dirty tables, letting a
+// burst of writes settle into a single checkpoint per table
+#define DefaultMaxStalenessMs 2000
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t flushed;
+    Table *dirtyHead;
+    unsigned long long firstDirtyNanos;
+    unsigned long long maxStalenessNanos;
+    unsigned long long requestedFlush;
+    unsigned long long completedFlush;
+    bool urgent;
+    bool running;
+} PersistenceWorker;
+
+PersistenceWorker persistence;
+
+void *persistenceWorker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&persistence.mutex);
+    while (true)
+    {
+        while (persistence.running && !persistence.dirtyHead &&
+               persistence.requestedFlush == persistence.completedFlush)
+        {
+            pthread_cond_wait(&persistence.wake, &persistence.mutex);
+        }
+        if (!persistence.running && !persistence.dirtyHead)
+        {
+            break;
+        }
+
+        // coalesce until the oldest pending change reaches max staleness
+        while (persistence.running && persistence.dirtyHead && !persistence.urgent &&
+               persistence.requestedFlush == persistence.completedFlush)
+        {
+            unsigned long long deadline = persistence.firstDirtyNanos + persistence.maxStalenessNanos;
+            if (nowNanos() >= deadline)
+            {
+                break;
+            }
+            struct timespec ts = {
+                .tv_sec = (time_t)(deadline / 1000000000ULL),
+                .tv_nsec = (long)(deadline % 1000000000ULL),
+            };
+            pthread_cond_timedwait(&persistence.wake, &persistence.mutex, &ts);
+        }
+
+        Table *dirty = persistence.dirtyHead;
+        unsigned long long flushGoal = persistence.requestedFlush;
+        persistence.dirtyHead = NULL;
+        persistence.urgent = false;
+        // a table written to during the flush is queued again via nextDirty
+        for (Table *table = dirty; table; table = table->nextDirty)
+        {
+            table->queued = false;
+            table->nextFlush = table->nextDirty;
+        }
+        pthread_mutex_unlock(&persistence.mutex);
+
+        for (Table *table = dirty; table; table = table->nextFlush)
+        {
+            backupTable(table);
+        }
+
+        pthread_mutex_lock(&persistence.mutex);
+        persistence.completedFlush = flushGoal;
+        pthread_cond_broadcast(&persistence.flushed);
+    }
+    pthread_mutex_unlock(&persistence.mutex);
+    return NULL;
+}
+
+// returns false if the thread could not start; tables are then only
+// compacted at close
+bool startPersistenceWorker(unsigned int maxStalenessMs)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&persistence.mutex, NULL);
+    pthread_cond_init(&persistence.wake, &attr);
+    pthread_cond_init(&persistence.flushed, NULL);
+    pthread_condattr_destroy(&attr);
+
+    persistence.dirtyHead = NULL;
+    persistence.maxStalenessNanos = (unsigned long long)maxStalenessMs * 1000000ULL;
+    persistence.requestedFlush = 0;
+    persistence.completedFlush = 0;
+    persistence.urgent = false;
+    persistence.running = true;
+    if (pthread_create(&persistence.thread, NULL, persistenceWorker, NULL) != 0)
+    {
+        persistence.running = false;
+    }
+    return persistence.running;
+}
+
+// queues the table for the next checkpoint; repeated calls before it runs coalesce
+void markTableDirty(Table *table, bool urgent)
+{
+    pthread_mutex_lock(&persistence.mutex);
+    if (!table->queued)
+    {
+        if (!persistence.dirtyHead)
+        {
+            persistence.firstDirtyNanos = nowNanos();
+        }
+        table->queued = true;
+        table->nextDirty = persistence.dirtyHead;
+        persistence.dirtyHead = table;
+    }
+    if (urgent)
+    {
+        persistence.urgent = true;
+    }
+    pthread_cond_signal(&persistence.wake);
+    pthread_mutex_unlock(&persistence.mutex);
+}
+
+// blocks until every table dirtied before the call has been checkpointed
+void flushNow()
+{
+    pthread_mutex_lock(&persistence.mutex);
+    if (!persistence.running)
+    {
+        pthread_mutex_unlock(&persistence.mutex);
+        return;
+    }
+    unsigned long long goal = ++persistence.requestedFlush;
+    pthread_cond_signal(&persistence.wake);
+    while (persistence.completedFlush < goal)
+    {
+        pthread_cond_wait(&persistence.flushed, &persistence.mutex);
+    }
+    pthread_mutex_unlock(&persistence.mutex);
+}
+
+void stopPersistenceWorker()
+{
+    pthread_mutex_lock(&persistence.mutex);
+    bool running = persistence.running;
+    persistence.running = false;
+    pthread_cond_signal(&persistence.wake);
+    pthread_mutex_unlock(&persistence.mutex);
+
+    if (running)
+    {
+        pthread_join(persistence.thread, NULL);
+    }
+    pthread_mutex_destroy(&persistence.mutex);
+    pthread_cond_destroy(&persistence.wake);
+    pthread_cond_destroy(&persistence.flushed);
+}
+
+// called after the table lock is released so concurrent writers share one fsync
+HotelStatus commitChange(Table *table, unsigned long long lsn)
+{
+    bool durable = lsn && walCommit(table, lsn);
+
+    // a failed log is only reset by a checkpoint
+    pthread_mutex_lock(&table->wal.mutex);
+    bool urgent = table->wal.logBytes >= WalCompactBytes || table->wal.failed;
+    pthread_mutex_unlock(&table->wal.mutex);
+    markTableDirty(table, urgent);
+    return durable ? HotelOk : HotelIoError;
+}
+
+// public operations: the table lock is taken here, callers never see it;
+// each runs through a single exit so its latency is recorded
+HotelStatus tableInsert(Table *table, const void *record)
+{
+    unsigned long long start = nowNanos();
+    HotelStatus status = HotelInvalid;
+    unsigned long long lsn = 0;
+    if (table->validateFunction(record))
+    {
+        int id = table->idExtract((void *)record);
+        lockTable(table);
+        void *stored = NULL;
+        if (findById(table, id))
+        {
+            status = HotelDuplicate;
+        }
+        else if (!(stored = addRecord(table, record)))
+        {
+            status = HotelNoMemory;
+        }
+        else
+        {
+            lsn = walAppend(table, LogInsert, id, stored);
+        }
+        unlockTable(table);
+        if (stored)
+        {
+            status = commitChange(table, lsn);
+        }
+    }
+    recordOperation(table, OpInsert, start);
+    return status;
+}
+
+// lock-free: records are never overwritten and the one found stays
+// allocated until the epoch is left; the lock is only a fallback
+HotelStatus tableGet(Table *table, int id, void *record)
+{
+    unsigned long long start = nowNanos();
+    void *data = NULL;
+    bool answered = false;
+    if (epochEnter())
+    {
+        answered = idIndexFindShared(&table->idIndex, id, table->idExtract, &data);
+        if (data)
+        {
+            memcpy(record, data, table->dataSize);
+        }
+        epochExit();
+    }
+    if (!answered)
+    {
+        lockTableRead(table);
+        data = findById(table, id);
+        if (data)
+        {
+            memcpy(record, data, table->dataSize);
+        }
+        unlockTable(table);
+    }
+    recordOperation(table, OpGet, start);
+    return data ? HotelOk : HotelNotFound;
+}
+
+HotelStatus tableUpdate(Table *table, int id, const void *record)
+{
+    unsigned long long start = nowNanos();
+    HotelStatus status = HotelInvalid;
+    if (table->validateFunction(record))
+    {
+        int newId = table->idExtract((void *)record);
+        bool changed = false;
+        unsigned long long lsn = 0;
+        lockTable(table);
+        void *data = findById(table, id);
+        if (!data)
+        {
+            status = HotelNotFound;
+        }
+        else if (newId != id && findById(table, newId))
+        {
+            status = HotelDuplicate;
+        }
+        else if (!(data = replaceRecord(table, data, record)))
+        {
+            status = HotelNoMemory;
+        }
+        else
+        {
+            lsn = walAppend(table, LogUpdate, id, data);
+            changed = true;
+        }
+        unlockTable(table);
+        if (changed)
+        {
+            status = commitChange(table, lsn);
+        }
+    }
+    recordOperation(table, OpUpdate, start);
+    return status;
+}
+
+HotelStatus tableDelete(Table *table, int id)
+{
+    unsigned long long start = nowNanos();
+    HotelStatus status = HotelNotFound;
+    unsigned long long lsn = 0;
+    lockTable(table);
+    void *data = findById(table, id);
+    if (data)
+    {
+        removeRecord(table, data);
+        lsn = walAppend(table, LogDelete, id, NULL);
+    }
+    unlockTable(table);
+    if (data)
+    {
+        status = commitChange(table, lsn);
+    }
+    recordOperation(table, OpDelete, start);
+    return status;
+}
+
+HotelStatus tableScan(Table *table, TableVisitor visit, void *context)
+{
+    unsigned long long start = nowNanos();
+    lockTableRead(table);
+    for (Node *current = table->head; current; current = current->next)
+    {
+        if (!visit(current->data, context))
+        {
+            break;
+        }
+    }
+    unlockTable(table);
+    recordOperation(table, OpScan, start);
+    return HotelOk;
+}
+
+// cursors: the ids in id order, looked up again batch by batch
+struct TableCursor
+{
+    Table *table;
+    int *ids;
+    size_t count;
+    size_t position;
+};
+
+int compareIds(const void *a, const void *b)
+{
+    int left = *(const int *)a, right = *(const int *)b;
+    return (left > right) - (left < right);
+}
+
+// still in the list: the id index leads to this very copy
+bool nodeLinked(Table *table, Node *node)
+{
+    return findById(table, table->idExtract(node->data)) == node->data;
+}
+
+// the ids are collected CursorBatch records per read lock. while the cursor
+// opens it counts as a snapshot, so records unlinked meanwhile wait on the
+// retired list with their prev link intact: when the last record listed has
+// left the list, the walk backs up to the nearest one still in it. a record
+// met twice that way is listed once
+TableCursor *tableCursorOpen(Table *table)
+{
+    TableCursor *cursor = malloc(sizeof(TableCursor));
+    if (!cursor)
+    {
+        return NULL;
+    }
+    cursor->table = table;
+    cursor->position = 0;
+    cursor->count = 0;
+    cursor->ids = NULL;
+
+    size_t capacity = 0;
+    Node *last = NULL;
+    bool memory = true, started = false, done = false;
+    while (memory && !done)
+    {
+        if (cursor->count + CursorBatch > capacity)
+        {
+            capacity = capacity ? capacity * 2 : CursorBatch;
+            int *ids = realloc(cursor->ids, capacity * sizeof(int));
+            memory = ids != NULL;
+            cursor->ids = ids ? ids : cursor->ids;
+            if (!memory)
+            {
+                break;
+            }
+        }
+        lockTableRead(table);
+        if (!started)
+        {
+            atomic_fetch_add(&table->snapshots, 1);
+            started = true;
+        }
+        while (last && !nodeLinked(table, last))
+        {
+            last = last->prev;
+        }
+        Node *current = last ? last->next : table->head;
+        for (int taken = 0; current && taken < CursorBatch; taken++)
+        {
+            cursor->ids[cursor->count++] = table->idExtract(current->data);
+            last = current;
+            current = current->next;
+        }
+        done = !current;
+        unlockTable(table);
+    }
+    if (started)
+    {
+        lockTable(table);
+        if (atomic_fetch_sub(&table->snapshots, 1) == 1)
+        {
+            reclaimRetired(table);
+        }
+        unlockTable(table);
+    }
+    if (!memory)
+    {
+        free(cursor->ids);
+        free(cursor);
+        return NULL;
+    }
+
+    qsort(cursor->ids, cursor->count, sizeof(int), compareIds);
+    size_t unique = 0;
+    for (size_t i = 0; i < cursor->count; i++)
+    {
+        if (unique == 0 || cursor->ids[i] != cursor->ids[unique - 1])
+        {
+            cursor->ids[unique++] = cursor->ids[i];
+        }
+    }
+    cursor->count = unique;
+    return cursor;
+}
+
+size_t cursorRecordCount(const TableCursor *cursor)
+{
+    return cursor->count;
+}
+
+size_t cursorFetch(TableCursor *cursor, void *records, size_t maxRecords)
+{
+    Table *table = cursor->table;
+    unsigned long long start = nowNanos();
+    size_t fetched = 0;
+    while (fetched < maxRecords && cursor->position < cursor->count)
+    {
+        // lock per batch so writers get in between
+        lockTableRead(table);
+        for (size_t looked = 0;
+             looked < CursorBatch && fetched < maxRecords && cursor->position < cursor->count; looked++)
+        {
+            void *data = findById(table, cursor->ids[cursor->position++]);
+            if (data)
+            {
+                memcpy((char *)records + fetched++ * table->dataSize, data, table->dataSize);
+            }
+        }
+        unlockTable(table);
+    }
+    recordOperation(table, OpScan, start);
+    return fetched;
+}
+
+size_t cursorPosition(const TableCursor *cursor)
+{
+    return cursor->position;
+}
+
+void cursorSeek(TableCursor *cursor, size_t position)
+{
+    cursor->position = position < cursor->count ? position : cursor->count;
+}
+
+void cursorClose(TableCursor *cursor)
+{
+    if (!cursor)
+    {
+        return;
+    }
+    free(cursor->ids);
+    free(cursor);
+}
+
+// transactions: every record a transaction touches is a row remembering the
+// version it was first seen at (0 when missing) and the transaction's copy
+typedef enum
+{
+    TxRead,
+    TxInsert,
+    TxUpdate,
+    TxDelete
+} TxAction;
+
+typedef struct
+{
+    HotelTableId table;
+    int id;
+    unsigned long long version;
+    TxAction action;
+    // the record as the transaction sees it, unused while it is missing
+    void *record;
+} TxRow;
+
+// a room that must have no reservation overlapping [fromDay, toDay) when the
+// transaction commits
+typedef struct
+{
+    int roomId;
+    int fromDay;
+    int toDay;
+} TxStay;
+
+struct Transaction
+{
+    TxRow *rows;
+    int count;
+    int capacity;
+    TxStay *stays;
+    int stayCount;
+    int stayCapacity;
+};
+
+Transaction *txBegin()
+{
+    return calloc(1, sizeof(Transaction));
+}
+
+// whether the record exists as far as the transaction is concerned
+bool txRowVisible(const TxRow *row)
+{
+    return row->action == TxInsert || row->action == TxUpdate || (row->action == TxRead && row->version != 0);
+}
+
+// finds the transaction's row for a record, reading it from the table the
+// first time; NULL when out of memory
+TxRow *txRow(Transaction *tx, HotelTableId id, int recordId)
+{
+    for (int i = 0; i < tx->count; i++)
+    {
+        if (tx->rows[i].table == id && tx->rows[i].id == recordId)
+        {
+            return &tx->rows[i];
+        }
+    }
+    if (tx->count == tx->capacity)
+    {
+        int capacity = tx->capacity ? tx->capacity * 2 : 8;
+        TxRow *rows = realloc(tx->rows, capacity * sizeof(TxRow));
+        if (!rows)
+        {
+            return NULL;
+        }
+        tx->rows = rows;
+        tx->capacity = capacity;
+    }
+    Table *table = hotelTable(id);
+    TxRow *row = &tx->rows[tx->count];
+    row->record = malloc(table->dataSize);
+    if (!row->record)
+    {
+        return NULL;
+    }
+    row->table = id;
+    row->id = recordId;
+    row->action = TxRead;
+    row->version = 0;
+
+    unsigned long long start = nowNanos();
+    lockTableRead(table);
+    void *data = findById(table, recordId);
+    if (data)
+    {
+        memcpy(row->record, data, table->dataSize);
+        row->version = recordNode(data)->version;
+    }
+    unlockTable(table);
+    recordOperation(table, OpGet, start);
+    tx->count++;
+    return row;
+}
+
+HotelStatus txGet(Transaction *tx, HotelTableId table, int id, void *record)
+{
+    TxRow *row = txRow(tx, table, id);
+    if (!row)
+    {
+        return HotelNoMemory;
+    }
+    if (!txRowVisible(row))
+    {
+        return HotelNotFound;
+    }
+    memcpy(record, row->record, hotelTable(table)->dataSize);
+    return HotelOk;
+}
+
+HotelStatus txInsert(Transaction *tx, HotelTableId table, const void *record)
+{
+    if (!hotelTable(table)->validateFunction(record))
+    {
+        return HotelInvalid;
+    }
+    TxRow *row = txRow(tx, table, hotelTable(table)->idExtract((void *)record));
+    if (!row)
+    {
+        return HotelNoMemory;
+    }
+    if (txRowVisible(row))
+    {
+        return HotelDuplicate;
+    }
+    // deleted earlier in the same transaction, so it is still there to update
+    row->action = row->version ? TxUpdate : TxInsert;
+    memcpy(row->record, record, hotelTable(table)->dataSize);
+    return HotelOk;
+}
+
+HotelStatus txUpdate(Transaction *tx, HotelTableId table, int id, const void *record)
+{
+    if (!hotelTable(table)->validateFunction(record) || hotelTable(table)->idExtract((void *)record) != id)
+    {
+        return HotelInvalid;
+    }
+    TxRow *row = txRow(tx, table, id);
+    if (!row)
+    {
+        return HotelNoMemory;
+    }
+    if (!txRowVisible(row))
+    {
+        return HotelNotFound;
+    }
+    if (row->action == TxRead)
+    {
+        row->action = TxUpdate;
+    }
+    memcpy(row->record, record, hotelTable(table)->dataSize);
+    return HotelOk;
+}
+
+// checks the reservation interval index now and again at commit, so a stay
+// booked by anyone in between conflicts
+HotelStatus txRequireFree(Transaction *tx, int roomId, int fromDay, int toDay)
+{
+    Table *reservations = &tables[ReservationTable];
+    lockTableRead(reservations);
+    bool taken = intervalOverlaps(&reservations->intervalIndex, roomId, fromDay, toDay);
+    unlockTable(reservations);
+    if (taken)
+    {
+        return HotelConflict;
+    }
+    if (tx->stayCount == tx->stayCapacity)
+    {
+        int capacity = tx->stayCapacity ? tx->stayCapacity * 2 : 2;
+        TxStay *stays = realloc(tx->stays, capacity * sizeof(TxStay));
+        if (!stays)
+        {
+            return HotelNoMemory;
+        }
+        tx->stays = stays;
+        tx->stayCapacity = capacity;
+    }
+    tx->stays[tx->stayCount++] = (TxStay){roomId, fromDay, toDay};
+    return HotelOk;
+}
+
+HotelStatus txDelete(Transaction *tx, HotelTableId table, int id)
+{
+    TxRow *row = txRow(tx, table, id);
+    if (!row)
+    {
+        return HotelNoMemory;
+    }
+    if (!txRowVisible(row))
+    {
+        return HotelNotFound;
+    }
+    // inserted by this transaction: back to expecting it missing
+    row->action = row->version ? TxDelete : TxRead;
+    return HotelOk;
+}
+
+void txAbort(Transaction *tx)
+{
+    if (!tx)
+    {
+        return;
+    }
+    for (int i = 0; i < tx->count; i++)
+    {
+        free(tx->rows[i].record);
+    }
+    free(tx->rows);
+    free(tx->stays);
+    free(tx);
+}
+
+// the locks of the tables involved are held only to validate and apply, in
+// table order like runQuery; tables the transaction only read are read locked
+HotelStatus txCommit(Transaction *tx)
+{
+    unsigned long long start = nowNanos();
+    bool used[TableCount] = {false}, written[TableCount] = {false};
+    for (int i = 0; i < tx->count; i++)
+    {
+        used[tx->rows[i].table] = true;
+        written[tx->rows[i].table] |= tx->rows[i].action != TxRead;
+    }
+    used[ReservationTable] |= tx->stayCount > 0;
+    for (int i = 0; i < TableCount; i++)
+    {
+        if (written[i])
+        {
+            lockTable(hotelTable(i));
+        }
+        else if (used[i])
+        {
+            lockTableRead(hotelTable(i));
+        }
+    }
+
+    HotelStatus status = HotelOk;
+    for (int i = 0; i < tx->count && status == HotelOk; i++)
+    {
+        void *data = findById(hotelTable(tx->rows[i].table), tx->rows[i].id);
+        if ((data ? recordNode(data)->version : 0) != tx->rows[i].version)
+        {
+            status = HotelConflict;
+        }
+    }
+    // the stays are checked before the transaction's own reservations go in
+    for (int i = 0; i < tx->stayCount && status == HotelOk; i++)
+    {
+        if (intervalOverlaps(&tables[ReservationTable].intervalIndex, tx->stays[i].roomId, tx->stays[i].fromDay,
+                             tx->stays[i].toDay))
+        {
+            status = HotelConflict;
+        }
+    }
+
+    // every write was checked above, so only running out of memory can stop
+    // them part way; what was applied stays, as the header says
+    unsigned long long lsn[TableCount] = {0};
+    for (int i = 0; i < tx->count && status == HotelOk; i++)
+    {
+        TxRow *row = &tx->rows[i];
+        Table *table = hotelTable(row->table);
+        void *data = findById(table, row->id);
+        if (row->action == TxInsert)
+        {
+            if (!(data = addRecord(table, row->record)))
+            {
+                status = HotelNoMemory;
+                break;
+            }
+            lsn[row->table] = walAppend(table, LogInsert, row->id, data);
+        }
+        else if (row->action == TxUpdate)
+        {
+            if (!(data = replaceRecord(table, data, row->record)))
+            {
+                status = HotelNoMemory;
+                break;
+            }
+            lsn[row->table] = walAppend(table, LogUpdate, row->id, data);
+        }
+        else if (row->action == TxDelete)
+        {
+            removeRecord(table, data);
+            lsn[row->table] = walAppend(table, LogDelete, row->id, NULL);
+        }
+    }
+
+    for (int i = TableCount - 1; i >= 0; i--)
+    {
+        if (used[i])
+        {
+            unlockTable(hotelTable(i));
+        }
+    }
+    for (int i = 0; i < TableCount; i++)
+    {
+        if (lsn[i] && commitChange(hotelTable(i), lsn[i]) != HotelOk && status == HotelOk)
+        {
+            status = HotelIoError;
+        }
+        if (used[i])
+        {
+            recordOperation(hotelTable(i), OpCommit, start);
+        }
+    }
+    txAbort(tx);
+    return status;
+}
+
+#define BookRetries 8
+
+// a booking reads the room, the customer and the room's occupant row and
+// requires the stay to be free in the reservation interval index, so of two
+// overlapping bookings the later one fails at commit, retries and sees the
+// stay taken
+HotelStatus bookRoom(const struct Reservation *reservation)
+{
+    for (int attempt = 0; attempt < BookRetries; attempt++)
+    {
+        Transaction *tx = txBegin();
+        if (!tx)
+        {
+            return HotelNoMemory;
+        }
+        struct Room room;
+        struct Customer customer;
+        struct CUTSOMER_PLACES_ROOM occupant;
+        HotelStatus status = txGet(tx, RoomTable, reservation->roomID, &room);
+        if (status == HotelOk)
+        {
+            status = txGet(tx, CustomerTable, reservation->customerID, &customer);
+        }
+        if (status == HotelOk)
+        {
+            status = txRequireFree(tx, room.roomID, reservation->checkInDay, reservation->checkOutDay);
+        }
+        if (status == HotelOk)
+        {
+            status = txInsert(tx, ReservationTable, reservation);
+        }
+        if (status == HotelOk)
+        {
+            bool occupied = txGet(tx, CustomerPlacesRoomTable, room.roomID, &occupant) == HotelOk;
+            occupant.customerID = customer.customerID;
+            occupant.RoomID = room.roomID;
+            memcpy(occupant.phone, customer.phone, sizeof(occupant.phone));
+            status = occupied ? txUpdate(tx, CustomerPlacesRoomTable, room.roomID, &occupant)
+                              : txInsert(tx, CustomerPlacesRoomTable, &occupant);
+        }
+        if (status != HotelOk)
+        {
+            txAbort(tx);
+            return status;
+        }
+        status = txCommit(tx);
+        if (status != HotelConflict)
+        {
+            return status;
+        }
+    }
+    return HotelConflict;
+}
+
+// fills results with up to maxResults records whose name is exactly name and
+// returns the total number of matches
+size_t findAllByName(Table *table, const char *name, void **results, size_t maxResults)
+{
+    if (table->codedField)
+    {
+        int code = dictionaryFind(&table->strings, name);
+        Posting *posting = code < 0 ? NULL : idIndexFind(&table->codeIndex.keys, code);
+        size_t count = !posting ? 0 : posting->count < maxResults ? posting->count : maxResults;
+        if (count)
+        {
+            memcpy(results, posting->records, count * sizeof(void *));
+        }
+        return posting ? posting->count : 0;
+    }
+    if (!table->nameExtract || !table->nameHashTable.buckets)
+    {
+        return 0;
+    }
+    unsigned int hash = stringHashFunction(name);
+    HashNode *current = table->nameHashTable.buckets[hash % table->nameHashTable.bucketCount];
+
+    size_t found = 0;
+    while (current)
+    {
+        if (current->hash == hash && strcmp(table->nameExtract(current->data), name) == 0)
+        {
+            if (found < maxResults)
+            {
+                results[found] = current->data;
+            }
+            found++;
+        }
+        current = current->next;
+    }
+    return found;
+}
+
+void *findByName(Table *table, const char *name)
+{
+    void *data = NULL;
+    findAllByName(table, name, &data, 1);
+    return data;
+}
+
+// case-insensitive search on the ordered name index for typeahead: names
+// starting with text, or equal to it when prefix is false, in name order
+size_t searchByName(Table *table, const char *text, bool prefix, void **results, size_t maxResults)
+{
+    if (!table->nameExtract)
+    {
+        return 0;
+    }
+    char folded[strlen(text) + 1];
+    foldName(text, folded);
+    return skipSearch(&table->nameOrder, folded, prefix, results, maxResults);
+}
+
+// copies the first matches out of the pointer array filled under the lock
+void copyMatches(Table *table, void **matches, size_t total, size_t maxRecords, void *records)
+{
+    size_t count = total < maxRecords ? total : maxRecords;
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy((char *)records + i * table->dataSize, matches[i], table->dataSize);
+    }
+}
+
+size_t tableFindByName(Table *table, const char *name, void *records, size_t maxRecords)
+{
+    unsigned long long start = nowNanos();
+    void **matches = malloc((maxRecords + 1) * sizeof(void *));
+    if (!matches)
+    {
+        return 0;
+    }
+    lockTableRead(table);
+    size_t total = findAllByName(table, name, matches, maxRecords);
+    copyMatches(table, matches, total, maxRecords, records);
+    unlockTable(table);
+    free(matches);
+    recordOperation(table, OpFindByName, start);
+    return total;
+}
+
+size_t tableSearchByName(Table *table, const char *text, bool prefix, void *records, size_t maxRecords)
+{
+    unsigned long long start = nowNanos();
+    void **matches = malloc((maxRecords + 1) * sizeof(void *));
+    if (!matches)
+    {
+        return 0;
+    }
+    lockTableRead(table);
+    size_t found = searchByName(table, text, prefix, matches, maxRecords);
+    copyMatches(table, matches, found, maxRecords, records);
+    unlockTable(table);
+    free(matches);
+    recordOperation(table, OpSearchByName, start);
+    return found;
+}
+
+size_t tableFindBySecondary(Table *table, int indexNumber, int key, void *records, size_t maxRecords)
+{
+    unsigned long long start = nowNanos();
+    if (indexNumber < 0 || indexNumber >= table->secondaryCount)
+    {
+        return 0;
+    }
+    void **matches = malloc((maxRecords + 1) * sizeof(void *));
+    if (!matches)
+    {
+        return 0;
+    }
+    lockTableRead(table);
+    size_t total = findAllBySecondary(table, indexNumber, key, matches, maxRecords);
+    copyMatches(table, matches, total, maxRecords, records);
+    unlockTable(table);
+    free(matches);
+    recordOperation(table, OpFindBySecondary, start);
+    return total;
+}
+
+Table *hotelTable(HotelTableId id)
+{
+    return id >= 0 && id < TableCount ? &tables[id] : NULL;
+}
+
+const char *tableName(const Table *table)
+{
+    return table->name;
+}
+
+size_t tableRecordSize(const Table *table)
+{
+    return table->dataSize;
+}
+
+int tableRecordId(const Table *table, const void *record)
+{
+    return table->idExtract((void *)record);
+}
+
+size_t tableRecordCount(Table *table)
+{
+    lockTableRead(table);
+    size_t count = table->idIndex.count + table->idIndex.oldCount;
+    unlockTable(table);
+    return count;
+}
+
+int tableSecondaryCount(const Table *table)
+{
+    return table->secondaryCount;
+}
+
+const char *tableSecondaryName(const Table *table, int indexNumber)
+{
+    return indexNumber >= 0 && indexNumber < table->secondaryCount ? table->secondary[indexNumber].name : NULL;
+}
+
+const char *hotelStatusText(HotelStatus status)
+{
+    switch (status)
+    {
+    case HotelOk:
+        return "ok";
+    case HotelNotFound:
+        return "record not found";
+    case HotelDuplicate:
+        return "id already exists";
+    case HotelInvalid:
+        return "invalid record";
+    case HotelNoMemory:
+        return "out of memory";
+    case HotelIoError:
+        return "could not write to disk";
+    case HotelConflict:
+        return "changed by another writer";
+    }
+    return "unknown status";
+}
+const char *extractCustomerName(void *data)
+{
+    return ((struct Customer *)data)->name;
+}
+int extractCustomerId(void *data)
+{
+    return ((struct Customer *)data)->customerID;
+}
+const char *extractRoomType(void *data)
+{
+    return ((struct Room *)data)->roomType;
+}
+
+int extractRoomTypeCode(void *data)
+{
+    return *recordCode(&tables[RoomTable], data);
+}
+
+int extractRoomId(void *data)
+{
+    return ((struct Room *)data)->roomID;
+}
+
+int extractReservationId(void *data)
+{
+    return ((struct Reservation *)data)->reservationID;
+}
+
+int extractReservationCustomerId(void *data)
+{
+    return ((struct Reservation *)data)->customerID;
+}
+
+int extractReservationRoomId(void *data)
+{
+    return ((struct Reservation *)data)->roomID;
+}
+
+int extractReservationCheckIn(void *data)
+{
+    return ((struct Reservation *)data)->checkInDay;
+}
+
+int extractReservationCheckOut(void *data)
+{
+    return ((struct Reservation *)data)->checkOutDay;
+}
+
+int extractAmenityRoomId(void *data)
+{
+    return ((struct Amenity *)data)->RoomID;
+}
+
+int extractAmenityAmenityId(void *data)
+{
+    return ((struct Amenity *)data)->AmenityID;
+}
+
+int extractAmenityTypeId(void *data)
+{
+    return ((struct Amenity_Type *)data)->AmenityID;
+}
+
+const char *extractAmenityTypeName(void *data)
+{
+    return ((struct Amenity_Type *)data)->AmenityName;
+}
+
+int extractAmenityTypeNameCode(void *data)
+{
+    return *recordCode(&tables[AmenityTypeTable], data);
+}
+
+int extractCustomerPlacesRoomId(void *data)
+{
+    return ((struct CUTSOMER_PLACES_ROOM *)data)->RoomID;
+}
+
+int extractCustomerPlacesRoomCustomerId(void *data)
+{
+    return ((struct CUTSOMER_PLACES_ROOM *)data)->customerID;
+}
+
+const Field customerFields[] = {
+    RecordField(FieldInt, struct Customer, customerID),
+    RecordField(FieldText, struct Customer, name),
+    RecordField(FieldText, struct Customer, email),
+    RecordField(FieldText, struct Customer, phone),
+    RecordField(FieldText, struct Customer, address),
+};
+
+const Field roomFields[] = {
+    RecordField(FieldInt, struct Room, roomID),
+    RecordField(FieldCoded, struct Room, roomType),
+    RecordField(FieldDouble, struct Room, price),
+    RecordField(FieldInt, struct Room, availability),
+};
+
+const Field reservationFields[] = {
+    RecordField(FieldInt, struct Reservation, reservationID),
+    RecordField(FieldInt, struct Reservation, checkInDay),
+    RecordField(FieldInt, struct Reservation, checkOutDay),
+    RecordField(FieldInt, struct Reservation, customerID),
+    RecordField(FieldInt, struct Reservation, roomID),
+};
+
+const Field amenityFields[] = {
+    RecordField(FieldInt, struct Amenity, RoomID),
+    RecordField(FieldInt, struct Amenity, AmenityID),
+};
+
+const Field amenityTypeFields[] = {
+    RecordField(FieldInt, struct Amenity_Type, AmenityID),
+    RecordField(FieldCoded, struct Amenity_Type, AmenityName),
+};
+
+const Field customerPlacesRoomFields[] = {
+    RecordField(FieldInt, struct CUTSOMER_PLACES_ROOM, customerID),
+    RecordField(FieldInt, struct CUTSOMER_PLACES_ROOM, RoomID),
+    RecordField(FieldText, struct CUTSOMER_PLACES_ROOM, phone),
+};
+
+#define FieldCount(fields) ((int)(sizeof(fields) / sizeof((fields)[0])))
+
+// bulk import: CSV rows carry the columns in struct order, binary files hold
+// records laid out exactly like the table's .dat file
+#define ImportMaxFields 8
+
+// splits a line in place on commas; a field may be wrapped in double quotes,
+// with "" standing for a quote inside it; returns the number of fields
+int splitCsvLine(char *line, char **fields, int maxFields)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+    int count = 0;
+    char *read = line;
+    while (count < maxFields)
+    {
+        char *write = read;
+        fields[count++] = write;
+        if (*read == '"')
+        {
+            read++;
+            while (*read && !(read[0] == '"' && read[1] != '"'))
+            {
+                if (*read == '"')
+                {
+                    read++;
+                }
+                *write++ = *read++;
+            }
+            if (*read == '"')
+            {
+                read++;
+            }
+        }
+        while (*read && *read != ',')
+        {
+            *write++ = *read++;
+        }
+        bool more = *read == ',';
+        *write = '\0';
+        if (!more)
+        {
+            return count;
+        }
+        read++;
+    }
+    return maxFields + 1;
+}
+
+bool csvInt(const char *text, int *value)
+{
+    char *end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < -2147483647L - 1 || parsed > 2147483647L)
+    {
+        return false;
+    }
+    *value = (int)parsed;
+    return true;
+}
+
+bool csvDouble(const char *text, double *value)
+{
+    char *end;
+    errno = 0;
+    *value = strtod(text, &end);
+    return end != text && *end == '\0' && errno != ERANGE;
+}
+
+// copies a text column, rejecting values that do not fit with their terminator
+bool csvText(char *field, size_t size, const char *text)
+{
+    size_t length = strlen(text);
+    if (length >= size)
+    {
+        return false;
+    }
+    memcpy(field, text, length + 1);
+    return true;
+}
+
+bool terminated(const char *field, size_t size)
+{
+    return memchr(field, '\0', size) != NULL;
+}
+
+bool parseCustomer(char **fields, int count, void *data)
+{
+    struct Customer *customer = (struct Customer *)data;
+    return count == 5 && csvInt(fields[0], &customer->customerID) &&
+           csvText(customer->name, sizeof(customer->name), fields[1]) &&
+           csvText(customer->email, sizeof(customer->email), fields[2]) &&
+           csvText(customer->phone, sizeof(customer->phone), fields[3]) &&
+           csvText(customer->address, sizeof(customer->address), fields[4]);
+}
+
+bool parseRoom(char **fields, int count, void *data)
+{
+    struct Room *room = (struct Room *)data;
+    return count == 4 && csvInt(fields[0], &room->roomID) &&
+           csvText(room->roomType, sizeof(room->roomType), fields[1]) &&
+           csvDouble(fields[2], &room->price) && csvInt(fields[3], &room->availability);
+}
+
+bool parseReservation(char **fields, int count, void *data)
+{
+    struct Reservation *reservation = (struct Reservation *)data;
+    return count == 5 && csvInt(fields[0], &reservation->reservationID) &&
+           parseDate(fields[1], &reservation->checkInDay) && parseDate(fields[2], &reservation->checkOutDay) &&
+           csvInt(fields[3], &reservation->customerID) && csvInt(fields[4], &reservation->roomID);
+}
+
+bool parseAmenity(char **fields, int count, void *data)
+{
+    struct Amenity *amenity = (struct Amenity *)data;
+    return count == 2 && csvInt(fields[0], &amenity->RoomID) && csvInt(fields[1], &amenity->AmenityID);
+}
+
+bool parseAmenityType(char **fields, int count, void *data)
+{
+    struct Amenity_Type *amenityType = (struct Amenity_Type *)data;
+    return count == 2 && csvInt(fields[0], &amenityType->AmenityID) &&
+           csvText(amenityType->AmenityName, sizeof(amenityType->AmenityName), fields[1]);
+}
+
+bool parseCustomerPlacesRoom(char **fields, int count, void *data)
+{
+    struct CUTSOMER_PLACES_ROOM *cpr = (struct CUTSOMER_PLACES_ROOM *)data;
+    return count == 3 && csvInt(fields[0], &cpr->customerID) && csvInt(fields[1], &cpr->RoomID) &&
+           csvText(cpr->phone, sizeof(cpr->phone), fields[2]);
+}
+
+bool validateCustomer(const void *data)
+{
+    const struct Customer *customer = data;
+    return terminated(customer->name, sizeof(customer->name)) &&
+           terminated(customer->email, sizeof(customer->email)) &&
+           terminated(customer->phone, sizeof(customer->phone)) &&
+           terminated(customer->address, sizeof(customer->address));
+}
+
+bool validateRoom(const void *data)
+{
+    const struct Room *room = data;
+    return terminated(room->roomType, sizeof(room->roomType)) && room->price >= 0 &&
+           (room->availability == 0 || room->availability == 1);
+}
+
+bool validateReservation(const void *data)
+{
+    const struct Reservation *reservation = data;
+    return reservation->checkOutDay > reservation->checkInDay;
+}
+
+bool validateAmenity(const void *data)
+{
+    (void)data;
+    return true;
+}
+
+bool validateAmenityType(const void *data)
+{
+    const struct Amenity_Type *amenityType = data;
+    return terminated(amenityType->AmenityName, sizeof(amenityType->AmenityName));
+}
+
+bool validateCustomerPlacesRoom(const void *data)
+{
+    const struct CUTSOMER_PLACES_ROOM *cpr = data;
+    return terminated(cpr->phone, sizeof(cpr->phone));
+}
+
+void rejectRow(ImportStats *stats, size_t row)
+{
+    if (stats->invalid < ImportBadRowsShown)
+    {
+        stats->rejected[stats->invalid] = row;
+    }
+    stats->invalid++;
+}
+
+// the rows of an import that passed validation, parsed before the table is
+// locked so the write lock only covers inserting them
+typedef struct
+{
+    char *records;
+    size_t count;
+    size_t capacity;
+} ImportStage;
+
+// keeps one parsed row unless it is malformed; false when out of memory
+bool stageRow(Table *table, ImportStage *stage, const void *record, size_t row, ImportStats *stats)
+{
+    stats->rows++;
+    if (!table->validateFunction(record))
+    {
+        rejectRow(stats, row);
+        return true;
+    }
+    if (stage->count == stage->capacity)
+    {
+        size_t capacity = stage->capacity ? stage->capacity * 2 : 1024;
+        char *records = realloc(stage->records, capacity * table->dataSize);
+        if (!records)
+        {
+            return false;
+        }
+        stage->records = records;
+        stage->capacity = capacity;
+    }
+    memcpy(stage->records + stage->count++ * table->dataSize, record, table->dataSize);
+    return true;
+}
+
+// adds the staged rows under one write lock, skipping those whose id is
+// already taken, either by an existing record or by an earlier row
+bool insertStaged(Table *table, const ImportStage *stage, ImportStats *stats)
+{
+    bool ok = true;
+    lockTable(table);
+    table->bulkLoad = true;
+    idIndexReserve(&table->idIndex, table->idIndex.count + stage->count);
+    for (size_t i = 0; i < stage->count && ok; i++)
+    {
+        void *record = stage->records + i * table->dataSize;
+        if (findById(table, table->idExtract(record)))
+        {
+            stats->duplicates++;
+            continue;
+        }
+        ok = addRecord(table, record) != NULL;
+        stats->imported += ok;
+    }
+    ok = finishBulkLoad(table) && ok;
+    unlockTable(table);
+    return ok;
+}
+
+// loads a CSV or binary file into the table: rows are parsed and validated
+// without the lock, then go straight into the pools under one write lock
+// without logging, the ordered indexes are built once at the end and the
+// .dat file is rewritten a single time
+HotelStatus importTable(Table *table, const char *path, bool binary, ImportStats *stats)
+{
+    *stats = (ImportStats){0};
+    FILE *file = fopen(path, "rb");
+    void *record = malloc(table->dataSize);
+    if (!file || !record)
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+        free(record);
+        return file ? HotelNoMemory : HotelIoError;
+    }
+
+    unsigned long long start = nowNanos();
+    ImportStage stage = {0};
+    HotelStatus status = HotelOk;
+    bool ok = true;
+    if (binary)
+    {
+        while (ok && fread(record, table->dataSize, 1, file) == 1)
+        {
+            ok = stageRow(table, &stage, record, stats->rows + 1, stats);
+        }
+    }
+    else
+    {
+        char *line = NULL;
+        size_t capacity = 0;
+        size_t lineNumber = 0;
+        char *fields[ImportMaxFields];
+        while (ok && getline(&line, &capacity, file) != -1)
+        {
+            lineNumber++;
+            if (line[strspn(line, " \t\r\n")] == '\0')
+            {
+                continue;
+            }
+            memset(record, 0, table->dataSize);
+            int count = splitCsvLine(line, fields, ImportMaxFields);
+            if (!table->parseFunction(fields, count, record))
+            {
+                // a first line that does not start with a number is a header
+                if (lineNumber == 1 && !isdigit((unsigned char)fields[0][0]) && fields[0][0] != '-')
+                {
+                    continue;
+                }
+                stats->rows++;
+                rejectRow(stats, lineNumber);
+                continue;
+            }
+            ok = stageRow(table, &stage, record, lineNumber, stats);
+        }
+        free(line);
+    }
+    if (ferror(file))
+    {
+        status = HotelIoError;
+    }
+    else if (!ok || !insertStaged(table, &stage, stats))
+    {
+        status = HotelNoMemory;
+    }
+    free(stage.records);
+
+    if (stats->imported > 0 && !checkpointTable(table))
+    {
+        status = HotelIoError;
+    }
+
+    stats->seconds = (nowNanos() - start) / 1e9;
+    recordOperation(table, OpImport, start);
+    free(record);
+    fclose(file);
+    return status;
+}
+
+// availability search over every room, split across threads for large inventories
+#define AvailabilityChunk 4096
+#define MaxAvailabilityThreads 16
+
+// one thread per chunk of items, at most one per online cpu and at most max
+size_t workerThreads(size_t items, size_t chunk, size_t max)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = items / chunk + 1;
+    if (cpus > 0 && threads > (size_t)cpus)
+    {
+        threads = (size_t)cpus;
+    }
+    return threads < max ? threads : max;
+}
+
+typedef struct
+{
+    Table *reservations;
+    const int *roomIds;
+    size_t begin;
+    size_t end;
+    int fromDay;
+    int toDay;
+    bool *available;
+} AvailabilityTask;
+
+void *checkAvailability(void *arg)
+{
+    AvailabilityTask *task = (AvailabilityTask *)arg;
+    for (size_t i = task->begin; i < task->end; i++)
+    {
+        task->available[i] = !intervalOverlaps(&task->reservations->intervalIndex, task->roomIds[i],
+                                               task->fromDay, task->toDay);
+    }
+    return NULL;
+}
+
+// fills roomIds with up to maxRooms rooms that have no reservation overlapping
+// [fromDay, toDay) and returns how many rooms are available in total
+size_t findAvailableRooms(int fromDay, int toDay, int *roomIds, size_t maxRooms)
+{
+    Table *rooms = &tables[RoomTable];
+    Table *reservations = &tables[ReservationTable];
+
+    lockTableRead(rooms);
+    size_t count = rooms->idIndex.count + rooms->idIndex.oldCount;
+    int *ids = malloc((count + 1) * sizeof(int));
+    bool *available = malloc(count + 1);
+    if (!ids || !available)
+    {
+        unlockTable(rooms);
+        free(ids);
+        free(available);
+        return 0;
+    }
+    count = 0;
+    for (Node *current = rooms->head; current; current = current->next)
+    {
+        ids[count++] = rooms->idExtract(current->data);
+    }
+    unlockTable(rooms);
+
+    size_t threads = workerThreads(count, AvailabilityChunk, MaxAvailabilityThreads);
+
+    AvailabilityTask tasks[MaxAvailabilityThreads];
+    pthread_t handles[MaxAvailabilityThreads];
+    bool started[MaxAvailabilityThreads] = {false};
+
+    lockTableRead(reservations);
+    for (size_t t = 0; t < threads; t++)
+    {
+        tasks[t] = (AvailabilityTask){
+            .reservations = reservations,
+            .roomIds = ids,
+            .begin = count * t / threads,
+            .end = count * (t + 1) / threads,
+            .fromDay = fromDay,
+            .toDay = toDay,
+            .available = available,
+        };
+        if (t > 0)
+        {
+            started[t] = pthread_create(&handles[t], NULL, checkAvailability, &tasks[t]) == 0;
+        }
+    }
+    checkAvailability(&tasks[0]);
+    for (size_t t = 1; t < threads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(handles[t], NULL);
+        }
+        else
+        {
+            checkAvailability(&tasks[t]);
+        }
+    }
+    unlockTable(reservations);
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (available[i])
+        {
+            if (total < maxRooms)
+            {
+                roomIds[total] = ids[i];
+            }
+            total++;
+        }
+    }
+    free(ids);
+    free(available);
+    return total;
+}
+
+HotelStatus enableRoomColumns()
+{
+    Table *rooms = &tables[RoomTable];
+    HotelStatus status = HotelOk;
+    lockTable(rooms);
+    if (!rooms->roomColumns)
+    {
+        RoomColumns *columns = calloc(1, sizeof(RoomColumns));
+        if (columns)
+        {
+            columns->typeNames = &rooms->strings;
+        }
+        Node *current = rooms->head;
+        while (columns && current && roomColumnsAdd(columns, current->data, *recordCode(rooms, current->data)))
+        {
+            current = current->next;
+        }
+        if (!columns || current)
+        {
+            roomColumnsFree(columns);
+            status = HotelNoMemory;
+        }
+        else
+        {
+            rooms->roomColumns = columns;
+        }
+    }
+    unlockTable(rooms);
+    return status;
+}
+
+size_t findRooms(const RoomFilter *filter, int *roomIds, size_t maxRooms)
+{
+    Table *rooms = &tables[RoomTable];
+    unsigned long long start = nowNanos();
+    size_t total = 0;
+    lockTableRead(rooms);
+    if (rooms->roomColumns)
+    {
+        total = roomColumnsFilter(rooms->roomColumns, filter, roomIds, maxRooms);
+    }
+    else
+    {
+        // a type nobody has matches no room
+        int type = filter->roomType ? dictionaryFind(&rooms->strings, filter->roomType) : -1;
+        for (Node *current = filter->roomType && type < 0 ? NULL : rooms->head; current; current = current->next)
+        {
+            const struct Room *room = current->data;
+            if (room->price >= filter->minPrice && room->price <= filter->maxPrice &&
+                (filter->availability < 0 || room->availability == filter->availability) &&
+                (type < 0 || *recordCode(rooms, room) == type))
+            {
+                if (total < maxRooms)
+                {
+                    roomIds[total] = room->roomID;
+                }
+                total++;
+            }
+        }
+    }
+    unlockTable(rooms);
+    recordOperation(rooms, OpScan, start);
+    return total;
+}
+
+// query engine: the first query table drives the join and every later table
+// is joined to a column of an earlier one. filters run as each table is read,
+// joins on an id or secondary index column look rows up directly, any other
+// column gets a hash table built over the filtered table. driving rows are
+// probed in parallel and matches are handed to the visitor in batches
+#define QueryChunk 4096
+#define MaxQueryThreads 16
+#define QueryBatchRows 256
+
+typedef enum
+{
+    JoinById,
+    JoinBySecondary,
+    JoinByHash
+} JoinMethod;
+
+// build side of a hash join: open addressing that keeps duplicate keys
+typedef struct
+{
+    int *keys;
+    void **records;
+    size_t capacity;
+} JoinHashTable;
+
+typedef struct
+{
+    Table *table;
+    const Field *column;
+    // query table and column this one is joined to
+    int other;
+    const Field *otherColumn;
+    RecordFilter filter;
+    void *filterContext;
+    JoinMethod method;
+    SecondaryIndex *secondary;
+    JoinHashTable hash;
+} JoinStep;
+
+typedef struct
+{
+    JoinStep steps[QueryMaxTables];
+    int stepCount;
+    void **driving;
+    QueryVisitor visit;
+    void *context;
+    // serializes the visitor and stops every thread once it returns false
+    pthread_mutex_t emitMutex;
+    atomic_bool stopped;
+} QueryPlan;
+
+typedef struct
+{
+    QueryPlan *plan;
+    size_t begin;
+    size_t end;
+    const void *row[QueryMaxTables];
+    const void *batch[QueryBatchRows * QueryMaxTables];
+    size_t batchRows;
+} QueryTask;
+
+int columnValue(const Field *column, const void *record)
+{
+    int value;
+    memcpy(&value, (const char *)record + column->offset, sizeof(value));
+    return value;
+}
+
+// integer field of the table with the given name
+const Field *findColumn(const Table *table, const char *name)
+{
+    for (int i = 0; name && i < table->fieldCount; i++)
+    {
+        if (table->fields[i].type == FieldInt && strcmp(table->fields[i].name, name) == 0)
+        {
+            return &table->fields[i];
+        }
+    }
+    return NULL;
+}
+
+bool passesFilter(const JoinStep *step, const void *record)
+{
+    return !step->filter || step->filter(record, step->filterContext);
+}
+
+bool joinHashBuild(JoinStep *step)
+{
+    size_t count = step->table->idIndex.count + step->table->idIndex.oldCount;
+    size_t capacity = IdIndexMinCapacity;
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+    }
+    JoinHashTable *hash = &step->hash;
+    hash->keys = malloc(capacity * sizeof(int));
+    hash->records = calloc(capacity, sizeof(void *));
+    hash->capacity = capacity;
+    if (!hash->keys || !hash->records)
+    {
+        return false;
+    }
+    size_t mask = capacity - 1;
+    for (Node *current = step->table->head; current; current = current->next)
+    {
+        if (!passesFilter(step, current->data))
+        {
+            continue;
+        }
+        int key = columnValue(step->column, current->data);
+        size_t i = idIndexHash(key) & mask;
+        while (hash->records[i])
+        {
+            i = (i + 1) & mask;
+        }
+        hash->keys[i] = key;
+        hash->records[i] = current->data;
+    }
+    return true;
+}
+
+void queryFlush(QueryTask *task)
+{
+    QueryPlan *plan = task->plan;
+    pthread_mutex_lock(&plan->emitMutex);
+    for (size_t i = 0; i < task->batchRows && !atomic_load(&plan->stopped); i++)
+    {
+        if (!plan->visit(&task->batch[i * QueryMaxTables], plan->context))
+        {
+            atomic_store(&plan->stopped, true);
+        }
+    }
+    pthread_mutex_unlock(&plan->emitMutex);
+    task->batchRows = 0;
+}
+
+void queryEmit(QueryTask *task)
+{
+    memcpy(&task->batch[task->batchRows * QueryMaxTables], task->row, sizeof(task->row));
+    if (++task->batchRows == QueryBatchRows)
+    {
+        queryFlush(task);
+    }
+}
+
+// extends the partial row with every match of step level onwards
+void queryJoin(QueryTask *task, int level)
+{
+    QueryPlan *plan = task->plan;
+    if (level == plan->stepCount)
+    {
+        queryEmit(task);
+        return;
+    }
+
+    JoinStep *step = &plan->steps[level];
+    int key = columnValue(step->otherColumn, task->row[step->other]);
+    if (step->method == JoinById)
+    {
+        void *record = findById(step->table, key);
+        if (record && passesFilter(step, record))
+        {
+            task->row[level] = record;
+            queryJoin(task, level + 1);
+        }
+    }
+    else if (step->method == JoinBySecondary)
+    {
+        Posting *posting = idIndexFind(&step->secondary->keys, key);
+        for (size_t i = 0; posting && i < posting->count; i++)
+        {
+            if (passesFilter(step, posting->records[i]))
+            {
+                task->row[level] = posting->records[i];
+                queryJoin(task, level + 1);
+            }
+        }
+    }
+    else
+    {
+        JoinHashTable *hash = &step->hash;
+        size_t mask = hash->capacity - 1;
+        for (size_t i = idIndexHash(key) & mask; hash->records[i]; i = (i + 1) & mask)
+        {
+            if (hash->keys[i] == key)
+            {
+                task->row[level] = hash->records[i];
+                queryJoin(task, level + 1);
+            }
+        }
+    }
+}
+
+void *queryProbe(void *arg)
+{
+    QueryTask *task = (QueryTask *)arg;
+    for (size_t i = task->begin; i < task->end && !atomic_load(&task->plan->stopped); i++)
+    {
+        task->row[0] = task->plan->driving[i];
+        queryJoin(task, 1);
+    }
+    queryFlush(task);
+    return NULL;
+}
+
+// resolves column names and picks each join's method; false if the query is malformed
+bool planQuery(const Query *query, QueryPlan *plan)
+{
+    if (query->tableCount < 1 || query->tableCount > QueryMaxTables)
+    {
+        return false;
+    }
+    plan->stepCount = query->tableCount;
+    for (int i = 0; i < query->tableCount; i++)
+    {
+        const QueryTable *source = &query->tables[i];
+        JoinStep *step = &plan->steps[i];
+        if (source->table < 0 || source->table >= TableCount)
+        {
+            return false;
+        }
+        *step = (JoinStep){
+            .table = &tables[source->table],
+            .filter = source->filter,
+            .filterContext = source->filterContext,
+        };
+        if (i == 0)
+        {
+            continue;
+        }
+        if (source->other < 0 || source->other >= i)
+        {
+            return false;
+        }
+        step->other = source->other;
+        step->column = findColumn(step->table, source->column);
+        step->otherColumn = findColumn(plan->steps[source->other].table, source->otherColumn);
+        if (!step->column || !step->otherColumn)
+        {
+            return false;
+        }
+
+        step->method = JoinByHash;
+        if (strcmp(step->column->name, step->table->idColumn) == 0)
+        {
+            step->method = JoinById;
+        }
+        for (int j = 0; j < step->table->secondaryCount && step->method == JoinByHash; j++)
+        {
+            if (strcmp(step->column->name, step->table->secondary[j].column) == 0)
+            {
+                step->method = JoinBySecondary;
+                step->secondary = &step->table->secondary[j];
+            }
+        }
+    }
+    return true;
+}
+
+HotelStatus runQuery(const Query *query, QueryVisitor visit, void *context)
+{
+    unsigned long long start = nowNanos();
+    QueryPlan *plan = calloc(1, sizeof(QueryPlan));
+    if (!plan)
+    {
+        return HotelNoMemory;
+    }
+    if (!planQuery(query, plan))
+    {
+        free(plan);
+        return HotelInvalid;
+    }
+    plan->visit = visit;
+    plan->context = context;
+    pthread_mutex_init(&plan->emitMutex, NULL);
+
+    // read locks in table order, each table once, so queries and writers
+    // touching several tables cannot deadlock
+    bool locked[TableCount] = {false};
+    for (int i = 0; i < plan->stepCount; i++)
+    {
+        locked[plan->steps[i].table - tables] = true;
+    }
+    for (int i = 0; i < TableCount; i++)
+    {
+        if (locked[i])
+        {
+            lockTableRead(&tables[i]);
+        }
+    }
+
+    HotelStatus status = HotelOk;
+    for (int i = 1; i < plan->stepCount; i++)
+    {
+        if (plan->steps[i].method == JoinByHash && !joinHashBuild(&plan->steps[i]))
+        {
+            status = HotelNoMemory;
+        }
+    }
+
+    JoinStep *driver = &plan->steps[0];
+    size_t count = 0;
+    plan->driving = malloc((driver->table->idIndex.count + driver->table->idIndex.oldCount + 1) * sizeof(void *));
+    if (!plan->driving)
+    {
+        status = HotelNoMemory;
+    }
+    for (Node *current = driver->table->head; current && status == HotelOk; current = current->next)
+    {
+        if (passesFilter(driver, current->data))
+        {
+            plan->driving[count++] = current->data;
+        }
+    }
+
+    size_t threads = status == HotelOk ? workerThreads(count, QueryChunk, MaxQueryThreads) : 0;
+    QueryTask *tasks = calloc(threads + 1, sizeof(QueryTask));
+    pthread_t handles[MaxQueryThreads];
+    bool started[MaxQueryThreads] = {false};
+    if (!tasks)
+    {
+        status = HotelNoMemory;
+        threads = 0;
+    }
+    for (size_t t = 0; t < threads; t++)
+    {
+        tasks[t].plan = plan;
+        tasks[t].begin = count * t / threads;
+        tasks[t].end = count * (t + 1) / threads;
+        if (t > 0)
+        {
+            started[t] = pthread_create(&handles[t], NULL, queryProbe, &tasks[t]) == 0;
+        }
+    }
+    if (threads > 0)
+    {
+        queryProbe(&tasks[0]);
+    }
+    for (size_t t = 1; t < threads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(handles[t], NULL);
+        }
+        else
+        {
+            queryProbe(&tasks[t]);
+        }
+    }
+
+    for (int i = TableCount - 1; i >= 0; i--)
+    {
+        if (locked[i])
+        {
+            unlockTable(&tables[i]);
+        }
+    }
+    for (int i = 1; i < plan->stepCount; i++)
+    {
+        free(plan->steps[i].hash.keys);
+        free(plan->steps[i].hash.records);
+    }
+    free(tasks);
+    free(plan->driving);
+    pthread_mutex_destroy(&plan->emitMutex);
+    recordOperation(driver->table, OpQuery, start);
+    free(plan);
+    return status;
+}
+
+// Initialize tables
+
+// true if the base file starts with the block format header; files without
+// one hold raw records as older versions wrote them
+bool isBlockFile(const char *filename)
+{
+    char magic[4];
+    FILE *file = fopen(filename, "rb");
+    bool block = file && fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, BaseFileMagic, 4) == 0;
+    if (file)
+    {
+        fclose(file);
+    }
+    return block;
+}
+
+// startup runs every table on its own thread; within a table, blocks are
+// checksummed and decoded in chunks on several threads, then the id index
+// is filled in one pass and every other index is built on its own thread
+#define LoadChunkBlocks 16
+#define LoadChunkRecords 65536
+#define MaxLoadThreads 16
+
+// runs work on each of count items, spread over up to threads threads
+// including the caller; an item whose thread cannot start runs on the caller
+void runTasks(void *(*work)(void *), void *items, size_t itemSize, size_t count, size_t threads)
+{
+    pthread_t handles[MaxLoadThreads];
+    bool started[MaxLoadThreads] = {false};
+    if (threads > count)
+    {
+        threads = count;
+    }
+    if (threads > MaxLoadThreads)
+    {
+        threads = MaxLoadThreads;
+    }
+    for (size_t i = 1; i < threads; i++)
+    {
+        started[i] = pthread_create(&handles[i], NULL, work, (char *)items + i * itemSize) == 0;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i == 0 || i >= threads || !started[i])
+        {
+            work((char *)items + i * itemSize);
+        }
+    }
+    for (size_t i = 1; i < threads; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(handles[i], NULL);
+        }
+    }
+}
+
+typedef struct
+{
+    const unsigned char *payload;
+    BaseBlockHeader header;
+    // position of the block's first record in the load order
+    size_t first;
+    // page the block was read from, paged files only
+    uint32_t page;
+    // failed its checksum or did not decode
+    bool failed;
+} LoadBlock;
+
+typedef struct
+{
+    Table *table;
+    LoadBlock *blocks;
+    size_t begin;
+    size_t end;
+    void **records;
+    // the file's dictionary, NULL for files without one
+    const Dictionary *codes;
+} DecodeTask;
+
+void *decodeBlocks(void *arg)
+{
+    DecodeTask *task = (DecodeTask *)arg;
+    for (size_t b = task->begin; b < task->end; b++)
+    {
+        LoadBlock *block = &task->blocks[b];
+        const unsigned char *in = block->payload;
+        const unsigned char *end = in + block->header.length;
+        bool ok = block->header.checksum == fnv1a(2166136261u, in, block->header.length);
+        for (unsigned int i = 0; ok && i < block->header.records; i++)
+        {
+            in = decodeRecord(task->table, in, end, task->codes, task->records[block->first + i]);
+            ok = in != NULL;
+        }
+        block->failed = !ok || in != end;
+    }
+    return NULL;
+}
+
+typedef enum
+{
+    BuildNames,
+    BuildSecondary,
+    BuildInterval
+} IndexBuild;
+
+typedef struct
+{
+    Table *table;
+    IndexBuild build;
+    int secondary;
+    void **records;
+    size_t count;
+    bool ok;
+} IndexTask;
+
+// fills one index of a bulk loaded table; each task owns its index outright
+void *buildIndex(void *arg)
+{
+    IndexTask *task = (IndexTask *)arg;
+    Table *table = task->table;
+    task->ok = true;
+    for (size_t i = 0; i < task->count && task->ok; i++)
+    {
+        if (task->build == BuildNames)
+        {
+            task->ok = addNameNode(table, task->records[i]);
+        }
+        else if (task->build == BuildSecondary)
+        {
+            task->ok = secondaryAdd(&table->secondary[task->secondary], task->records[i]);
+        }
+        else
+        {
+            task->ok = intervalAdd(&table->intervalIndex, task->records[i], true);
+        }
+    }
+    if (task->ok && task->build == BuildNames)
+    {
+        task->ok = rebuildNameOrder(table);
+    }
+    else if (task->ok && task->build == BuildInterval)
+    {
+        intervalSort(&table->intervalIndex);
+    }
+    return NULL;
+}
+
+// links decoded records in and indexes them; records with an id seen before
+// are dropped as the serial loaders always did. with keepPages every record
+// goes back on the page its node names, otherwise each is placed afresh
+bool indexLoadedRecords(Table *table, void **records, size_t count, bool keepPages)
+{
+    bool ok = idIndexReserve(&table->idIndex, table->idIndex.count + count);
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        void *data = records[i];
+        int id = table->idExtract(data);
+        if (!ok || findById(table, id) || !holdCode(table, data))
+        {
+            freeRecord(table, data);
+            continue;
+        }
+        if (!idIndexInsert(&table->idIndex, id, data))
+        {
+            uncodeRecord(table, data);
+            freeRecord(table, data);
+            continue;
+        }
+        linkNode(table, recordNode(data));
+        records[kept++] = data;
+    }
+    // codes the file listed for records that were dropped
+    for (size_t code = 0; code < table->strings.count; code++)
+    {
+        if (table->strings.names[code] && table->strings.refs[code] == 0)
+        {
+            releaseCode(table, (int)code);
+        }
+    }
+    for (size_t i = 0; i < kept && ok; i++)
+    {
+        ok = keepPages ? pageAppend(table, records[i], recordNode(records[i])->page) : pageReserve(table);
+        if (ok && !keepPages)
+        {
+            pagePlace(table, records[i]);
+        }
+    }
+
+    IndexTask tasks[MaxSecondaryIndexes + 2];
+    size_t taskCount = 0;
+    if (table->nameExtract)
+    {
+        tasks[taskCount++] = (IndexTask){.build = BuildNames};
+    }
+    for (int j = 0; j < table->secondaryCount; j++)
+    {
+        tasks[taskCount++] = (IndexTask){.build = BuildSecondary, .secondary = j};
+    }
+    if (table->intervalIndex.keyExtract)
+    {
+        tasks[taskCount++] = (IndexTask){.build = BuildInterval};
+    }
+    for (size_t t = 0; t < taskCount; t++)
+    {
+        tasks[t].table = table;
+        tasks[t].records = records;
+        tasks[t].count = kept;
+    }
+    runTasks(buildIndex, tasks, sizeof(IndexTask), taskCount, workerThreads(kept, LoadChunkRecords, taskCount));
+    for (size_t t = 0; t < taskCount; t++)
+    {
+        ok = ok && tasks[t].ok;
+    }
+    table->bulkLoad = false;
+    return ok;
+}
+
+// reads the dictionary block of the header page; its strings must come out
+// numbered as they were written. dense files have no free codes
+bool loadDictionary(Table *table, const unsigned char *file, size_t length, bool dense)
+{
+    BaseBlockHeader block;
+    if (length < sizeof(BaseFileHeader) + sizeof(block))
+    {
+        return false;
+    }
+    memcpy(&block, file + sizeof(BaseFileHeader), sizeof(block));
+    const unsigned char *in = file + sizeof(BaseFileHeader) + sizeof(block);
+    const unsigned char *end = in + block.length;
+    if (block.length > DictionaryPayload || block.checksum != fnv1a(2166136261u, in, block.length) ||
+        (block.records > 0 && !table->codedField))
+    {
+        return false;
+    }
+    char value[BasePageBytes];
+    bool ok = true;
+    for (unsigned int code = 0; code < block.records && ok; code++)
+    {
+        unsigned int size;
+        in = getVarint(in, end, &size);
+        bool unused = !dense && in && size == 0;
+        size -= !dense && !unused;
+        ok = in && size < table->codedField->size && size <= (size_t)(end - in);
+        if (ok)
+        {
+            memcpy(value, in, size);
+            value[size] = '\0';
+            in += size;
+            ok = (unused || dictionaryFind(&table->strings, value) < 0) &&
+                 dictionaryAdd(&table->strings, unused ? NULL : value, false) == (int)code;
+        }
+        table->codeBytes += ok ? codeEntrySize(table->strings.names[code]) : 0;
+    }
+    if (!ok || in != end || table->codeBytes > DictionaryPayload)
+    {
+        dictionaryFree(&table->strings);
+        table->codeBytes = 0;
+        return false;
+    }
+    table->codesInFile = block.records;
+    return true;
+}
+
+// loads a block format base file. pages that fail their checksum or are cut
+// short lose their records and the rest load; in version 1 files nothing
+// after such a block can be found. damaged counts the records the header
+// promised but were not read. a damaged file is kept aside as
+// <name>.damaged before a checkpoint replaces it
+HotelStatus loadTableBlocks(Table *table, size_t *damaged)
+{
+    *damaged = 0;
+    int fd = open(table->filename, O_RDONLY);
+    if (fd < 0)
+    {
+        // nothing to build the ordered indexes from
+        table->bulkLoad = false;
+        table->rewriteBase = true;
+        return HotelOk;
+    }
+    struct stat st;
+    size_t length = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    unsigned char *file = length ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    BaseFileHeader header = {0};
+    bool readable = file != MAP_FAILED && length >= sizeof(header);
+    if (readable)
+    {
+        madvise(file, length, MADV_SEQUENTIAL);
+        memcpy(&header, file, sizeof(header));
+        readable = header.checksum == baseHeaderChecksum(header) && header.version >= BaseBlockFileVersion &&
+                   header.version <= BaseFileVersion && header.recordSize == table->dataSize &&
+                   header.fieldCount == (uint32_t)table->fieldCount;
+    }
+    bool paged = readable && header.version >= BaseTextPagesVersion;
+    bool coded = readable && header.version >= BaseDenseCodesVersion;
+    readable = readable && (!coded || loadDictionary(table, file, length, header.version == BaseDenseCodesVersion));
+    size_t pageCount = paged && length >= BasePageBytes ? length / BasePageBytes - 1 : 0;
+
+    // block boundaries come from the headers alone, so chunks can be decoded
+    // independently; a paged file has one block at the start of every page
+    size_t blockCount = 0, capacity = 0, total = 0;
+    LoadBlock *blocks = NULL;
+    bool memory = true, broken = false;
+    size_t offset = sizeof(header);
+    for (size_t p = 0; readable && memory && (paged ? p < pageCount : total < header.recordCount); p++)
+    {
+        BaseBlockHeader block;
+        offset = paged ? (p + 1) * BasePageBytes : offset;
+        if (offset + sizeof(block) > length)
+        {
+            break;
+        }
+        memcpy(&block, file + offset, sizeof(block));
+        offset += sizeof(block);
+        if (paged && block.records == 0 && block.length == 0)
+        {
+            // an empty page, or one never written
+            continue;
+        }
+        if (paged ? block.length > PagePayload || block.records > block.length
+                  : block.length > length - offset || block.records > header.recordCount - total)
+        {
+            broken = true;
+            if (!paged)
+            {
+                break;
+            }
+            continue;
+        }
+        if (blockCount == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            LoadBlock *grown = realloc(blocks, capacity * sizeof(LoadBlock));
+            memory = grown != NULL;
+            blocks = grown ? grown : blocks;
+        }
+        if (memory)
+        {
+            blocks[blockCount++] = (LoadBlock){
+                .payload = file + offset,
+                .header = block,
+                .first = total,
+                .page = (uint32_t)p,
+            };
+            offset += block.length;
+            total += block.records;
+        }
+    }
+    // records of older files are packed onto fresh pages
+    while (coded && memory && table->pageCount < pageCount)
+    {
+        memory = addPage(table);
+    }
+
+    void **records = readable && memory ? malloc((total + 1) * sizeof(void *)) : NULL;
+    size_t allocated = 0;
+    while (records && allocated < total && (records[allocated] = allocRecord(table)))
+    {
+        allocated++;
+    }
+    memory = memory && (!readable || (records && allocated == total));
+
+    // records of failed blocks are freed, the rest close up in load order
+    size_t loaded = 0;
+    if (readable && memory)
+    {
+        size_t threads = workerThreads(blockCount, LoadChunkBlocks, MaxLoadThreads);
+        DecodeTask tasks[MaxLoadThreads];
+        for (size_t t = 0; t < threads; t++)
+        {
+            tasks[t] = (DecodeTask){
+                .table = table,
+                .blocks = blocks,
+                .begin = blockCount * t / threads,
+                .end = blockCount * (t + 1) / threads,
+                .records = records,
+                .codes = coded ? &table->strings : NULL,
+            };
+        }
+        runTasks(decodeBlocks, tasks, sizeof(DecodeTask), threads, threads);
+        bool dropRest = false;
+        for (size_t b = 0; b < blockCount; b++)
+        {
+            broken = broken || blocks[b].failed;
+            // version 1 blocks after a failed one are dropped as well
+            dropRest = dropRest || (!paged && blocks[b].failed);
+            bool keep = !blocks[b].failed && !dropRest;
+            for (size_t i = blocks[b].first; i < blocks[b].first + blocks[b].header.records; i++)
+            {
+                if (keep)
+                {
+                    recordNode(records[i])->page = blocks[b].page;
+                    records[loaded++] = records[i];
+                }
+                else
+                {
+                    freeRecord(table, records[i]);
+                }
+            }
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < allocated; i++)
+        {
+            freeRecord(table, records[i]);
+        }
+    }
+    memory = memory && indexLoadedRecords(table, records, loaded, coded);
+
+    // pages whose records were dropped as duplicates differ from the file
+    for (size_t b = 0; coded && memory && b < blockCount; b++)
+    {
+        if (!blocks[b].failed && table->pages[blocks[b].page].count != blocks[b].header.records)
+        {
+            markPageDirty(table, blocks[b].page);
+        }
+    }
+    for (size_t p = 0; coded && p < table->pageCount; p++)
+    {
+        table->pages[p].listed = pageHasRoom(table, &table->pages[p]);
+        if (table->pages[p].listed)
+        {
+            table->freePages[table->freePageCount++] = (uint32_t)p;
+        }
+    }
+    free(records);
+    free(blocks);
+    if (file != MAP_FAILED)
+    {
+        munmap(file, length);
+    }
+
+    HotelStatus status = memory ? HotelOk : HotelNoMemory;
+    bool damagedFile = loaded < header.recordCount || broken || !readable;
+    if (damagedFile)
+    {
+        *damaged = loaded < header.recordCount ? header.recordCount - loaded : 0;
+        char damagedName[256];
+        snprintf(damagedName, sizeof(damagedName), "%s.damaged", table->filename);
+        remove(damagedName);
+        link(table->filename, damagedName);
+        status = status == HotelOk ? HotelIoError : status;
+    }
+    table->baseGeneration = readable ? header.generation : 0;
+    table->rewriteBase = !coded || damagedFile || !memory;
+    return status;
+}
+
+// loads a base file in the raw record layout of older versions
+void loadTableStream(Table *table)
+{
+    FILE *file = fopen(table->filename, "rb");
+    if (file)
+    {
+        void *data = malloc(table->dataSize);
+        while (data && fread(data, table->dataSize, 1, file) == 1)
+        {
+            if (!findById(table, table->idExtract(data)))
+            {
+                addRecord(table, data);
+            }
+        }
+        free(data);
+        fclose(file);
+    }
+}
+
+typedef struct
+{
+    Table *table;
+    HotelOpenReport *report;
+    int index;
+    HotelStatus status;
+} OpenTask;
+
+// retrieve data from the base file, then replay whatever the log holds on top
+void *openTable(void *arg)
+{
+    OpenTask *task = (OpenTask *)arg;
+    Table *table = task->table;
+    task->status = HotelOk;
+    table->bulkLoad = true;
+    if (!replayPageJournal(table))
+    {
+        task->status = HotelIoError;
+    }
+    bool legacy = access(table->filename, F_OK) == 0 && !isBlockFile(table->filename);
+    if (legacy)
+    {
+        table->rewriteBase = true;
+        loadTableStream(table);
+        if (!finishBulkLoad(table))
+        {
+            task->status = HotelNoMemory;
+        }
+    }
+    else
+    {
+        HotelStatus status = loadTableBlocks(table, &task->report->damaged[task->index]);
+        task->status = status != HotelOk ? status : task->status;
+    }
+
+    if (!walReplay(table, &task->report->recovered[task->index]))
+    {
+        task->status = HotelIoError;
+    }
+    table->wal.fd = open(table->logFilename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (table->wal.fd < 0)
+    {
+        // changes are still applied in memory, every commit reports HotelIoError
+        task->status = HotelIoError;
+    }
+    // rewrite files in an older layout right away
+    if (task->report->recovered[task->index] > 0 || (table->rewriteBase && access(table->filename, F_OK) == 0))
+    {
+        backupTable(table);
+    }
+    return NULL;
+}
+
+// converts a reservation.dat/.log pair written with string dates into the
+// packed reservations.dat and keeps the old files aside as *.legacy
+bool migrateLegacyReservations(HotelOpenReport *report)
+{
+    if (access("reservations.dat", F_OK) == 0 ||
+        (access("reservation.dat", F_OK) != 0 && access("reservation.log", F_OK) != 0))
+    {
+        return true;
+    }
+
+    // reservationID leads both layouts, so the current extractor reads either
+    Table legacy = {
+        .name = "Reservation (legacy)",
+        .filename = "reservation.dat",
+        .logFilename = "reservation.log",
+        .dataSize = sizeof(struct LegacyReservation),
+        .idExtract = extractReservationId,
+    };
+    initTableLock(&legacy);
+    walInit(&legacy);
+    initTablePools(&legacy);
+    loadTableStream(&legacy);
+    size_t replayed;
+    walReplay(&legacy, &replayed);
+
+    FILE *file = fopen("reservations.dat.tmp", "wb");
+    bool ok = file != NULL;
+    size_t converted = 0, invalid = 0;
+    for (Node *current = legacy.head; current && ok; current = current->next)
+    {
+        struct LegacyReservation *old = (struct LegacyReservation *)current->data;
+        struct Reservation reservation = {
+            .reservationID = old->reservationID,
+            .customerID = old->customerID,
+            .roomID = old->roomID,
+        };
+        old->checkInDate[sizeof(old->checkInDate) - 1] = '\0';
+        old->checkOutDate[sizeof(old->checkOutDate) - 1] = '\0';
+        if (!parseDate(old->checkInDate, &reservation.checkInDay) ||
+            !parseDate(old->checkOutDate, &reservation.checkOutDay))
+        {
+            invalid++;
+        }
+        ok = fwrite(&reservation, sizeof(reservation), 1, file) == 1;
+        converted++;
+    }
+    if (file)
+    {
+        ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+        ok = fclose(file) == 0 && ok;
+    }
+    ok = ok && rename("reservations.dat.tmp", "reservations.dat") == 0;
+
+    if (ok)
+    {
+        rename("reservation.dat", "reservation.dat.legacy");
+        rename("reservation.log", "reservation.log.legacy");
+        report->migratedReservations = converted;
+        report->invalidDates = invalid;
+    }
+    else
+    {
+        remove("reservations.dat.tmp");
+    }
+
+    poolDestroy(&legacy.recordPool);
+    poolDestroy(&legacy.nameNodePool);
+    idIndexFree(&legacy.idIndex);
+    pagesFree(&legacy);
+    walFree(&legacy);
+    pthread_rwlock_destroy(&legacy.lock);
+    return ok;
+}
+
+// metrics dump: a background thread appends a snapshot of every table
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    FILE *file;
+    unsigned long long intervalNanos;
+    bool running;
+} MetricsDumper;
+
+MetricsDumper dumper = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+void writeHistogram(FILE *file, const char *name, const unsigned long long *histogram)
+{
+    fprintf(file, ",\"%s\":[", name);
+    for (int b = 0; b < ChainBuckets; b++)
+    {
+        fprintf(file, b ? ",%llu" : "%llu", histogram[b]);
+    }
+    fprintf(file, "]");
+}
+
+void dumpMetrics(FILE *file)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    for (int i = 0; i < TableCount; i++)
+    {
+        TableMetrics metrics;
+        tableMetrics(&tables[i], &metrics);
+        fprintf(file, "{\"time\":%lld,\"table\":\"%s\",\"ops\":{", (long long)now.tv_sec, tables[i].name);
+        for (int op = 0; op < OperationCount; op++)
+        {
+            OperationStats *stats = &metrics.operations[op];
+            fprintf(file, "%s\"%s\":{\"count\":%llu,\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f}",
+                    op ? "," : "", operationName(op), stats->count,
+                    stats->count ? stats->totalNanos / 1e3 / stats->count : 0.0,
+                    metricsPercentile(stats, 0.50) / 1e3, metricsPercentile(stats, 0.99) / 1e3);
+        }
+        fprintf(file, "},\"lock\":{\"acquired\":%llu,\"contended\":%llu,\"wait_us\":%.1f,\"hold_us\":%.1f}",
+                metrics.lock.acquired, metrics.lock.contended, metrics.lock.waitNanos / 1e3,
+                metrics.lock.holdNanos / 1e3);
+        fprintf(file, ",\"backup\":{\"count\":%llu,\"bytes\":%llu,\"us\":%.1f,\"fsync_us\":%.1f}",
+                metrics.backups, metrics.backupBytes, metrics.backupNanos / 1e3, metrics.backupSyncNanos / 1e3);
+        fprintf(file, ",\"log\":{\"flushes\":%llu,\"bytes\":%llu,\"fsync_us\":%.1f}", metrics.logFlushes,
+                metrics.logBytes, metrics.logSyncNanos / 1e3);
+        writeHistogram(file, "id_probes", metrics.idProbeLengths);
+        writeHistogram(file, "name_chains", metrics.nameChainLengths);
+        fprintf(file, "}\n");
+    }
+    fflush(file);
+}
+
+void *metricsDumper(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&dumper.mutex);
+    while (dumper.running)
+    {
+        unsigned long long deadline = nowNanos() + dumper.intervalNanos;
+        struct timespec ts = {
+            .tv_sec = (time_t)(deadline / 1000000000ULL),
+            .tv_nsec = (long)(deadline % 1000000000ULL),
+        };
+        while (dumper.running && nowNanos() < deadline)
+        {
+            pthread_cond_timedwait(&dumper.wake, &dumper.mutex, &ts);
+        }
+        pthread_mutex_unlock(&dumper.mutex);
+        dumpMetrics(dumper.file);
+        pthread_mutex_lock(&dumper.mutex);
+    }
+    pthread_mutex_unlock(&dumper.mutex);
+    return NULL;
+}
+
+bool startMetricsDump(const char *path, unsigned int intervalMs)
+{
+    pthread_mutex_lock(&dumper.mutex);
+    bool ok = !dumper.running && intervalMs > 0 && (dumper.file = fopen(path, "a")) != NULL;
+    if (ok)
+    {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&dumper.wake, &attr);
+        pthread_condattr_destroy(&attr);
+        dumper.intervalNanos = (unsigned long long)intervalMs * 1000000ULL;
+        dumper.running = true;
+        if (pthread_create(&dumper.thread, NULL, metricsDumper, NULL) != 0)
+        {
+            dumper.running = false;
+            pthread_cond_destroy(&dumper.wake);
+            fclose(dumper.file);
+            ok = false;
+        }
+    }
+    pthread_mutex_unlock(&dumper.mutex);
+    return ok;
+}
+
+// the last snapshot is written on the way out
+void stopMetricsDump()
+{
+    pthread_mutex_lock(&dumper.mutex);
+    bool running = dumper.running;
+    dumper.running = false;
+    if (running)
+    {
+        pthread_cond_signal(&dumper.wake);
+    }
+    pthread_mutex_unlock(&dumper.mutex);
+
+    if (running)
+    {
+        pthread_join(dumper.thread, NULL);
+        pthread_cond_destroy(&dumper.wake);
+        fclose(dumper.file);
+    }
+}
+
+HotelStatus hotelOpen(HotelOpenReport *report)
+{
+    HotelOpenReport ignored;
+    if (!report)
+    {
+        report = &ignored;
+    }
+    *report = (HotelOpenReport){0};
+    HotelStatus status = HotelOk;
+
+    // Initialize Customer table
+    tables[0] = (Table){
+        .name = "Customer",
+        .head = NULL,
+        .filename = "customers.dat",
+        .logFilename = "customers.log",
+        .dataSize = sizeof(struct Customer),
+        .parseFunction = parseCustomer,
+        .validateFunction = validateCustomer,
+        .idExtract = extractCustomerId,
+        .nameExtract = extractCustomerName,
+        .fields = customerFields,
+        .fieldCount = FieldCount(customerFields),
+        .idColumn = "customerID",
+    };
+    initTableLock(&tables[0]);
+    walInit(&tables[0]);
+    initTablePools(&tables[0]);
+
+    tables[1] = (Table){
+        .name = "Room",
+        .head = NULL,
+        .filename = "room.dat",
+        .logFilename = "room.log",
+        .dataSize = sizeof(struct Room),
+        .parseFunction = parseRoom,
+        .validateFunction = validateRoom,
+        .idExtract = extractRoomId,
+        .nameExtract = extractRoomType,
+        .fields = roomFields,
+        .fieldCount = FieldCount(roomFields),
+        .idColumn = "roomID",
+    };
+    initTableLock(&tables[1]);
+    walInit(&tables[1]);
+    initTableCodes(&tables[1], extractRoomTypeCode);
+    initTablePools(&tables[1]);
+
+    tables[2] = (Table){
+        .name = "Reservation",
+        .head = NULL,
+        .filename = "reservations.dat",
+        .logFilename = "reservations.log",
+        .dataSize = sizeof(struct Reservation),
+        .parseFunction = parseReservation,
+        .validateFunction = validateReservation,
+        .idExtract = extractReservationId,
+        .nameExtract = NULL,
+        .fields = reservationFields,
+        .fieldCount = FieldCount(reservationFields),
+        .idColumn = "reservationID",
+    };
+    initTableLock(&tables[2]);
+    walInit(&tables[2]);
+    initTablePools(&tables[2]);
+    addSecondaryIndex(&tables[2], "Customer ID", "customerID", extractReservationCustomerId);
+    addSecondaryIndex(&tables[2], "Room ID", "roomID", extractReservationRoomId);
+    addIntervalIndex(&tables[2], extractReservationRoomId, extractReservationCheckIn, extractReservationCheckOut);
+
+    tables[3] = (Table){
+        .name = "Amenity",
+        .head = NULL,
+        .filename = "amenity.dat",
+        .logFilename = "amenity.log",
+        .dataSize = sizeof(struct Amenity),
+        .parseFunction = parseAmenity,
+        .validateFunction = validateAmenity,
+        .idExtract = extractAmenityRoomId,
+        .nameExtract = NULL,
+        .fields = amenityFields,
+        .fieldCount = FieldCount(amenityFields),
+        .idColumn = "RoomID",
+    };
+    initTableLock(&tables[3]);
+    walInit(&tables[3]);
+    initTablePools(&tables[3]);
+    addSecondaryIndex(&tables[3], "Amenity ID", "AmenityID", extractAmenityAmenityId);
+
+    tables[4] = (Table){
+        .name = "Amenity_Type",
+        .head = NULL,
+        .filename = "amenity_type.dat",
+        .logFilename = "amenity_type.log",
+        .dataSize = sizeof(struct Amenity_Type),
+        .parseFunction = parseAmenityType,
+        .validateFunction = validateAmenityType,
+        .idExtract = extractAmenityTypeId,
+        .nameExtract = extractAmenityTypeName,
+        .fields = amenityTypeFields,
+        .fieldCount = FieldCount(amenityTypeFields),
+        .idColumn = "AmenityID",
+    };
+    initTableLock(&tables[4]);
+    walInit(&tables[4]);
+    initTableCodes(&tables[4], extractAmenityTypeNameCode);
+    initTablePools(&tables[4]);
+
+    tables[5] = (Table){
+        .name = "CUTSOMER_PLACES_ROOM",
+        .head = NULL,
+        .filename = "CUTSOMER_PLACES_ROOM.dat",
+        .logFilename = "CUTSOMER_PLACES_ROOM.log",
+        .dataSize = sizeof(struct CUTSOMER_PLACES_ROOM),
+        .parseFunction = parseCustomerPlacesRoom,
+        .validateFunction = validateCustomerPlacesRoom,
+        .idExtract = extractCustomerPlacesRoomId,
+        .nameExtract = NULL,
+        .fields = customerPlacesRoomFields,
+        .fieldCount = FieldCount(customerPlacesRoomFields),
+        .idColumn = "RoomID",
+    };
+    initTableLock(&tables[5]);
+    walInit(&tables[5]);
+    initTablePools(&tables[5]);
+    addSecondaryIndex(&tables[5], "Customer ID", "customerID", extractCustomerPlacesRoomCustomerId);
+
+    if (!migrateLegacyReservations(report))
+    {
+        status = HotelIoError;
+    }
+
+    // every table loads on its own thread
+    OpenTask tasks[TableCount];
+    for (int i = 0; i < TableCount; i++)
+    {
+        tasks[i] = (OpenTask){.table = &tables[i], .report = report, .index = i};
+    }
+    runTasks(openTable, tasks, sizeof(OpenTask), TableCount, TableCount);
+    for (int i = 0; i < TableCount; i++)
+    {
+        if (status == HotelOk)
+        {
+            status = tasks[i].status;
+        }
+    }
+
+    if (!startPersistenceWorker(DefaultMaxStalenessMs) && status == HotelOk)
+    {
+        status = HotelNoMemory;
+    }
+    return status;
+}
+
+void hotelClose()
+{
+
+    // drain pending checkpoints before tearing the tables down
+    flushNow();
+    stopPersistenceWorker();
+    stopMetricsDump();
+
+    for (int i = 0; i < TableCount; i++)
+    {
+        // every record and node lives in the pools, so the table goes in one step
+        poolDestroy(&tables[i].recordPool);
+        poolDestroy(&tables[i].nameNodePool);
+        tables[i].head = NULL;
+        free(tables[i].nameHashTable.buckets);
+        memset(&tables[i].nameHashTable, 0, sizeof(HashTable));
+        skipFree(&tables[i].nameOrder);
+        for (int j = 0; j < tables[i].secondaryCount; j++)
+        {
+            secondaryFree(&tables[i].secondary[j]);
+        }
+        tables[i].secondaryCount = 0;
+        if (tables[i].intervalIndex.keyExtract)
+        {
+            intervalFree(&tables[i].intervalIndex);
+        }
+        roomColumnsFree(tables[i].roomColumns);
+        tables[i].roomColumns = NULL;
+        idIndexFree(&tables[i].idIndex);
+        if (tables[i].codedField)
+        {
+            secondaryFree(&tables[i].codeIndex);
+        }
+        dictionaryFree(&tables[i].strings);
+        tables[i].codesInFile = tables[i].codeBytes = 0;
+        pagesFree(&tables[i]);
+        walFree(&tables[i]);
+        tables[i].retired = NULL;
+        tables[i].limbo = tables[i].limboTail = NULL;
+        tables[i].limboCount = 0;
+        pthread_rwlock_destroy(&tables[i].lock);
+        pthread_mutex_destroy(&tables[i].checkpointMutex);
+    }
+    freeRetiredMemory(true);
+}
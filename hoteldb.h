@@ -0,0 +1,351 @@
+#ifndef HOTELDB_H
+#define HOTELDB_H
+
+// embeddable hotel database: every call returns a status or a count, records
+// are copied in and out of caller-supplied buffers and nothing is printed or
+// read from the terminal
+#include <stdbool.h>
+#include <stddef.h>
+
+struct Customer
+{
+    int customerID;
+    char name[100];
+    char email[100];
+    char phone[20];
+    char address[200];
+};
+
+struct Room
+{
+    int roomID;
+    char roomType[50];
+    double price;
+    int availability;
+};
+
+// dates are day numbers counted from 1970-01-01, check-out is exclusive
+struct Reservation
+{
+    int reservationID;
+    int checkInDay;
+    int checkOutDay;
+    int customerID;
+    int roomID;
+};
+
+struct Amenity
+{
+    int RoomID;
+    int AmenityID;
+};
+
+struct Amenity_Type
+{
+    int AmenityID;
+    char AmenityName[100];
+};
+
+struct CUTSOMER_PLACES_ROOM
+{
+    int customerID;
+    int RoomID;
+    char phone[20];
+};
+
+typedef enum
+{
+    CustomerTable,
+    RoomTable,
+    ReservationTable,
+    AmenityTable,
+    AmenityTypeTable,
+    CustomerPlacesRoomTable,
+    TableCount
+} HotelTableId;
+
+typedef enum
+{
+    HotelOk,
+    HotelNotFound,
+    // another record already has the id
+    HotelDuplicate,
+    // the record breaks a column rule, e.g. an unterminated string
+    HotelInvalid,
+    HotelNoMemory,
+    // the change is applied in memory but could not be made durable
+    HotelIoError,
+    // a transaction read a record that changed before it committed
+    HotelConflict
+} HotelStatus;
+
+typedef struct Table Table;
+typedef struct TableSnapshot TableSnapshot;
+
+typedef struct
+{
+    // reservations converted from the old string date layout
+    size_t migratedReservations;
+    size_t invalidDates;
+    // logged changes replayed on top of each base file
+    size_t recovered[TableCount];
+    // records lost to a base file that failed its checksums, which is kept
+    // as <name>.damaged
+    size_t damaged[TableCount];
+} HotelOpenReport;
+
+#define ImportBadRowsShown 5
+
+typedef struct
+{
+    size_t rows;
+    size_t imported;
+    size_t invalid;
+    size_t duplicates;
+    double seconds;
+    // line (CSV) or record (binary) numbers of the first rejected rows
+    size_t rejected[ImportBadRowsShown];
+} ImportStats;
+
+typedef struct
+{
+    size_t records;
+    size_t slabBytes;
+    size_t usedBytes;
+    size_t idIndexBytes;
+    // columnar Room copy, 0 when not enabled
+    size_t columnBytes;
+} TableMemoryStats;
+
+typedef struct
+{
+    unsigned long long acquired;
+    unsigned long long contended;
+    unsigned long long waitNanos;
+    unsigned long long holdNanos;
+} TableLockStats;
+
+// operations timed by the built-in metrics
+typedef enum
+{
+    OpInsert,
+    OpGet,
+    OpUpdate,
+    OpDelete,
+    OpScan,
+    OpFindByName,
+    OpSearchByName,
+    OpFindBySecondary,
+    OpImport,
+    OpQuery,
+    OpCommit,
+    OperationCount
+} HotelOperation;
+
+// bucket i counts calls that took less than 2^i ns (and at least 2^(i-1)),
+// the last bucket also takes everything slower
+#define MetricsBuckets 36
+// chain length histograms: bucket i counts records found after i + 1 probes
+// or chain steps, the last bucket also takes longer walks
+#define ChainBuckets 16
+
+typedef struct
+{
+    unsigned long long count;
+    unsigned long long totalNanos;
+    unsigned long long buckets[MetricsBuckets];
+} OperationStats;
+
+typedef struct
+{
+    OperationStats operations[OperationCount];
+    TableLockStats lock;
+    // checkpoints writing the .dat file
+    unsigned long long backups;
+    unsigned long long backupBytes;
+    unsigned long long backupNanos;
+    unsigned long long backupSyncNanos;
+    // group commits of the write-ahead log
+    unsigned long long logFlushes;
+    unsigned long long logBytes;
+    unsigned long long logSyncNanos;
+    // measured when the metrics are read
+    unsigned long long idProbeLengths[ChainBuckets];
+    unsigned long long nameChainLengths[ChainBuckets];
+} TableMetrics;
+
+// return false to stop the scan
+typedef bool (*TableVisitor)(const void *record, void *context);
+
+// loads every table from the working directory and starts the persistence
+// worker; report may be NULL
+HotelStatus hotelOpen(HotelOpenReport *report);
+// checkpoints pending changes and frees every table
+void hotelClose();
+// blocks until every change made so far is in the base files
+void flushNow();
+Table *hotelTable(HotelTableId id);
+const char *hotelStatusText(HotelStatus status);
+
+const char *tableName(const Table *table);
+size_t tableRecordSize(const Table *table);
+int tableRecordId(const Table *table, const void *record);
+size_t tableRecordCount(Table *table);
+
+HotelStatus tableInsert(Table *table, const void *record);
+// copies the record with the given id into record
+HotelStatus tableGet(Table *table, int id, void *record);
+// replaces the record with the given id; record may carry a new id
+HotelStatus tableUpdate(Table *table, int id, const void *record);
+HotelStatus tableDelete(Table *table, int id);
+// visits every record under the table's read lock; the visitor must not
+// write to the same table
+HotelStatus tableScan(Table *table, TableVisitor visit, void *context);
+
+// point-in-time view of a table: scanning it takes no lock, so writers carry
+// on meanwhile; records replaced or deleted after the snapshot are kept until
+// it is released. every snapshot must be released before hotelClose
+TableSnapshot *tableSnapshot(Table *table);
+size_t snapshotRecordCount(const TableSnapshot *snapshot);
+HotelStatus snapshotScan(TableSnapshot *snapshot, TableVisitor visit, void *context);
+void snapshotRelease(TableSnapshot *snapshot);
+
+// cursors list a table in batches without pinning old versions: the ids are
+// taken when the cursor opens, a batch per read lock, and each fetch copies
+// the current contents of the next records in id order under a short read
+// lock, released between batches. records inserted after opening are not
+// listed, those inserted while it opens may be, records deleted before
+// their batch is fetched are skipped, every other record comes exactly
+// once. the exception is a record whose id an update changes: it is looked
+// up under the id it had when listed, so it is skipped when that happens
+// after the cursor opened
+typedef struct TableCursor TableCursor;
+
+// a good maxRecords for cursorFetch; larger fetches still release the lock
+// every CursorBatch records
+#define CursorBatch 256
+
+TableCursor *tableCursorOpen(Table *table);
+// ids taken when the cursor opened, deleted records included
+size_t cursorRecordCount(const TableCursor *cursor);
+// copies up to maxRecords records into records, an array of tableRecordSize()
+// sized slots, and returns how many; 0 once the cursor is at the end
+size_t cursorFetch(TableCursor *cursor, void *records, size_t maxRecords);
+// ids consumed so far; seeking back to a saved position resumes there, and
+// seeking to offset before fetching limit records reads one page
+size_t cursorPosition(const TableCursor *cursor);
+void cursorSeek(TableCursor *cursor, size_t position);
+void cursorClose(TableCursor *cursor);
+
+// transactions across tables: txGet remembers the version of every record it
+// reads, or that it was missing, and writes stay in the transaction until
+// txCommit. commit locks the tables involved just long enough to check that
+// none of those records changed and to apply the writes; if one changed it
+// applies nothing and returns HotelConflict, and the caller starts over.
+// commit is all-or-nothing only to other threads: each table logs its own
+// writes, so a crash can recover them for some tables and not others, and
+// running out of memory part way keeps the writes applied so far and
+// returns HotelNoMemory
+typedef struct Transaction Transaction;
+
+Transaction *txBegin();
+// sees the transaction's own writes
+HotelStatus txGet(Transaction *tx, HotelTableId table, int id, void *record);
+HotelStatus txInsert(Transaction *tx, HotelTableId table, const void *record);
+// the record must keep its id
+HotelStatus txUpdate(Transaction *tx, HotelTableId table, int id, const void *record);
+HotelStatus txDelete(Transaction *tx, HotelTableId table, int id);
+// both free the transaction
+HotelStatus txCommit(Transaction *tx);
+void txAbort(Transaction *tx);
+
+// in one transaction: inserts the reservation and makes the customer the
+// room's CUTSOMER_PLACES_ROOM entry, retrying on conflict; HotelConflict when
+// another reservation of the room overlaps the stay, HotelNotFound when the
+// room or customer does not exist. the room's availability is left as is
+HotelStatus bookRoom(const struct Reservation *reservation);
+
+// the find functions copy up to maxRecords matches into records, an array of
+// tableRecordSize() sized slots, and return the total number of matches
+size_t tableFindByName(Table *table, const char *name, void *records, size_t maxRecords);
+// case-insensitive; names starting with text when prefix is set, in name order
+size_t tableSearchByName(Table *table, const char *text, bool prefix, void *records, size_t maxRecords);
+int tableSecondaryCount(const Table *table);
+const char *tableSecondaryName(const Table *table, int indexNumber);
+size_t tableFindBySecondary(Table *table, int indexNumber, int key, void *records, size_t maxRecords);
+
+// bulk loads a CSV file (columns in struct order) or a binary file of raw
+// records as laid out in memory, then rewrites the table's .dat file once
+HotelStatus importTable(Table *table, const char *path, bool binary, ImportStats *stats);
+
+// fills roomIds with up to maxRooms rooms that have no reservation overlapping
+// [fromDay, toDay) and returns how many rooms are available in total
+size_t findAvailableRooms(int fromDay, int toDay, int *roomIds, size_t maxRooms);
+
+// inventory search; prices are inclusive bounds, -1 availability and a NULL
+// roomType match any room
+typedef struct
+{
+    double minPrice;
+    double maxPrice;
+    int availability;
+    const char *roomType;
+} RoomFilter;
+
+// keeps a columnar copy of the Room table from now until hotelClose so
+// findRooms runs vectorized filters instead of walking every record
+HotelStatus enableRoomColumns();
+// fills roomIds with up to maxRooms matching room ids and returns how many
+// rooms match in total
+size_t findRooms(const RoomFilter *filter, int *roomIds, size_t maxRooms);
+
+// joins: the first query table drives, every later table names a column of
+// its own that must equal a column of an earlier query table. columns are
+// int struct members named as in this header, e.g. "customerID"
+#define QueryMaxTables 4
+
+// rows failing the filter are dropped before they are joined
+typedef bool (*RecordFilter)(const void *record, void *context);
+// called once per result row, records[i] is the row's record of the i-th
+// query table; calls are serialized but come in no particular order, return
+// false to stop the query
+typedef bool (*QueryVisitor)(const void *const *records, void *context);
+
+typedef struct
+{
+    HotelTableId table;
+    // NULL keeps every row
+    RecordFilter filter;
+    void *filterContext;
+    // join condition, ignored for the first table
+    const char *column;
+    int other;
+    const char *otherColumn;
+} QueryTable;
+
+typedef struct
+{
+    QueryTable tables[QueryMaxTables];
+    int tableCount;
+} Query;
+
+// holds the read lock of every table in the query while it runs, so the
+// visitor must not write to them; HotelInvalid if a table or column is unknown
+HotelStatus runQuery(const Query *query, QueryVisitor visit, void *context);
+
+void tableMemoryStats(Table *table, TableMemoryStats *stats);
+void tableLockStats(Table *table, TableLockStats *stats);
+// counters are kept per thread without locks and summed here
+void tableMetrics(Table *table, TableMetrics *metrics);
+// upper bound in ns of the bucket holding the given fraction of calls
+unsigned long long metricsPercentile(const OperationStats *stats, double fraction);
+const char *operationName(HotelOperation operation);
+// appends every table's metrics to path as JSON lines every intervalMs
+// until hotelClose; returns false if the file or thread could not be set up
+bool startMetricsDump(const char *path, unsigned int intervalMs);
+
+// parses YYYY-MM-DD, rejecting dates that do not exist
+bool parseDate(const char *text, int *days);
+void formatDate(int days, char *buffer, size_t size);
+
+#endif
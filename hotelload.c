@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "hoteldb.h"
+#include "hotelproto.h"
+
+// load generator for hotelserver: fills the Room table through the server,
+// then every connection keeps a window of requests in flight, a random mix of
+// ProtoGet and ProtoUpdate, and one line reports requests/sec and latency
+#define DefaultConnections 4
+#define DefaultRequests 100000
+#define DefaultPipeline 16
+#define DefaultRows 10000
+#define DefaultWritePercent 10
+#define MaxConnections 256
+#define MaxPipeline 1024
+
+typedef struct
+{
+    const char *socketPath;
+    int port;
+    int connections;
+    size_t requests;
+    int pipeline;
+    size_t rows;
+    int writePercent;
+} LoadOptions;
+
+typedef struct
+{
+    size_t sent;
+    size_t received;
+    size_t errors;
+    // send time of every request still in flight, oldest first
+    unsigned long long inFlight[MaxPipeline];
+    unsigned long long *latencies;
+    unsigned int state;
+    bool failed;
+} LoadTask;
+
+LoadOptions options;
+
+unsigned long long loadNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+unsigned int nextRandom(unsigned int *state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x ? x : 1;
+}
+
+int connectServer()
+{
+    int fd;
+    if (options.port)
+    {
+        struct sockaddr_in address = {
+            .sin_family = AF_INET,
+            .sin_port = htons(options.port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", options.socketPath);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void *data, size_t length)
+{
+    char *at = data;
+    while (length > 0)
+    {
+        ssize_t n = recv(fd, at, length, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        at += n;
+        length -= n;
+    }
+    return true;
+}
+
+void makeRoom(int id, unsigned int salt, struct Room *room)
+{
+    memset(room, 0, sizeof(*room));
+    room->roomID = id;
+    snprintf(room->roomType, sizeof(room->roomType), "Type %d", id % 100);
+    room->price = 50 + (id + salt) % 400;
+    room->availability = (id + salt) % 2;
+}
+
+// appends the next request of the mix to a send buffer
+size_t nextRequest(LoadTask *task, char *buffer)
+{
+    RequestHeader header = {
+        .tag = (uint32_t)task->sent,
+        .table = RoomTable,
+        .id = 1 + (int)(nextRandom(&task->state) % options.rows),
+    };
+    if ((int)(nextRandom(&task->state) % 100) < options.writePercent)
+    {
+        struct Room room;
+        makeRoom(header.id, task->state, &room);
+        header.operation = ProtoUpdate;
+        header.length = sizeof(room);
+        memcpy(buffer, &header, sizeof(header));
+        memcpy(buffer + sizeof(header), &room, sizeof(room));
+        return sizeof(header) + sizeof(room);
+    }
+    header.operation = ProtoGet;
+    memcpy(buffer, &header, sizeof(header));
+    return sizeof(header);
+}
+
+// keeps options.pipeline requests in flight until options.requests are answered
+void *runConnection(void *arg)
+{
+    LoadTask *task = arg;
+    int fd = connectServer();
+    size_t requestBytes = sizeof(RequestHeader) + sizeof(struct Room);
+    char *sendBuffer = malloc(MaxPipeline * requestBytes);
+    char payload[ProtoMaxRecords * sizeof(struct Customer)];
+    if (fd < 0 || !sendBuffer)
+    {
+        task->failed = true;
+        free(sendBuffer);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    while (task->received < options.requests)
+    {
+        // top the window up with one write
+        size_t length = 0;
+        unsigned long long now = loadNanos();
+        while (task->sent < options.requests && task->sent - task->received < (size_t)options.pipeline)
+        {
+            task->inFlight[task->sent % MaxPipeline] = now;
+            length += nextRequest(task, sendBuffer + length);
+            task->sent++;
+        }
+        if (!sendAll(fd, sendBuffer, length))
+        {
+            task->failed = true;
+            break;
+        }
+
+        ResponseHeader response;
+        if (!receiveAll(fd, &response, sizeof(response)) || response.length > sizeof(payload) ||
+            !receiveAll(fd, payload, response.length) || response.tag != task->received)
+        {
+            task->failed = true;
+            break;
+        }
+        task->latencies[task->received] = loadNanos() - task->inFlight[task->received % MaxPipeline];
+        task->errors += response.status != HotelOk;
+        task->received++;
+    }
+    free(sendBuffer);
+    close(fd);
+    return NULL;
+}
+
+// rooms 1..rows, inserted or overwritten in pipelined batches on one connection
+bool populate()
+{
+    int fd = connectServer();
+    if (fd < 0)
+    {
+        return false;
+    }
+    size_t requestBytes = sizeof(RequestHeader) + sizeof(struct Room);
+    char *buffer = malloc(MaxPipeline * requestBytes);
+    bool ok = buffer != NULL;
+    for (size_t first = 1; ok && first <= options.rows; first += MaxPipeline)
+    {
+        size_t count = options.rows - first + 1 < MaxPipeline ? options.rows - first + 1 : MaxPipeline;
+        for (size_t i = 0; i < count; i++)
+        {
+            struct Room room;
+            makeRoom((int)(first + i), 0, &room);
+            RequestHeader header = {
+                .length = sizeof(room),
+                .tag = (uint32_t)i,
+                .operation = ProtoInsert,
+                .table = RoomTable,
+            };
+            memcpy(buffer + i * requestBytes, &header, sizeof(header));
+            memcpy(buffer + i * requestBytes + sizeof(header), &room, sizeof(room));
+        }
+        ok = sendAll(fd, buffer, count * requestBytes);
+        for (size_t i = 0; ok && i < count; i++)
+        {
+            ResponseHeader response;
+            ok = receiveAll(fd, &response, sizeof(response)) && response.length == 0 &&
+                 (response.status == HotelOk || response.status == HotelDuplicate);
+        }
+    }
+    free(buffer);
+    close(fd);
+    return ok;
+}
+
+int compareNanos(const void *a, const void *b)
+{
+    unsigned long long left = *(const unsigned long long *)a, right = *(const unsigned long long *)b;
+    return (left > right) - (left < right);
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-s socket | -p port] [-c connections] [-n requests] [-P pipeline] [-r rooms] [-w write%%]\n"
+            "  -s  Unix-domain socket path (default %s)\n"
+            "  -p  connect to 127.0.0.1:port instead\n"
+            "  -c  connections, one thread each (default %d)\n"
+            "  -n  requests per connection (default %d)\n"
+            "  -P  requests in flight per connection, 1 to %d (default %d)\n"
+            "  -r  rooms inserted before the run (default %d)\n"
+            "  -w  percentage of updates, the rest are gets (default %d)\n",
+            program, DefaultSocketPath, DefaultConnections, DefaultRequests, MaxPipeline, DefaultPipeline,
+            DefaultRows, DefaultWritePercent);
+}
+
+int main(int argc, char **argv)
+{
+    options = (LoadOptions){
+        .socketPath = DefaultSocketPath,
+        .connections = DefaultConnections,
+        .requests = DefaultRequests,
+        .pipeline = DefaultPipeline,
+        .rows = DefaultRows,
+        .writePercent = DefaultWritePercent,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:c:n:P:r:w:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            options.socketPath = optarg;
+            break;
+        case 'p':
+            options.port = atoi(optarg);
+            break;
+        case 'c':
+            options.connections = atoi(optarg);
+            break;
+        case 'n':
+            options.requests = strtoull(optarg, NULL, 10);
+            break;
+        case 'P':
+            options.pipeline = atoi(optarg);
+            break;
+        case 'r':
+            options.rows = strtoull(optarg, NULL, 10);
+            break;
+        case 'w':
+            options.writePercent = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.connections < 1 || options.connections > MaxConnections || options.requests == 0 ||
+        options.requests > 0xffffffffUL || options.pipeline < 1 || options.pipeline > MaxPipeline ||
+        options.rows < 1 || options.rows > 2147483647UL || options.writePercent < 0 || options.writePercent > 100)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!populate())
+    {
+        fprintf(stderr, "could not fill the Room table through the server\n");
+        return 1;
+    }
+
+    LoadTask *tasks = calloc(options.connections, sizeof(LoadTask));
+    pthread_t handles[MaxConnections];
+    if (!tasks)
+    {
+        return 1;
+    }
+    for (int i = 0; i < options.connections; i++)
+    {
+        tasks[i].state = 12345u + 7919u * (i + 1);
+        tasks[i].latencies = malloc(options.requests * sizeof(unsigned long long));
+        if (!tasks[i].latencies)
+        {
+            return 1;
+        }
+    }
+    unsigned long long start = loadNanos();
+    for (int i = 0; i < options.connections; i++)
+    {
+        pthread_create(&handles[i], NULL, runConnection, &tasks[i]);
+    }
+    for (int i = 0; i < options.connections; i++)
+    {
+        pthread_join(handles[i], NULL);
+    }
+    double seconds = (loadNanos() - start) / 1e9;
+
+    size_t total = 0, errors = 0;
+    bool failed = false;
+    unsigned long long *all = malloc(options.connections * options.requests * sizeof(unsigned long long));
+    for (int i = 0; i < options.connections; i++)
+    {
+        if (all)
+        {
+            memcpy(all + total, tasks[i].latencies, tasks[i].received * sizeof(unsigned long long));
+        }
+        total += tasks[i].received;
+        errors += tasks[i].errors;
+        failed |= tasks[i].failed;
+        free(tasks[i].latencies);
+    }
+    double p50 = 0, p99 = 0;
+    if (all && total > 0)
+    {
+        qsort(all, total, sizeof(unsigned long long), compareNanos);
+        p50 = all[(size_t)(0.50 * (total - 1) + 0.5)] / 1e3;
+        p99 = all[(size_t)(0.99 * (total - 1) + 0.5)] / 1e3;
+    }
+    printf("connections,pipeline,requests,seconds,requests_per_sec,p50_us,p99_us,errors\n");
+    printf("%d,%d,%zu,%.6f,%.1f,%.2f,%.2f,%zu\n", options.connections, options.pipeline, total, seconds,
+           seconds > 0 ? total / seconds : 0.0, p50, p99, errors);
+    free(all);
+    free(tasks);
+    if (failed)
+    {
+        fprintf(stderr, "some connections failed before finishing\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef HOTELPROTO_H
+#define HOTELPROTO_H
+
+// wire protocol of hotelserver: every request is a RequestHeader followed by
+// length payload bytes, every response a ResponseHeader followed by length
+// bytes of records. the server and its clients share one machine (a
+// Unix-domain socket or loopback TCP), so integers and records travel in
+// their in-memory layout. a connection may send any number of requests
+// without waiting; they run in order and the responses come back in order,
+// each carrying the tag of its request
+#include <stdint.h>
+#include "hoteldb.h"
+
+#define DefaultSocketPath "hotel.sock"
+// payloads above this close the connection
+#define ProtoMaxPayload 65536
+// records returned by one find or scan at most
+#define ProtoMaxRecords 64
+
+typedef enum
+{
+    // id: record id
+    ProtoGet,
+    // payload: the record
+    ProtoInsert,
+    // id: record id, payload: the new record
+    ProtoUpdate,
+    // id: record id
+    ProtoDelete,
+    // payload: the name, not terminated
+    ProtoFindByName,
+    // id: key, index: secondary index number
+    ProtoFindBySecondary,
+    // id: offset into the table, count: records wanted
+    ProtoScan,
+    // payload: a struct Reservation, booked with bookRoom
+    ProtoBook,
+    ProtoCount,
+    ProtoOperationCount
+} ProtoOperation;
+
+typedef struct
+{
+    uint32_t length;
+    uint32_t tag;
+    uint8_t operation;
+    uint8_t table;
+    uint8_t index;
+    uint8_t reserved;
+    int32_t id;
+    uint32_t count;
+} RequestHeader;
+
+typedef struct
+{
+    uint32_t length;
+    uint32_t tag;
+    // a HotelStatus
+    uint32_t status;
+    // total matches for finds, records for ProtoCount, otherwise the number
+    // of records in the payload
+    uint32_t count;
+} ResponseHeader;
+
+#endif
@@ -0,0 +1,703 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "hoteldb.h"
+#include "hotelproto.h"
+
+// server mode: one thread waits on every socket with epoll and reads what
+// arrives, a fixed pool of workers runs the requests. a connection is handed
+// to one worker at a time, which runs every complete request it has buffered
+// in order and sends the responses back in one write, so pipelined requests
+// cost one wakeup and one send per batch rather than per request
+#define DefaultWorkers 4
+#define MaxWorkers 64
+#define MaxEvents 64
+#define ReadChunk 65536
+// stop reading a connection whose unprocessed input or unsent output grows
+// past this, until the workers catch up
+#define ConnectionBufferLimit (4 * 1024 * 1024)
+// input a worker takes from one connection before letting others run
+#define WorkerBatchBytes (256 * 1024)
+
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+typedef struct Connection
+{
+    int fd;
+    pthread_mutex_t mutex;
+    Buffer input;
+    Buffer output;
+    // queued for or held by a worker
+    bool scheduled;
+    // reading paused until the buffers shrink
+    bool paused;
+    bool closed;
+    struct Connection *nextReady;
+    // every open connection, so shutdown can free them
+    struct Connection *previous;
+    struct Connection *next;
+    // the table cursors ProtoScan pages through, only touched by the worker
+    // holding the connection
+    TableCursor *cursors[TableCount];
+} Connection;
+
+typedef struct
+{
+    const char *socketPath;
+    int port;
+    int workers;
+} ServerOptions;
+
+ServerOptions options;
+int epollFd = -1;
+// connections with requests waiting for a worker
+pthread_mutex_t readyMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t readyCondition = PTHREAD_COND_INITIALIZER;
+Connection *readyHead = NULL;
+Connection *readyTail = NULL;
+bool stopping = false;
+pthread_mutex_t connectionsMutex = PTHREAD_MUTEX_INITIALIZER;
+Connection *connections = NULL;
+unsigned long long requestsServed = 0;
+unsigned long long connectionsAccepted = 0;
+
+bool bufferReserve(Buffer *buffer, size_t extra)
+{
+    if (buffer->length + extra <= buffer->capacity)
+    {
+        return true;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra)
+    {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity);
+    if (!data)
+    {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+bool bufferAppend(Buffer *buffer, const void *data, size_t length)
+{
+    if (length == 0)
+    {
+        return true;
+    }
+    if (!bufferReserve(buffer, length))
+    {
+        return false;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return true;
+}
+
+void bufferConsume(Buffer *buffer, size_t length)
+{
+    memmove(buffer->data, buffer->data + length, buffer->length - length);
+    buffer->length -= length;
+}
+
+// bytes at the front of input that form whole requests, at most limit
+// unless the first request alone is larger; false on a malformed request
+bool completeRequests(const Buffer *input, size_t limit, size_t *bytes)
+{
+    size_t offset = 0;
+    while (input->length - offset >= sizeof(RequestHeader))
+    {
+        RequestHeader header;
+        memcpy(&header, input->data + offset, sizeof(header));
+        if (header.length > ProtoMaxPayload)
+        {
+            return false;
+        }
+        size_t size = sizeof(header) + header.length;
+        if (input->length - offset < size || (offset > 0 && offset + size > limit))
+        {
+            break;
+        }
+        offset += size;
+    }
+    *bytes = offset;
+    return true;
+}
+
+// callers hold the connection mutex
+void watchConnection(Connection *connection)
+{
+    struct epoll_event event = {
+        .events = (connection->paused ? 0 : EPOLLIN) | (connection->output.length ? EPOLLOUT : 0),
+        .data.ptr = connection,
+    };
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+void closeConnection(Connection *connection)
+{
+    if (!connection->closed)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+        close(connection->fd);
+        connection->closed = true;
+    }
+}
+
+void freeConnection(Connection *connection)
+{
+    pthread_mutex_lock(&connectionsMutex);
+    if (connection->previous)
+    {
+        connection->previous->next = connection->next;
+    }
+    else
+    {
+        connections = connection->next;
+    }
+    if (connection->next)
+    {
+        connection->next->previous = connection->previous;
+    }
+    pthread_mutex_unlock(&connectionsMutex);
+    for (int i = 0; i < TableCount; i++)
+    {
+        cursorClose(connection->cursors[i]);
+    }
+    pthread_mutex_destroy(&connection->mutex);
+    free(connection->input.data);
+    free(connection->output.data);
+    free(connection);
+}
+
+// sends as much pending output as the socket takes; callers hold the mutex
+void flushOutput(Connection *connection)
+{
+    size_t sent = 0;
+    while (sent < connection->output.length)
+    {
+        ssize_t n = send(connection->fd, connection->output.data + sent, connection->output.length - sent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                // the event loop sees the error and closes the connection
+                shutdown(connection->fd, SHUT_RDWR);
+                connection->output.length = sent = 0;
+            }
+            break;
+        }
+        sent += n;
+    }
+    bufferConsume(&connection->output, sent);
+}
+
+// puts a scheduled connection at the back of the ready queue
+void enqueueConnection(Connection *connection)
+{
+    pthread_mutex_lock(&readyMutex);
+    connection->nextReady = NULL;
+    if (readyTail)
+    {
+        readyTail->nextReady = connection;
+    }
+    else
+    {
+        readyHead = connection;
+    }
+    readyTail = connection;
+    pthread_cond_signal(&readyCondition);
+    pthread_mutex_unlock(&readyMutex);
+}
+
+// callers hold the connection mutex
+void scheduleConnection(Connection *connection)
+{
+    if (connection->scheduled)
+    {
+        return;
+    }
+    connection->scheduled = true;
+    enqueueConnection(connection);
+}
+
+// appends a response with count records of the table's size from records
+bool respond(Buffer *output, const RequestHeader *request, HotelStatus status, uint32_t count,
+             const void *records, size_t length)
+{
+    ResponseHeader header = {
+        .length = (uint32_t)length,
+        .tag = request->tag,
+        .status = status,
+        .count = count,
+    };
+    return bufferAppend(output, &header, sizeof(header)) && bufferAppend(output, records, length);
+}
+
+// runs one request against the database and appends its response
+bool executeRequest(Connection *connection, const RequestHeader *request, const char *payload, char *records,
+                    Buffer *output)
+{
+    if (request->table >= TableCount || request->operation >= ProtoOperationCount)
+    {
+        return respond(output, request, HotelInvalid, 0, NULL, 0);
+    }
+    Table *table = hotelTable(request->table);
+    size_t size = tableRecordSize(table);
+    // payloads sit unaligned in the batch
+    bool recordPayload = request->length == size;
+    if (recordPayload)
+    {
+        memcpy(records, payload, size);
+    }
+    switch (request->operation)
+    {
+    case ProtoGet:
+    {
+        HotelStatus status = tableGet(table, request->id, records);
+        return respond(output, request, status, status == HotelOk, records, status == HotelOk ? size : 0);
+    }
+    case ProtoInsert:
+        return respond(output, request, recordPayload ? tableInsert(table, records) : HotelInvalid, 0, NULL, 0);
+    case ProtoUpdate:
+        return respond(output, request, recordPayload ? tableUpdate(table, request->id, records) : HotelInvalid, 0,
+                       NULL, 0);
+    case ProtoDelete:
+        return respond(output, request, tableDelete(table, request->id), 0, NULL, 0);
+    case ProtoFindByName:
+    {
+        char name[256];
+        if (request->length >= sizeof(name))
+        {
+            return respond(output, request, HotelInvalid, 0, NULL, 0);
+        }
+        memcpy(name, payload, request->length);
+        name[request->length] = '\0';
+        size_t total = tableFindByName(table, name, records, ProtoMaxRecords);
+        size_t shown = total < ProtoMaxRecords ? total : ProtoMaxRecords;
+        return respond(output, request, HotelOk, (uint32_t)total, records, shown * size);
+    }
+    case ProtoFindBySecondary:
+    {
+        if (request->index >= tableSecondaryCount(table))
+        {
+            return respond(output, request, HotelInvalid, 0, NULL, 0);
+        }
+        size_t total = tableFindBySecondary(table, request->index, request->id, records, ProtoMaxRecords);
+        size_t shown = total < ProtoMaxRecords ? total : ProtoMaxRecords;
+        return respond(output, request, HotelOk, (uint32_t)total, records, shown * size);
+    }
+    case ProtoScan:
+    {
+        // offset 0 starts a fresh listing, later pages reuse its cursor
+        TableCursor **cursor = &connection->cursors[request->table];
+        if (request->id == 0 || !*cursor)
+        {
+            cursorClose(*cursor);
+            *cursor = tableCursorOpen(table);
+        }
+        if (!*cursor || request->id < 0)
+        {
+            return respond(output, request, *cursor ? HotelInvalid : HotelNoMemory, 0, NULL, 0);
+        }
+        cursorSeek(*cursor, request->id);
+        size_t wanted = request->count < ProtoMaxRecords ? request->count : ProtoMaxRecords;
+        size_t fetched = cursorFetch(*cursor, records, wanted);
+        return respond(output, request, HotelOk, (uint32_t)fetched, records, fetched * size);
+    }
+    case ProtoBook:
+    {
+        if (request->length != sizeof(struct Reservation))
+        {
+            return respond(output, request, HotelInvalid, 0, NULL, 0);
+        }
+        struct Reservation reservation;
+        memcpy(&reservation, payload, sizeof(reservation));
+        return respond(output, request, bookRoom(&reservation), 0, NULL, 0);
+    }
+    default:
+        return respond(output, request, HotelOk, (uint32_t)tableRecordCount(table), NULL, 0);
+    }
+}
+
+// takes a batch of whole requests from the connection, runs them and sends
+// the responses; false once the connection has nothing left to run
+bool serveBatch(Connection *connection, Buffer *batch, Buffer *responses, char *records)
+{
+    pthread_mutex_lock(&connection->mutex);
+    size_t bytes = 0;
+    if (!connection->closed && !completeRequests(&connection->input, WorkerBatchBytes, &bytes))
+    {
+        // a malformed request: the event loop closes the connection
+        shutdown(connection->fd, SHUT_RDWR);
+    }
+    if (connection->closed)
+    {
+        bytes = 0;
+    }
+    batch->length = 0;
+    if (bytes == 0 || !bufferAppend(batch, connection->input.data, bytes))
+    {
+        connection->scheduled = false;
+        bool release = connection->closed;
+        pthread_mutex_unlock(&connection->mutex);
+        if (release)
+        {
+            freeConnection(connection);
+        }
+        return false;
+    }
+    bufferConsume(&connection->input, bytes);
+    pthread_mutex_unlock(&connection->mutex);
+
+    responses->length = 0;
+    size_t served = 0;
+    for (size_t offset = 0; offset < batch->length; served++)
+    {
+        RequestHeader request;
+        memcpy(&request, batch->data + offset, sizeof(request));
+        offset += sizeof(request);
+        executeRequest(connection, &request, batch->data + offset, records, responses);
+        offset += request.length;
+    }
+    __atomic_fetch_add(&requestsServed, served, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&connection->mutex);
+    if (!connection->closed)
+    {
+        bufferAppend(&connection->output, responses->data, responses->length);
+        flushOutput(connection);
+        connection->paused = connection->input.length + connection->output.length > ConnectionBufferLimit;
+        watchConnection(connection);
+    }
+    pthread_mutex_unlock(&connection->mutex);
+    return true;
+}
+
+void *workerMain(void *arg)
+{
+    (void)arg;
+    Buffer batch = {0}, responses = {0};
+    // room for ProtoMaxRecords of the largest record
+    char *records = malloc(ProtoMaxRecords * sizeof(struct Customer));
+    while (records)
+    {
+        pthread_mutex_lock(&readyMutex);
+        while (!readyHead && !stopping)
+        {
+            pthread_cond_wait(&readyCondition, &readyMutex);
+        }
+        Connection *connection = readyHead;
+        if (!connection)
+        {
+            pthread_mutex_unlock(&readyMutex);
+            break;
+        }
+        readyHead = connection->nextReady;
+        if (!readyHead)
+        {
+            readyTail = NULL;
+        }
+        pthread_mutex_unlock(&readyMutex);
+
+        // one batch per turn: a connection with more to run goes to the back
+        // of the queue, so a busy client cannot keep a worker from the rest
+        if (serveBatch(connection, &batch, &responses, records))
+        {
+            enqueueConnection(connection);
+        }
+    }
+    free(records);
+    free(batch.data);
+    free(responses.data);
+    return NULL;
+}
+
+void acceptConnections(int listenFd)
+{
+    while (true)
+    {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        Connection *connection = calloc(1, sizeof(Connection));
+        if (!connection)
+        {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        pthread_mutex_init(&connection->mutex, NULL);
+        pthread_mutex_lock(&connectionsMutex);
+        connection->next = connections;
+        if (connections)
+        {
+            connections->previous = connection;
+        }
+        connections = connection;
+        pthread_mutex_unlock(&connectionsMutex);
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            freeConnection(connection);
+            continue;
+        }
+        connectionsAccepted++;
+    }
+}
+
+// reads everything the socket has and hands whole requests to the workers
+void connectionEvent(Connection *connection, unsigned int events)
+{
+    pthread_mutex_lock(&connection->mutex);
+    bool hangup = (events & (EPOLLERR | EPOLLHUP)) != 0;
+    if (events & EPOLLIN)
+    {
+        while (connection->input.length < ConnectionBufferLimit && bufferReserve(&connection->input, ReadChunk))
+        {
+            ssize_t n = recv(connection->fd, connection->input.data + connection->input.length, ReadChunk, 0);
+            if (n > 0)
+            {
+                connection->input.length += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            hangup |= n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+    }
+    if (events & EPOLLOUT)
+    {
+        flushOutput(connection);
+    }
+
+    size_t bytes = 0;
+    if (hangup || !completeRequests(&connection->input, WorkerBatchBytes, &bytes))
+    {
+        closeConnection(connection);
+        bool release = !connection->scheduled;
+        pthread_mutex_unlock(&connection->mutex);
+        if (release)
+        {
+            freeConnection(connection);
+        }
+        return;
+    }
+    if (bytes > 0)
+    {
+        scheduleConnection(connection);
+    }
+    connection->paused = connection->input.length + connection->output.length > ConnectionBufferLimit;
+    watchConnection(connection);
+    pthread_mutex_unlock(&connection->mutex);
+}
+
+int listenSocket()
+{
+    int fd;
+    if (options.port)
+    {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in address = {
+            .sin_family = AF_INET,
+            .sin_port = htons(options.port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            perror("bind");
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+        if (strlen(options.socketPath) >= sizeof(address.sun_path))
+        {
+            fprintf(stderr, "socket path too long: %s\n", options.socketPath);
+            return -1;
+        }
+        strcpy(address.sun_path, options.socketPath);
+        unlink(options.socketPath);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            perror("bind");
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0)
+    {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-s socket | -p port] [-w workers]\n"
+            "  -s  Unix-domain socket path (default %s)\n"
+            "  -p  serve on 127.0.0.1:port instead\n"
+            "  -w  worker threads running requests (default %d)\n"
+            "the tables are loaded from the working directory; stop with Ctrl-C\n",
+            program, DefaultSocketPath, DefaultWorkers);
+}
+
+int main(int argc, char **argv)
+{
+    options = (ServerOptions){
+        .socketPath = DefaultSocketPath,
+        .workers = DefaultWorkers,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:w:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            options.socketPath = optarg;
+            break;
+        case 'p':
+            options.port = atoi(optarg);
+            break;
+        case 'w':
+            options.workers = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.workers < 1 || options.workers > MaxWorkers || options.port < 0 || options.port > 65535)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // SIGINT and SIGTERM arrive through the event loop as a file descriptor
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    int signalFd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+    HotelStatus status = hotelOpen(NULL);
+    if (status != HotelOk)
+    {
+        fprintf(stderr, "Warning: %s while opening the database, some changes may not be saved!\n",
+                hotelStatusText(status));
+    }
+    enableRoomColumns();
+    int listenFd = listenSocket();
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listenEvent = {.events = EPOLLIN, .data.ptr = &listenFd};
+    struct epoll_event signalEvent = {.events = EPOLLIN, .data.ptr = &signalFd};
+    if (listenFd < 0 || signalFd < 0 || epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) != 0 ||
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &signalEvent) != 0)
+    {
+        fprintf(stderr, "could not set up the server socket\n");
+        hotelClose();
+        return 1;
+    }
+
+    pthread_t workers[MaxWorkers];
+    int started = 0;
+    while (started < options.workers && pthread_create(&workers[started], NULL, workerMain, NULL) == 0)
+    {
+        started++;
+    }
+    if (options.port)
+    {
+        printf("Serving on 127.0.0.1:%d with %d workers\n", options.port, started);
+    }
+    else
+    {
+        printf("Serving on %s with %d workers\n", options.socketPath, started);
+    }
+    fflush(stdout);
+
+    struct epoll_event events[MaxEvents];
+    bool running = started > 0;
+    while (running)
+    {
+        int count = epoll_wait(epollFd, events, MaxEvents, -1);
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.ptr == &listenFd)
+            {
+                acceptConnections(listenFd);
+            }
+            else if (events[i].data.ptr == &signalFd)
+            {
+                running = false;
+            }
+            else
+            {
+                connectionEvent(events[i].data.ptr, events[i].events);
+            }
+        }
+    }
+
+    // finish the requests already handed out, then checkpoint and exit
+    close(listenFd);
+    pthread_mutex_lock(&readyMutex);
+    stopping = true;
+    pthread_cond_broadcast(&readyCondition);
+    pthread_mutex_unlock(&readyMutex);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    while (connections)
+    {
+        closeConnection(connections);
+        freeConnection(connections);
+    }
+    if (!options.port)
+    {
+        unlink(options.socketPath);
+    }
+    printf("Served %llu requests on %llu connections\n", requestsServed, connectionsAccepted);
+    hotelClose();
+    return 0;
+}
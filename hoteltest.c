@@ -0,0 +1,1982 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include "hoteldb.h"
+#include "hotelproto.h"
+
+// correctness checks of the engine: every test starts hotelOpen() in an empty
+// directory, prints one line and counts towards the exit status
+#define JoinCustomers 400
+#define JoinRooms 150
+// enough reservations for the driving side to be split across threads
+#define JoinReservations 12000
+#define JoinAmenityTypes 6
+#define BookRooms 40
+#define BookCustomers 50
+#define BookThreads 8
+#define BookAttempts 1500
+// rooms whose prices the transfer threads move between
+#define TransferRooms 5
+#define TransferThreads 2
+#define Transfers 300
+// ids grow from empty so the id index resizes while it is read
+#define ReadIds 20000
+#define ReadThreads 3
+// enough guests for the base file to span many pages
+#define PagedGuests 20000
+#define LoggedGuests 2000
+// a few hundred batches to open a cursor over
+#define ListedGuests 50000
+#define ListChunk 100
+// ids given to guests inserted while a cursor opens, after it opened and
+// by an id change
+#define OpeningIds 1000000
+#define OpenedIds 2000000
+#define MovedIds 3000000
+#define LoadedGuests 6000
+#define LoadedRooms 200
+#define LoadedStays 40000
+// availability windows compared after the reload
+#define LoadWindows 40
+#define ServedGuests 20
+// gets each connection pipelines at once
+#define PipelinedGets 2000
+#define ServerConnections 3
+#define ServerSocket "test.sock"
+
+typedef struct
+{
+    const char *name;
+    bool (*run)();
+} Test;
+
+// checks that failed in the current test
+int failed = 0;
+// the hotelserver binary the server test starts
+char serverPath[4096 + 64];
+
+void expect(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("  failed: %s\n", what);
+        failed++;
+    }
+}
+
+// xorshift, one state per thread
+unsigned int nextRandom(unsigned int *state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x ? x : 1;
+}
+
+int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+bool freshDirectory(const char *path)
+{
+    nftw(path, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    return mkdir(path, 0755) == 0 && chdir(path) == 0;
+}
+
+// while set, the engine's in-place page writes stop half way and fail, as
+// if the process died during them. the engine is linked in statically, so
+// this definition replaces the C library's for it
+atomic_bool failPageWrites = false;
+
+ssize_t pwrite(int fd, const void *buffer, size_t count, off_t offset)
+{
+    if (atomic_load(&failPageWrites))
+    {
+        syscall(SYS_pwrite64, fd, buffer, count / 2, offset);
+        return -1;
+    }
+    return syscall(SYS_pwrite64, fd, buffer, count, offset);
+}
+
+// while set, syncing a log fails as on a full or failing disk
+atomic_bool failLogSyncs = false;
+
+int fdatasync(int fd)
+{
+    if (atomic_load(&failLogSyncs))
+    {
+        errno = EIO;
+        return -1;
+    }
+    return (int)syscall(SYS_fdatasync, fd);
+}
+
+// the whole file, NULL when it cannot be read
+char *readFile(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    char *contents = NULL;
+    if (file && fseek(file, 0, SEEK_END) == 0 && (*size = (size_t)ftell(file), fseek(file, 0, SEEK_SET) == 0))
+    {
+        contents = malloc(*size + 1);
+        if (contents && fread(contents, 1, *size, file) != *size)
+        {
+            free(contents);
+            contents = NULL;
+        }
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+    return contents;
+}
+
+bool writeFile(const char *path, const char *contents, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    bool ok = file && fwrite(contents, 1, size, file) == size;
+    return (file ? fclose(file) == 0 : false) && ok;
+}
+
+bool fileExists(const char *path)
+{
+    return access(path, F_OK) == 0;
+}
+
+// joins: runQuery against nested loops over copies of the tables
+
+typedef struct
+{
+    char *records;
+    size_t count;
+    size_t size;
+} TableCopy;
+
+TableCopy copies[TableCount];
+
+bool copyVisitor(const void *record, void *context)
+{
+    TableCopy *copy = (TableCopy *)context;
+    memcpy(copy->records + copy->count++ * copy->size, record, copy->size);
+    return true;
+}
+
+bool copyTables()
+{
+    for (int i = 0; i < TableCount; i++)
+    {
+        Table *table = hotelTable(i);
+        copies[i].size = tableRecordSize(table);
+        copies[i].count = 0;
+        copies[i].records = malloc((tableRecordCount(table) + 1) * copies[i].size);
+        if (!copies[i].records || tableScan(table, copyVisitor, &copies[i]) != HotelOk)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void freeCopies()
+{
+    for (int i = 0; i < TableCount; i++)
+    {
+        free(copies[i].records);
+        copies[i].records = NULL;
+    }
+}
+
+// result rows are compared as a count and an order independent sum of a
+// hash of each row's record ids
+typedef struct
+{
+    const Query *query;
+    size_t rows;
+    unsigned long long sum;
+} JoinResult;
+
+unsigned long long mixId(unsigned long long hash, int id)
+{
+    hash = (hash ^ (unsigned int)id) * 0x100000001b3ULL;
+    return hash ^ (hash >> 29);
+}
+
+void addRow(JoinResult *result, const void *const *records)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < result->query->tableCount; i++)
+    {
+        hash = mixId(hash, tableRecordId(hotelTable(result->query->tables[i].table), records[i]));
+    }
+    result->rows++;
+    result->sum += hash;
+}
+
+bool joinVisitor(const void *const *records, void *context)
+{
+    addRow((JoinResult *)context, records);
+    return true;
+}
+
+// the brute force side names columns by offset
+typedef struct
+{
+    size_t column;
+    size_t otherColumn;
+} JoinOffsets;
+
+int intAt(const void *record, size_t offset)
+{
+    int value;
+    memcpy(&value, (const char *)record + offset, sizeof(value));
+    return value;
+}
+
+void bruteJoin(const Query *query, const JoinOffsets *offsets, int level, const void **row, JoinResult *result)
+{
+    if (level == query->tableCount)
+    {
+        addRow(result, row);
+        return;
+    }
+    const QueryTable *table = &query->tables[level];
+    const TableCopy *copy = &copies[table->table];
+    for (size_t i = 0; i < copy->count; i++)
+    {
+        const void *record = copy->records + i * copy->size;
+        if (table->filter && !table->filter(record, table->filterContext))
+        {
+            continue;
+        }
+        if (level > 0 && intAt(record, offsets[level].column) != intAt(row[table->other], offsets[level].otherColumn))
+        {
+            continue;
+        }
+        row[level] = record;
+        bruteJoin(query, offsets, level + 1, row, result);
+    }
+}
+
+void expectJoin(const char *what, const Query *query, const JoinOffsets *offsets)
+{
+    JoinResult joined = {query, 0, 0}, brute = {query, 0, 0};
+    const void *row[QueryMaxTables];
+    expect(runQuery(query, joinVisitor, &joined) == HotelOk, what);
+    bruteJoin(query, offsets, 0, row, &brute);
+    expect(joined.rows == brute.rows && joined.sum == brute.sum, what);
+}
+
+bool evenCustomer(const void *record, void *context)
+{
+    (void)context;
+    return ((const struct Customer *)record)->customerID % 2 == 0;
+}
+
+bool cheapRoom(const void *record, void *context)
+{
+    return ((const struct Room *)record)->price < *(const double *)context;
+}
+
+bool earlyStay(const void *record, void *context)
+{
+    (void)context;
+    return ((const struct Reservation *)record)->checkInDay < 20003;
+}
+
+bool fillJoinTables()
+{
+    unsigned int state = 7;
+    bool ok = true;
+    for (int i = 0; i < JoinCustomers; i++)
+    {
+        struct Customer customer = {.customerID = i};
+        snprintf(customer.name, sizeof(customer.name), "Guest %d", i);
+        ok = ok && tableInsert(hotelTable(CustomerTable), &customer) == HotelOk;
+    }
+    for (int i = 0; i < JoinRooms; i++)
+    {
+        struct Room room = {.roomID = i, .price = 50 + nextRandom(&state) % 300, .availability = i % 2};
+        snprintf(room.roomType, sizeof(room.roomType), i % 3 ? "Single" : "Suite");
+        ok = ok && tableInsert(hotelTable(RoomTable), &room) == HotelOk;
+    }
+    for (int i = 0; i < JoinReservations; i++)
+    {
+        int day = 20000 + nextRandom(&state) % 20;
+        struct Reservation reservation = {
+            .reservationID = i,
+            .checkInDay = day,
+            .checkOutDay = day + 1 + nextRandom(&state) % 5,
+            // some point at customers and rooms that do not exist
+            .customerID = nextRandom(&state) % (JoinCustomers + 20),
+            .roomID = nextRandom(&state) % (JoinRooms + 10),
+        };
+        ok = ok && tableInsert(hotelTable(ReservationTable), &reservation) == HotelOk;
+    }
+    for (int i = 0; i < JoinRooms; i += 2)
+    {
+        struct Amenity amenity = {.RoomID = i, .AmenityID = i % (JoinAmenityTypes + 1)};
+        ok = ok && tableInsert(hotelTable(AmenityTable), &amenity) == HotelOk;
+    }
+    for (int i = 0; i < JoinAmenityTypes; i++)
+    {
+        struct Amenity_Type type = {.AmenityID = i};
+        snprintf(type.AmenityName, sizeof(type.AmenityName), "Amenity %d", i);
+        ok = ok && tableInsert(hotelTable(AmenityTypeTable), &type) == HotelOk;
+    }
+    return ok;
+}
+
+// one query per join method: id lookups, a secondary index, a hash join on
+// columns without an index, and four tables mixing them
+bool testJoins()
+{
+    if (!fillJoinTables() || !copyTables())
+    {
+        freeCopies();
+        return false;
+    }
+    double maxPrice = 200;
+
+    Query byId = {
+        .tables = {{ReservationTable},
+                   {CustomerTable, evenCustomer, NULL, "customerID", 0, "customerID"},
+                   {RoomTable, cheapRoom, &maxPrice, "roomID", 0, "roomID"}},
+        .tableCount = 3,
+    };
+    JoinOffsets byIdOffsets[] = {{0, 0},
+                                 {offsetof(struct Customer, customerID), offsetof(struct Reservation, customerID)},
+                                 {offsetof(struct Room, roomID), offsetof(struct Reservation, roomID)}};
+    expectJoin("id lookup joins", &byId, byIdOffsets);
+
+    Query bySecondary = {
+        .tables = {{CustomerTable, evenCustomer},
+                   {ReservationTable, earlyStay, NULL, "customerID", 0, "customerID"},
+                   {RoomTable, NULL, NULL, "roomID", 1, "roomID"}},
+        .tableCount = 3,
+    };
+    JoinOffsets bySecondaryOffsets[] = {
+        {0, 0},
+        {offsetof(struct Reservation, customerID), offsetof(struct Customer, customerID)},
+        {offsetof(struct Room, roomID), offsetof(struct Reservation, roomID)}};
+    expectJoin("secondary index join", &bySecondary, bySecondaryOffsets);
+
+    Query byHash = {
+        .tables = {{ReservationTable, earlyStay}, {ReservationTable, NULL, NULL, "checkInDay", 0, "checkOutDay"}},
+        .tableCount = 2,
+    };
+    JoinOffsets byHashOffsets[] = {
+        {0, 0}, {offsetof(struct Reservation, checkInDay), offsetof(struct Reservation, checkOutDay)}};
+    expectJoin("hash join", &byHash, byHashOffsets);
+
+    Query fourWay = {
+        .tables = {{ReservationTable},
+                   {AmenityTable, NULL, NULL, "RoomID", 0, "roomID"},
+                   {AmenityTypeTable, NULL, NULL, "AmenityID", 1, "AmenityID"},
+                   {RoomTable, cheapRoom, &maxPrice, "availability", 1, "AmenityID"}},
+        .tableCount = 4,
+    };
+    JoinOffsets fourWayOffsets[] = {{0, 0},
+                                    {offsetof(struct Amenity, RoomID), offsetof(struct Reservation, roomID)},
+                                    {offsetof(struct Amenity_Type, AmenityID), offsetof(struct Amenity, AmenityID)},
+                                    {offsetof(struct Room, availability), offsetof(struct Amenity, AmenityID)}};
+    expectJoin("four table join", &fourWay, fourWayOffsets);
+
+    Query unknown = {
+        .tables = {{ReservationTable}, {CustomerTable, NULL, NULL, "nope", 0, "customerID"}},
+        .tableCount = 2,
+    };
+    JoinResult ignored = {&unknown, 0, 0};
+    expect(runQuery(&unknown, joinVisitor, &ignored) == HotelInvalid, "unknown column rejected");
+
+    freeCopies();
+    return true;
+}
+
+// bookings: threads book random, often overlapping stays while others move
+// price between rooms in transactions
+
+atomic_int nextReservation = 1;
+atomic_int booked = 0;
+atomic_int unexpected = 0;
+
+void *bookStays(void *arg)
+{
+    unsigned int state = (unsigned int)(size_t)arg * 7919 + 1;
+    for (int i = 0; i < BookAttempts; i++)
+    {
+        int day = 20000 + nextRandom(&state) % 200;
+        struct Reservation reservation = {
+            .reservationID = atomic_fetch_add(&nextReservation, 1),
+            .checkInDay = day,
+            .checkOutDay = day + 1 + nextRandom(&state) % 6,
+            .customerID = 1 + nextRandom(&state) % BookCustomers,
+            .roomID = 1 + nextRandom(&state) % BookRooms,
+        };
+        HotelStatus status = bookRoom(&reservation);
+        if (status == HotelOk)
+        {
+            atomic_fetch_add(&booked, 1);
+        }
+        else if (status != HotelConflict)
+        {
+            atomic_fetch_add(&unexpected, 1);
+        }
+    }
+    return NULL;
+}
+
+void *transferPrice(void *arg)
+{
+    unsigned int state = (unsigned int)(size_t)arg * 104729 + 1;
+    for (int i = 0; i < Transfers; i++)
+    {
+        int from = 1001 + nextRandom(&state) % TransferRooms, to = 1001 + nextRandom(&state) % TransferRooms;
+        HotelStatus status = HotelConflict;
+        while (from != to && status == HotelConflict)
+        {
+            Transaction *tx = txBegin();
+            struct Room source, target;
+            if (!tx || txGet(tx, RoomTable, from, &source) != HotelOk || txGet(tx, RoomTable, to, &target) != HotelOk)
+            {
+                txAbort(tx);
+                status = HotelNotFound;
+                break;
+            }
+            source.price -= 1;
+            target.price += 1;
+            txUpdate(tx, RoomTable, from, &source);
+            txUpdate(tx, RoomTable, to, &target);
+            status = txCommit(tx);
+        }
+        if (from != to && status != HotelOk)
+        {
+            atomic_fetch_add(&unexpected, 1);
+        }
+    }
+    return NULL;
+}
+
+double transferTotal()
+{
+    double total = 0;
+    for (int i = 1001; i < 1001 + TransferRooms; i++)
+    {
+        struct Room room = {0};
+        tableGet(hotelTable(RoomTable), i, &room);
+        total += room.price;
+    }
+    return total;
+}
+
+// no two reservations of a room overlap and every booked room has an
+// occupant row
+void expectBookings()
+{
+    Table *table = hotelTable(ReservationTable);
+    TableCopy stays = {malloc((tableRecordCount(table) + 1) * sizeof(struct Reservation)), 0,
+                       sizeof(struct Reservation)};
+    if (!stays.records || tableScan(table, copyVisitor, &stays) != HotelOk)
+    {
+        expect(false, "reservations scanned");
+        free(stays.records);
+        return;
+    }
+    const struct Reservation *reservations = (const struct Reservation *)stays.records;
+    size_t overlaps = 0, unoccupied = 0;
+    for (size_t i = 0; i < stays.count; i++)
+    {
+        for (size_t j = i + 1; j < stays.count; j++)
+        {
+            overlaps += reservations[i].roomID == reservations[j].roomID &&
+                        reservations[i].checkInDay < reservations[j].checkOutDay &&
+                        reservations[j].checkInDay < reservations[i].checkOutDay;
+        }
+        struct CUTSOMER_PLACES_ROOM occupant;
+        unoccupied += tableGet(hotelTable(CustomerPlacesRoomTable), reservations[i].roomID, &occupant) != HotelOk;
+    }
+    expect(stays.count == (size_t)booked, "one reservation per successful booking");
+    expect(overlaps == 0, "no overlapping stays");
+    expect(unoccupied == 0, "booked rooms have an occupant");
+    free(stays.records);
+}
+
+bool testBookings()
+{
+    bool ok = true;
+    for (int i = 1; i <= BookCustomers; i++)
+    {
+        struct Customer customer = {.customerID = i};
+        snprintf(customer.name, sizeof(customer.name), "Guest %d", i);
+        snprintf(customer.phone, sizeof(customer.phone), "555-%04d", i);
+        ok = ok && tableInsert(hotelTable(CustomerTable), &customer) == HotelOk;
+    }
+    for (int i = 1; i <= BookRooms; i++)
+    {
+        struct Room room = {.roomID = i, .roomType = "Single", .price = 80, .availability = 1};
+        ok = ok && tableInsert(hotelTable(RoomTable), &room) == HotelOk;
+    }
+    for (int i = 1001; i < 1001 + TransferRooms; i++)
+    {
+        struct Room room = {.roomID = i, .roomType = "Suite", .price = 1000, .availability = 1};
+        ok = ok && tableInsert(hotelTable(RoomTable), &room) == HotelOk;
+    }
+    if (!ok)
+    {
+        return false;
+    }
+    double total = transferTotal();
+
+    pthread_t threads[BookThreads + TransferThreads];
+    int started = 0;
+    for (; started < BookThreads + TransferThreads; started++)
+    {
+        void *(*body)(void *) = started < BookThreads ? bookStays : transferPrice;
+        if (pthread_create(&threads[started], NULL, body, (void *)(size_t)started) != 0)
+        {
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    expect(started == BookThreads + TransferThreads, "threads started");
+    expect(unexpected == 0, "bookings and transfers only conflict");
+
+    struct Reservation taken = {.reservationID = 1000000, .checkInDay = 20000, .checkOutDay = 20300,
+                                .customerID = 1, .roomID = 1};
+    struct Reservation nowhere = {.reservationID = 1000001, .checkInDay = 20000, .checkOutDay = 20001,
+                                  .customerID = 1, .roomID = 999};
+    expect(booked == 0 || bookRoom(&taken) == HotelConflict, "a booked stay conflicts");
+    expect(bookRoom(&nowhere) == HotelNotFound, "a missing room is not found");
+    expectBookings();
+    expect(transferTotal() == total, "transfers keep the total price");
+
+    // and all of it survives a reopen
+    hotelClose();
+    if (hotelOpen(NULL) != HotelOk)
+    {
+        return false;
+    }
+    expectBookings();
+    expect(transferTotal() == total, "total price after reopen");
+    return true;
+}
+
+// lock-free reads: readers look up ids while one writer inserts them in
+// order, growing the id index through several resizes, and another rewrites
+// and deletes them. every copy a reader gets must be one whole version
+
+atomic_int inserted = 0;
+atomic_bool writing = true;
+atomic_int torn = 0;
+atomic_int lost = 0;
+atomic_size_t reads = 0;
+
+// every field of a guest carries its id and a version stamp
+void fillGuest(struct Customer *customer, int id, unsigned int stamp)
+{
+    memset(customer, 0, sizeof(*customer));
+    customer->customerID = id;
+    snprintf(customer->name, sizeof(customer->name), "Guest %d version %u", id, stamp);
+    snprintf(customer->email, sizeof(customer->email), "guest%d.%u@example.com", id, stamp);
+    snprintf(customer->phone, sizeof(customer->phone), "%u", stamp);
+    snprintf(customer->address, sizeof(customer->address), "%u Stamp Street, room %d", stamp, id);
+}
+
+bool wholeGuest(const struct Customer *customer, int id)
+{
+    struct Customer expected;
+    fillGuest(&expected, id, (unsigned int)strtoul(customer->phone, NULL, 10));
+    return memcmp(customer, &expected, sizeof(expected)) == 0;
+}
+
+// ids divisible by four are the only ones ever deleted
+void *insertGuests(void *arg)
+{
+    (void)arg;
+    for (int id = 0; id < ReadIds; id++)
+    {
+        struct Customer customer;
+        fillGuest(&customer, id, 0);
+        if (tableInsert(hotelTable(CustomerTable), &customer) != HotelOk)
+        {
+            atomic_fetch_add(&lost, 1);
+        }
+        atomic_store(&inserted, id + 1);
+    }
+    return NULL;
+}
+
+void *rewriteGuests(void *arg)
+{
+    (void)arg;
+    unsigned int state = 99;
+    for (unsigned int stamp = 1; atomic_load(&writing); stamp++)
+    {
+        int count = atomic_load(&inserted);
+        if (count == 0)
+        {
+            continue;
+        }
+        int id = (int)(nextRandom(&state) % (unsigned int)count);
+        struct Customer customer;
+        fillGuest(&customer, id, stamp);
+        if (id % 4 == 0 && stamp % 3 == 0)
+        {
+            tableDelete(hotelTable(CustomerTable), id);
+            tableInsert(hotelTable(CustomerTable), &customer);
+        }
+        else if (tableUpdate(hotelTable(CustomerTable), id, &customer) != HotelOk && id % 4 != 0)
+        {
+            atomic_fetch_add(&lost, 1);
+        }
+    }
+    return NULL;
+}
+
+void *readGuests(void *arg)
+{
+    unsigned int state = (unsigned int)(size_t)arg * 31 + 7;
+    size_t done = 0;
+    while (atomic_load(&writing))
+    {
+        int count = atomic_load(&inserted);
+        if (count == 0)
+        {
+            continue;
+        }
+        int id = (int)(nextRandom(&state) % (unsigned int)count);
+        struct Customer customer;
+        HotelStatus status = tableGet(hotelTable(CustomerTable), id, &customer);
+        if (status == HotelOk && !wholeGuest(&customer, id))
+        {
+            atomic_fetch_add(&torn, 1);
+        }
+        else if (status != HotelOk && id % 4 != 0)
+        {
+            atomic_fetch_add(&lost, 1);
+        }
+        done++;
+        // leave the writers a cpu on small machines
+        sched_yield();
+    }
+    atomic_fetch_add(&reads, done);
+    return NULL;
+}
+
+bool testConcurrentReads()
+{
+    pthread_t threads[ReadThreads + 2];
+    int started = 0;
+    for (; started < ReadThreads + 2; started++)
+    {
+        void *(*body)(void *) = started == 0 ? insertGuests : started == 1 ? rewriteGuests : readGuests;
+        if (pthread_create(&threads[started], NULL, body, (void *)(size_t)started) != 0)
+        {
+            break;
+        }
+    }
+    if (started > 0)
+    {
+        pthread_join(threads[0], NULL);
+    }
+    atomic_store(&writing, false);
+    for (int i = 1; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    expect(started == ReadThreads + 2, "threads started");
+    expect(torn == 0, "no torn reads");
+    expect(lost == 0, "ids never deleted are always found");
+    expect(reads > 0, "readers ran");
+
+    size_t bad = 0;
+    for (int id = 0; id < ReadIds; id++)
+    {
+        struct Customer customer;
+        HotelStatus status = tableGet(hotelTable(CustomerTable), id, &customer);
+        bad += status == HotelOk ? !wholeGuest(&customer, id) : id % 4 != 0;
+    }
+    expect(bad == 0, "every record intact afterwards");
+    return true;
+}
+
+// checkpoints: a few changed records rewrite their pages in place, a
+// journal left by a checkpoint that died during those writes is replayed on
+// open, and one left over from before a whole-file rewrite is ignored
+
+#define CustomerFile "customers.dat"
+#define CustomerLog "customers.log"
+#define CustomerJournal "customers.dat.pages"
+
+// the stamp each guest should have, -1 for deleted ones
+int guestStamps[PagedGuests];
+
+void setGuest(int id, int stamp)
+{
+    struct Customer customer;
+    fillGuest(&customer, id, (unsigned int)stamp);
+    tableUpdate(hotelTable(CustomerTable), id, &customer);
+    guestStamps[id] = stamp;
+}
+
+void expectGuests(const char *what)
+{
+    size_t bad = 0, present = 0;
+    for (int id = 0; id < PagedGuests; id++)
+    {
+        struct Customer customer, expected;
+        HotelStatus status = tableGet(hotelTable(CustomerTable), id, &customer);
+        if (guestStamps[id] < 0)
+        {
+            bad += status != HotelNotFound;
+            continue;
+        }
+        fillGuest(&expected, id, (unsigned int)guestStamps[id]);
+        bad += status != HotelOk || memcmp(&customer, &expected, sizeof(expected)) != 0;
+        present++;
+    }
+    expect(bad == 0 && tableRecordCount(hotelTable(CustomerTable)) == present, what);
+}
+
+// blocks of the two versions of the base file that differ
+size_t changedBlocks(const char *before, const char *after, size_t size)
+{
+    size_t changed = 0;
+    for (size_t offset = 0; offset < size; offset += 4096)
+    {
+        size_t length = size - offset < 4096 ? size - offset : 4096;
+        changed += memcmp(before + offset, after + offset, length) != 0;
+    }
+    return changed;
+}
+
+bool testCheckpoints()
+{
+    bool ok = true;
+    memset(guestStamps, 0, sizeof(guestStamps));
+    for (int id = 0; id < PagedGuests; id++)
+    {
+        struct Customer customer;
+        fillGuest(&customer, id, 0);
+        ok = ok && tableInsert(hotelTable(CustomerTable), &customer) == HotelOk;
+    }
+    hotelClose();
+    size_t size = 0, changedSize = 0;
+    char *before = readFile(CustomerFile, &size);
+    if (!ok || !before || hotelOpen(NULL) != HotelOk)
+    {
+        free(before);
+        return false;
+    }
+
+    // a handful of updates rewrite their own pages and nothing else
+    for (int id = 0; id < PagedGuests; id += PagedGuests / 4)
+    {
+        setGuest(id, 1);
+    }
+    flushNow();
+    char *after = readFile(CustomerFile, &changedSize);
+    expect(after && changedSize == size, "pages rewritten in place");
+    // four 16 KiB pages and the header page
+    expect(after && changedSize == size && changedBlocks(before, after, size) <= 5 * 4,
+           "only the changed pages are written");
+    expect(!fileExists(CustomerJournal), "journal removed after the checkpoint");
+    free(before);
+    free(after);
+    hotelClose();
+
+    // a checkpoint dies after syncing its journal, half way into the pages.
+    // the changes go in as one commit so only one checkpoint can pick them up
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        Transaction *tx = hotelOpen(NULL) == HotelOk ? txBegin() : NULL;
+        if (!tx)
+        {
+            _exit(1);
+        }
+        for (int id = 7; id < PagedGuests; id += PagedGuests / 3)
+        {
+            struct Customer customer;
+            fillGuest(&customer, id, 2);
+            txUpdate(tx, CustomerTable, id, &customer);
+        }
+        txDelete(tx, CustomerTable, 8);
+        atomic_store(&failPageWrites, true);
+        _exit(txCommit(tx) == HotelOk ? (flushNow(), 0) : 1);
+    }
+    int childStatus = 0;
+    if (child < 0 || waitpid(child, &childStatus, 0) != child || childStatus != 0)
+    {
+        return false;
+    }
+    for (int id = 7; id < PagedGuests; id += PagedGuests / 3)
+    {
+        guestStamps[id] = 2;
+    }
+    guestStamps[8] = -1;
+    size_t journalSize = 0;
+    char *journal = readFile(CustomerJournal, &journalSize);
+    expect(journal != NULL, "journal left behind");
+    // without the log only the journal can bring the changes back
+    remove(CustomerLog);
+    if (hotelOpen(NULL) != HotelOk)
+    {
+        free(journal);
+        return false;
+    }
+    expectGuests("journal replayed on open");
+    expect(!fileExists(CustomerJournal), "journal removed after replay");
+
+    // a failed checkpoint has the next one rewrite the whole file, so the
+    // old journal no longer belongs to it
+    atomic_store(&failPageWrites, true);
+    setGuest(0, 3);
+    flushNow();
+    atomic_store(&failPageWrites, false);
+    setGuest(1, 3);
+    hotelClose();
+    ok = journal && writeFile(CustomerJournal, journal, journalSize);
+    free(journal);
+    if (!ok || hotelOpen(NULL) != HotelOk)
+    {
+        return false;
+    }
+    expectGuests("stale journal ignored");
+    expect(!fileExists(CustomerJournal), "stale journal removed");
+    return true;
+}
+
+// the log: changes only in the log come back after the process dies, a torn
+// last record is cut off, and a failed sync fails every commit until a
+// checkpoint has the changes in the base file
+
+HotelStatus insertGuest(int id, int stamp)
+{
+    struct Customer customer;
+    fillGuest(&customer, id, (unsigned int)stamp);
+    guestStamps[id] = stamp;
+    return tableInsert(hotelTable(CustomerTable), &customer);
+}
+
+// runs changes in a child that dies without closing the database; false if
+// it could not
+bool dieAfter(void (*changes)())
+{
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        if (hotelOpen(NULL) != HotelOk)
+        {
+            _exit(1);
+        }
+        changes();
+        _exit(0);
+    }
+    int status = 0;
+    return child > 0 && waitpid(child, &status, 0) == child && status == 0;
+}
+
+// the stamps the children leave behind are set again in the parent
+void logFirstGuests()
+{
+    for (int id = 0; id < 100; id++)
+    {
+        insertGuest(id, 0);
+    }
+    setGuest(5, 1);
+    tableDelete(hotelTable(CustomerTable), 6);
+}
+
+void logMoreGuests()
+{
+    for (int id = 100; id < 110; id++)
+    {
+        insertGuest(id, 0);
+    }
+}
+
+long fileSize(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+bool testLog()
+{
+    hotelClose();
+    memset(guestStamps, -1, sizeof(guestStamps));
+    if (!dieAfter(logFirstGuests))
+    {
+        return false;
+    }
+    for (int id = 0; id < 100; id++)
+    {
+        guestStamps[id] = id == 5 ? 1 : id == 6 ? -1 : 0;
+    }
+    expect(fileSize(CustomerLog) > 0 && !fileExists(CustomerFile), "changes only in the log");
+    HotelOpenReport report;
+    if (hotelOpen(&report) != HotelOk)
+    {
+        return false;
+    }
+    expect(report.recovered[CustomerTable] == 102, "every logged change replayed");
+    expectGuests("log replayed after the process died");
+    hotelClose();
+
+    // the last record loses its end
+    if (!dieAfter(logMoreGuests))
+    {
+        return false;
+    }
+    long logged = fileSize(CustomerLog);
+    if (logged < 10 || truncate(CustomerLog, logged - 10) != 0 || hotelOpen(&report) != HotelOk)
+    {
+        return false;
+    }
+    for (int id = 100; id < 109; id++)
+    {
+        guestStamps[id] = 0;
+    }
+    expect(report.recovered[CustomerTable] == 9, "torn record dropped");
+    expectGuests("records before a torn one replayed");
+    expect(insertGuest(109, 0) == HotelOk, "log appends after the cut");
+    hotelClose();
+    if (hotelOpen(NULL) != HotelOk)
+    {
+        return false;
+    }
+    expectGuests("appended record replayed");
+
+    // enough pages that one changed page is checkpointed in place, which
+    // failPageWrites can then make fail
+    bool ok = true;
+    for (int id = 110; id < LoggedGuests; id++)
+    {
+        ok = ok && insertGuest(id, 0) == HotelOk;
+    }
+    flushNow();
+
+    // the first failed sync fails its commit; with syncs working again the
+    // next commit still fails, since the checkpoint the failure asks for
+    // cannot finish either
+    atomic_store(&failPageWrites, true);
+    atomic_store(&failLogSyncs, true);
+    expect(insertGuest(LoggedGuests, 0) == HotelIoError, "failed sync reported");
+    atomic_store(&failLogSyncs, false);
+    expect(insertGuest(LoggedGuests + 1, 0) == HotelIoError, "failed log stays failed");
+    atomic_store(&failPageWrites, false);
+    // a checkpoint covering everything clears the failure
+    insertGuest(LoggedGuests + 2, 0);
+    flushNow();
+    expect(insertGuest(LoggedGuests + 3, 0) == HotelOk, "checkpoint clears the failure");
+    expectGuests("failed commits applied in memory");
+    hotelClose();
+    if (hotelOpen(NULL) != HotelOk)
+    {
+        return false;
+    }
+    expectGuests("failed commits survive a reopen");
+    return ok;
+}
+
+// cursors: a writer inserts, updates and deletes while a cursor opens, then
+// keeps updating and inserting while it is fetched. guests are told apart by
+// id % 5: 0 is left alone, 1 is deleted and 2 gets a new id after the cursor
+// opened, 3 is updated throughout and 4 may be deleted while it opens
+
+atomic_bool cursorOpened = false;
+atomic_bool writerOpened = false;
+atomic_bool cursorDone = false;
+// guests the writer deleted while the cursor opened
+bool deletedWhileOpening[ListedGuests];
+atomic_int openingInserts = 0;
+
+void *writeDuringCursor(void *arg)
+{
+    (void)arg;
+    unsigned int state = 5;
+    int deletes = 4;
+    for (unsigned int stamp = 1; !atomic_load(&cursorDone); stamp++)
+    {
+        if (atomic_load(&cursorOpened))
+        {
+            atomic_store(&writerOpened, true);
+        }
+        bool opened = atomic_load(&writerOpened);
+        struct Customer customer;
+        int id = (int)(nextRandom(&state) % (ListedGuests / 5)) * 5 + 3;
+        fillGuest(&customer, id, stamp);
+        tableUpdate(hotelTable(CustomerTable), id, &customer);
+        if (!opened && deletes < ListedGuests)
+        {
+            tableDelete(hotelTable(CustomerTable), deletes);
+            deletedWhileOpening[deletes] = true;
+            deletes += 5;
+        }
+        if (!opened)
+        {
+            fillGuest(&customer, OpeningIds + atomic_fetch_add(&openingInserts, 1), 0);
+            tableInsert(hotelTable(CustomerTable), &customer);
+        }
+        else
+        {
+            fillGuest(&customer, OpenedIds + (int)stamp, 0);
+            tableInsert(hotelTable(CustomerTable), &customer);
+        }
+    }
+    return NULL;
+}
+
+bool writeGuestFile(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    bool ok = file != NULL;
+    for (int id = 0; id < ListedGuests && ok; id++)
+    {
+        struct Customer customer;
+        fillGuest(&customer, id, 0);
+        ok = fwrite(&customer, sizeof(customer), 1, file) == 1;
+    }
+    return (file ? fclose(file) == 0 : false) && ok;
+}
+
+bool testCursors()
+{
+    ImportStats stats;
+    if (!writeGuestFile("guests.bin") ||
+        importTable(hotelTable(CustomerTable), "guests.bin", true, &stats) != HotelOk ||
+        stats.imported != ListedGuests)
+    {
+        return false;
+    }
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writeDuringCursor, NULL) != 0)
+    {
+        return false;
+    }
+    while (atomic_load(&openingInserts) == 0)
+    {
+        sched_yield();
+    }
+    TableCursor *cursor = tableCursorOpen(hotelTable(CustomerTable));
+    atomic_store(&cursorOpened, true);
+    while (!atomic_load(&writerOpened))
+    {
+        sched_yield();
+    }
+    for (int id = 1; id < ListedGuests; id += 5)
+    {
+        tableDelete(hotelTable(CustomerTable), id);
+    }
+    for (int id = 2; id < ListedGuests; id += 5)
+    {
+        struct Customer customer;
+        fillGuest(&customer, MovedIds + id, 0);
+        tableUpdate(hotelTable(CustomerTable), id, &customer);
+    }
+
+    int *listed = malloc(ListedGuests * 2 * sizeof(int));
+    unsigned char *seen = calloc(ListedGuests, 1);
+    unsigned char *seenOpening = calloc(ListedGuests, 1);
+    struct Customer *records = malloc(ListChunk * sizeof(struct Customer));
+    size_t count = 0, torn = 0, unexpected = 0, repeated = 0, second = 0;
+    size_t fetched = 0;
+    while (cursor && listed && seen && seenOpening && records &&
+           (fetched = cursorFetch(cursor, records, ListChunk)) > 0)
+    {
+        if (count == 0)
+        {
+            second = cursorPosition(cursor);
+        }
+        for (size_t i = 0; i < fetched && count < ListedGuests * 2; i++)
+        {
+            int id = records[i].customerID;
+            listed[count++] = id;
+            torn += !wholeGuest(&records[i], id);
+            if (id >= 0 && id < ListedGuests)
+            {
+                unexpected += id % 5 == 1 || id % 5 == 2 || deletedWhileOpening[id];
+                repeated += seen[id]++ > 0;
+            }
+            else if (id >= OpeningIds && id < OpeningIds + ListedGuests)
+            {
+                repeated += seenOpening[id - OpeningIds]++ > 0;
+            }
+            else
+            {
+                unexpected++;
+            }
+        }
+    }
+    atomic_store(&cursorDone, true);
+    pthread_join(writer, NULL);
+    if (!cursor || !listed || !seen || !seenOpening || !records)
+    {
+        cursorClose(cursor);
+        free(listed);
+        free(seen);
+        free(seenOpening);
+        free(records);
+        return false;
+    }
+
+    size_t missing = 0;
+    for (int id = 0; id < ListedGuests; id++)
+    {
+        bool kept = id % 5 == 0 || id % 5 == 3 || (id % 5 == 4 && !deletedWhileOpening[id]);
+        missing += kept && !seen[id];
+    }
+    expect(torn == 0, "every record listed whole");
+    expect(repeated == 0, "no record listed twice");
+    expect(missing == 0, "every surviving record listed");
+    expect(unexpected == 0, "deleted, moved and later records skipped");
+    expect(count <= cursorRecordCount(cursor), "no more records than ids taken");
+
+    // seeking back to where the second fetch started lists it again
+    size_t again = 0;
+    cursorSeek(cursor, second);
+    fetched = cursorFetch(cursor, records, ListChunk);
+    for (size_t i = 0; i < fetched && ListChunk + i < count; i++)
+    {
+        again += records[i].customerID == listed[ListChunk + i];
+    }
+    expect(fetched == ListChunk && again == ListChunk, "seek resumes at a saved position");
+
+    cursorClose(cursor);
+    free(listed);
+    free(seen);
+    free(seenOpening);
+    free(records);
+    return true;
+}
+
+// imports: a CSV and a binary file with good, malformed and duplicate rows
+// are imported by a process that then dies; the checkpoint the import ends
+// with must hold every imported row
+
+const char importedGuests[] = "customerID,name,email,phone,address\n"
+                              "1,\"Smith, Anna\",anna@example.com,555-0101,\"1 \"\"Main\"\" Street\"\n"
+                              "2,Bob,bob@example.com,555-0102,2 Side Road\n"
+                              "\n"
+                              "x3,Bad Id,bad@example.com,555-0103,3 Nowhere\n"
+                              "3,Carol,carol@example.com,555-0104\n"
+                              "2,Bob Again,bob2@example.com,555-0105,2 Side Road\n"
+                              "4,Dan,dan@example.com,555-0106-0107-0108-0109,4 Long Phone Lane\n"
+                              "10,Guest Ten,ten@example.com,555-0110,10 Taken Street\n";
+
+void importGuestsAndRooms()
+{
+    ImportStats stats[2];
+    if (importTable(hotelTable(CustomerTable), "guests.csv", false, &stats[0]) != HotelOk ||
+        importTable(hotelTable(RoomTable), "rooms.bin", true, &stats[1]) != HotelOk ||
+        !writeFile("import.stats", (const char *)stats, sizeof(stats)))
+    {
+        _exit(1);
+    }
+}
+
+bool sameRows(const ImportStats *stats, size_t rows, size_t imported, size_t invalid, size_t duplicates,
+              size_t first, size_t second, size_t third)
+{
+    return stats->rows == rows && stats->imported == imported && stats->invalid == invalid &&
+           stats->duplicates == duplicates && stats->rejected[0] == first && stats->rejected[1] == second &&
+           stats->rejected[2] == third;
+}
+
+bool testImports()
+{
+    // a record already there counts as a duplicate too
+    if (insertGuest(10, 0) != HotelOk)
+    {
+        return false;
+    }
+    hotelClose();
+    struct Room rooms[6] = {
+        {.roomID = 1, .roomType = "Single", .price = 90, .availability = 1},
+        {.roomID = 2, .roomType = "Double", .price = 120, .availability = 0},
+        {.roomID = 1, .roomType = "Suite", .price = 300, .availability = 1},
+        {.roomID = 4, .price = 80, .availability = 1},
+        {.roomID = 5, .roomType = "Twin", .price = 100, .availability = 2},
+        {.roomID = 3, .roomType = "Suite", .price = 300, .availability = 1},
+    };
+    // a type with no terminator
+    memset(rooms[3].roomType, 'x', sizeof(rooms[3].roomType));
+    size_t size;
+    char *written;
+    if (!writeFile("guests.csv", importedGuests, strlen(importedGuests)) ||
+        !writeFile("rooms.bin", (const char *)rooms, sizeof(rooms)) || !dieAfter(importGuestsAndRooms) ||
+        !(written = readFile("import.stats", &size)))
+    {
+        return false;
+    }
+    ImportStats stats[2];
+    memcpy(stats, written, size == sizeof(stats) ? sizeof(stats) : 0);
+    free(written);
+    expect(size == sizeof(stats) && sameRows(&stats[0], 7, 2, 3, 2, 5, 6, 8),
+           "csv header and blank line skipped, bad and duplicate lines counted");
+    expect(size == sizeof(stats) && sameRows(&stats[1], 6, 3, 2, 1, 4, 5, 0),
+           "binary bad and duplicate records counted");
+    expect(fileSize(CustomerLog) == 0 && fileSize("room.log") == 0, "imports are not logged");
+
+    HotelOpenReport report;
+    if (hotelOpen(&report) != HotelOk)
+    {
+        return false;
+    }
+    expect(report.recovered[CustomerTable] == 0 && report.recovered[RoomTable] == 0,
+           "imports read back from the checkpoint");
+    struct Customer customer;
+    struct Room room;
+    expect(tableGet(hotelTable(CustomerTable), 1, &customer) == HotelOk &&
+               strcmp(customer.name, "Smith, Anna") == 0 && strcmp(customer.address, "1 \"Main\" Street") == 0,
+           "quoted fields unquoted");
+    expect(tableGet(hotelTable(CustomerTable), 2, &customer) == HotelOk && strcmp(customer.name, "Bob") == 0 &&
+               tableGet(hotelTable(CustomerTable), 10, &customer) == HotelOk && wholeGuest(&customer, 10) &&
+               tableRecordCount(hotelTable(CustomerTable)) == 3,
+           "the first of duplicate guests kept");
+    expect(tableGet(hotelTable(RoomTable), 1, &room) == HotelOk && strcmp(room.roomType, "Single") == 0 &&
+               tableGet(hotelTable(RoomTable), 3, &room) == HotelOk && tableRecordCount(hotelTable(RoomTable)) == 3,
+           "the first of duplicate rooms kept");
+    return true;
+}
+
+// updates: a replaced record is found under its new fields in every index
+// and no longer under the old ones, whether or not it keeps its id
+
+int compareInts(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+bool sameIds(const int *ids, size_t count, int first, int second)
+{
+    int sorted[2] = {ids[0], ids[1]};
+    qsort(sorted, count < 2 ? count : 2, sizeof(int), compareInts);
+    return count == 2 && sorted[0] == first && sorted[1] == second;
+}
+
+bool testUpdates()
+{
+    struct Room rooms[3] = {
+        {.roomID = 1, .roomType = "Single", .price = 90, .availability = 1},
+        {.roomID = 2, .roomType = "Double", .price = 120, .availability = 0},
+        {.roomID = 3, .roomType = "Suite", .price = 300, .availability = 1},
+    };
+    struct Reservation stay = {.reservationID = 1, .checkInDay = 20000, .checkOutDay = 20003,
+                               .customerID = 1, .roomID = 1};
+    bool inserted = insertGuest(1, 0) == HotelOk && insertGuest(2, 0) == HotelOk &&
+                    tableInsert(hotelTable(ReservationTable), &stay) == HotelOk;
+    for (int i = 0; i < 3 && inserted; i++)
+    {
+        inserted = tableInsert(hotelTable(RoomTable), &rooms[i]) == HotelOk;
+    }
+    if (!inserted || enableRoomColumns() != HotelOk)
+    {
+        return false;
+    }
+
+    struct Room suite = {.roomID = 2, .roomType = "Suite", .price = 150, .availability = 1};
+    struct Room moved = {.roomID = 7, .roomType = "Single", .price = 95, .availability = 1};
+    struct Reservation rebooked = {.reservationID = 1, .checkInDay = 20010, .checkOutDay = 20012,
+                                   .customerID = 2, .roomID = 3};
+    struct Customer renamed;
+    fillGuest(&renamed, 8, 1);
+    if (tableUpdate(hotelTable(RoomTable), 2, &suite) != HotelOk ||
+        tableUpdate(hotelTable(RoomTable), 1, &moved) != HotelOk ||
+        tableUpdate(hotelTable(ReservationTable), 1, &rebooked) != HotelOk ||
+        tableUpdate(hotelTable(CustomerTable), 1, &renamed) != HotelOk)
+    {
+        return false;
+    }
+
+    int ids[LoadedRooms];
+    struct Room found[4];
+    RoomFilter suites = {.minPrice = 0, .maxPrice = 1000, .availability = 1, .roomType = "Suite"};
+    RoomFilter cheap = {.minPrice = 0, .maxPrice = 100, .availability = -1};
+    size_t count = findRooms(&suites, ids, LoadedRooms);
+    expect(sameIds(ids, count, 2, 3), "room kept its id and its column row changed");
+    count = findRooms(&cheap, ids, LoadedRooms);
+    expect(count == 1 && ids[0] == 7, "room moved to a new id in the columns");
+    expect(tableSearchByName(hotelTable(RoomTable), "suite", false, found, 4) == 2 &&
+               tableSearchByName(hotelTable(RoomTable), "double", false, found, 4) == 0,
+           "room types re-keyed");
+
+    struct Reservation stays[2];
+    struct Customer guests[2];
+    expect(tableFindBySecondary(hotelTable(ReservationTable), 0, 1, stays, 2) == 0 &&
+               tableFindBySecondary(hotelTable(ReservationTable), 0, 2, stays, 2) == 1 &&
+               tableFindBySecondary(hotelTable(ReservationTable), 1, 1, stays, 2) == 0 &&
+               tableFindBySecondary(hotelTable(ReservationTable), 1, 3, stays, 2) == 1,
+           "reservation postings moved");
+    count = findAvailableRooms(20000, 20003, ids, LoadedRooms);
+    expect(count == 3, "old stay no longer blocks its room");
+    count = findAvailableRooms(20011, 20012, ids, LoadedRooms);
+    expect(count == 2, "new stay blocks its room");
+    expect(tableFindByName(hotelTable(CustomerTable), "Guest 1 version 0", guests, 2) == 0 &&
+               tableFindByName(hotelTable(CustomerTable), "Guest 8 version 1", guests, 2) == 1 &&
+               guests[0].customerID == 8 && tableGet(hotelTable(CustomerTable), 1, guests) == HotelNotFound,
+           "guest found under the new name and id only");
+    return true;
+}
+
+// loads: tables spanning many pages are written and reopened; the indexes
+// the open builds from the decoded pages must answer every query as the
+// ones kept up insert by insert did, and as a brute force over the rows
+
+const char *const loadedRoomTypes[] = {"Single", "double", "Suite", "DOUBLE deluxe", "twin", "Double"};
+struct Reservation loadedStays[LoadedStays];
+
+typedef struct
+{
+    int *values;
+    size_t count;
+    size_t capacity;
+} IntList;
+
+void listAdd(IntList *list, int value)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        int *values = realloc(list->values, capacity * sizeof(int));
+        if (!values)
+        {
+            return;
+        }
+        list->values = values;
+        list->capacity = capacity;
+    }
+    list->values[list->count++] = value;
+}
+
+// appends count and then the ids in ascending order
+void listSorted(IntList *list, int *ids, size_t count)
+{
+    qsort(ids, count, sizeof(int), compareInts);
+    listAdd(list, (int)count);
+    for (size_t i = 0; i < count; i++)
+    {
+        listAdd(list, ids[i]);
+    }
+}
+
+const char *roomTypeOf(int roomId)
+{
+    return loadedRoomTypes[roomId % (int)(sizeof(loadedRoomTypes) / sizeof(loadedRoomTypes[0]))];
+}
+
+int compareGuestNames(const void *a, const void *b)
+{
+    char x[100], y[100];
+    snprintf(x, sizeof(x), "Guest %d version 0", *(const int *)a);
+    snprintf(y, sizeof(y), "Guest %d version 0", *(const int *)b);
+    return strcasecmp(x, y);
+}
+
+// rooms sharing a type come back in no set order, so ties go by id
+int compareRoomTypes(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    int order = strcasecmp(roomTypeOf(x), roomTypeOf(y));
+    return order != 0 ? order : (x > y) - (x < y);
+}
+
+bool staysOverlap(const struct Reservation *stay, int fromDay, int toDay)
+{
+    return stay->checkInDay < toDay && stay->checkOutDay > fromDay;
+}
+
+int windowStart(int window)
+{
+    return 20000 + window * 11;
+}
+
+// every query's answers in one list, as the tables give them
+bool loadedAnswers(IntList *answers)
+{
+    struct Customer *guests = malloc(LoadedGuests * sizeof(struct Customer));
+    struct Room rooms[LoadedRooms];
+    struct Reservation *stays = malloc(LoadedStays * sizeof(struct Reservation));
+    int ids[LoadedRooms + LoadedStays];
+    if (!guests || !stays)
+    {
+        free(guests);
+        free(stays);
+        return false;
+    }
+    size_t found = tableSearchByName(hotelTable(CustomerTable), "", true, guests, LoadedGuests);
+    listAdd(answers, (int)found);
+    for (size_t i = 0; i < found && i < LoadedGuests; i++)
+    {
+        listAdd(answers, guests[i].customerID);
+    }
+    found = tableSearchByName(hotelTable(RoomTable), "", true, rooms, LoadedRooms);
+    listAdd(answers, (int)found);
+    for (size_t begin = 0; begin < found && begin < LoadedRooms;)
+    {
+        size_t end = begin;
+        while (end < found && end < LoadedRooms && strcasecmp(rooms[end].roomType, rooms[begin].roomType) == 0)
+        {
+            ids[end - begin] = rooms[end].roomID;
+            end++;
+        }
+        qsort(ids, end - begin, sizeof(int), compareInts);
+        for (size_t i = 0; i < end - begin; i++)
+        {
+            listAdd(answers, ids[i]);
+        }
+        begin = end;
+    }
+    for (int index = 0; index < 2; index++)
+    {
+        for (int key = index == 0 ? 0 : 1; key < (index == 0 ? LoadedGuests : LoadedRooms + 1); key++)
+        {
+            found = tableFindBySecondary(hotelTable(ReservationTable), index, key, stays, LoadedStays);
+            for (size_t i = 0; i < found && i < LoadedStays; i++)
+            {
+                ids[i] = stays[i].reservationID;
+            }
+            listSorted(answers, ids, found < LoadedStays ? found : LoadedStays);
+        }
+    }
+    for (int window = 0; window < LoadWindows; window++)
+    {
+        found = findAvailableRooms(windowStart(window), windowStart(window) + 1 + window % 5, ids, LoadedRooms);
+        listSorted(answers, ids, found < LoadedRooms ? found : LoadedRooms);
+    }
+    free(guests);
+    free(stays);
+    return true;
+}
+
+// the same answers worked out from the rows written
+void expectedAnswers(IntList *answers)
+{
+    static int ids[LoadedRooms + LoadedStays];
+    listAdd(answers, LoadedGuests);
+    for (int id = 0; id < LoadedGuests; id++)
+    {
+        ids[id] = id;
+    }
+    qsort(ids, LoadedGuests, sizeof(int), compareGuestNames);
+    for (int i = 0; i < LoadedGuests; i++)
+    {
+        listAdd(answers, ids[i]);
+    }
+    listAdd(answers, LoadedRooms);
+    for (int id = 1; id <= LoadedRooms; id++)
+    {
+        ids[id - 1] = id;
+    }
+    qsort(ids, LoadedRooms, sizeof(int), compareRoomTypes);
+    for (int i = 0; i < LoadedRooms; i++)
+    {
+        listAdd(answers, ids[i]);
+    }
+    for (int index = 0; index < 2; index++)
+    {
+        for (int key = index == 0 ? 0 : 1; key < (index == 0 ? LoadedGuests : LoadedRooms + 1); key++)
+        {
+            size_t count = 0;
+            for (int i = 0; i < LoadedStays; i++)
+            {
+                if ((index == 0 ? loadedStays[i].customerID : loadedStays[i].roomID) == key)
+                {
+                    ids[count++] = loadedStays[i].reservationID;
+                }
+            }
+            listSorted(answers, ids, count);
+        }
+    }
+    for (int window = 0; window < LoadWindows; window++)
+    {
+        int fromDay = windowStart(window), toDay = fromDay + 1 + window % 5;
+        bool taken[LoadedRooms + 1] = {false};
+        for (int i = 0; i < LoadedStays; i++)
+        {
+            taken[loadedStays[i].roomID] |= staysOverlap(&loadedStays[i], fromDay, toDay);
+        }
+        size_t count = 0;
+        for (int id = 1; id <= LoadedRooms; id++)
+        {
+            if (!taken[id])
+            {
+                ids[count++] = id;
+            }
+        }
+        listSorted(answers, ids, count);
+    }
+}
+
+bool sameAnswers(const IntList *a, const IntList *b)
+{
+    return a->count == b->count && a->count > 0 && memcmp(a->values, b->values, a->count * sizeof(int)) == 0;
+}
+
+bool testLoads()
+{
+    unsigned int seed = 19;
+    bool inserted = true;
+    for (int id = 0; id < LoadedGuests && inserted; id++)
+    {
+        inserted = insertGuest(id, 0) == HotelOk;
+    }
+    for (int id = 1; id <= LoadedRooms && inserted; id++)
+    {
+        struct Room room = {.roomID = id, .price = 50 + id % 7 * 10, .availability = id % 2};
+        snprintf(room.roomType, sizeof(room.roomType), "%s", roomTypeOf(id));
+        inserted = tableInsert(hotelTable(RoomTable), &room) == HotelOk;
+    }
+    // rooms are sparse enough that some windows find them free
+    for (int i = 0; i < LoadedStays && inserted; i++)
+    {
+        int checkIn = 20000 + (int)(nextRandom(&seed) % 4000);
+        loadedStays[i] = (struct Reservation){
+            .reservationID = i + 1,
+            .checkInDay = checkIn,
+            .checkOutDay = checkIn + 1 + (int)(nextRandom(&seed) % 7),
+            .customerID = (int)(nextRandom(&seed) % LoadedGuests),
+            .roomID = 1 + (int)(nextRandom(&seed) % LoadedRooms),
+        };
+        inserted = tableInsert(hotelTable(ReservationTable), &loadedStays[i]) == HotelOk;
+    }
+    IntList expected = {0}, serial = {0}, loaded = {0};
+    if (!inserted || !loadedAnswers(&serial))
+    {
+        free(serial.values);
+        return false;
+    }
+    hotelClose();
+    // enough pages that decoding splits into chunks on larger machines
+    expect(fileSize(CustomerFile) > 16 * 16384 && fileSize("reservations.dat") > 16 * 16384,
+           "tables written over many pages");
+
+    HotelOpenReport report;
+    if (hotelOpen(&report) != HotelOk)
+    {
+        free(serial.values);
+        return false;
+    }
+    size_t damaged = 0, recovered = 0;
+    for (int t = 0; t < TableCount; t++)
+    {
+        damaged += report.damaged[t];
+        recovered += report.recovered[t];
+    }
+    expect(damaged == 0 && recovered == 0, "reopened from the base files alone");
+    size_t torn = 0, wrong = 0;
+    for (int id = 0; id < LoadedGuests; id++)
+    {
+        struct Customer customer;
+        torn += tableGet(hotelTable(CustomerTable), id, &customer) != HotelOk || !wholeGuest(&customer, id);
+    }
+    for (int i = 0; i < LoadedStays; i++)
+    {
+        struct Reservation stay;
+        wrong += tableGet(hotelTable(ReservationTable), i + 1, &stay) != HotelOk ||
+                 memcmp(&stay, &loadedStays[i], sizeof(stay)) != 0;
+    }
+    expect(torn == 0 && wrong == 0 && tableRecordCount(hotelTable(ReservationTable)) == LoadedStays,
+           "every record reloaded");
+
+    expectedAnswers(&expected);
+    bool answered = loadedAnswers(&loaded);
+    expect(sameAnswers(&serial, &expected), "indexes kept up by inserts answer as the rows do");
+    expect(answered && sameAnswers(&loaded, &expected),
+           "reloaded postings, name order and intervals answer as the rows do");
+
+    // a short buffer still gets the total and the first names in order
+    struct Customer first[5];
+    size_t total = tableSearchByName(hotelTable(CustomerTable), "GUEST", true, first, 5);
+    expect(total == LoadedGuests && expected.count > 5 && first[0].customerID == expected.values[1] &&
+               first[4].customerID == expected.values[5],
+           "name search counts matches past the buffer");
+    free(expected.values);
+    free(serial.values);
+    free(loaded.values);
+    return true;
+}
+
+// server: hotelserver runs in the test directory; requests are pipelined
+// in one write per connection and every response must come back in order
+// with its request's tag
+
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    uint32_t tags;
+} Pipeline;
+
+void pipelineAdd(Pipeline *pipeline, ProtoOperation operation, HotelTableId table, int id, uint32_t count,
+                 const void *payload, size_t length)
+{
+    RequestHeader header = {
+        .length = (uint32_t)length,
+        .tag = ++pipeline->tags,
+        .operation = (uint8_t)operation,
+        .table = (uint8_t)table,
+        .id = id,
+        .count = count,
+    };
+    if (pipeline->length + sizeof(header) + length > pipeline->capacity)
+    {
+        size_t capacity = (pipeline->capacity + sizeof(header) + length) * 2;
+        char *data = realloc(pipeline->data, capacity);
+        if (!data)
+        {
+            return;
+        }
+        pipeline->data = data;
+        pipeline->capacity = capacity;
+    }
+    memcpy(pipeline->data + pipeline->length, &header, sizeof(header));
+    memcpy(pipeline->data + pipeline->length + sizeof(header), payload, length);
+    pipeline->length += sizeof(header) + length;
+}
+
+bool readExactly(int fd, void *buffer, size_t length)
+{
+    for (size_t done = 0; done < length;)
+    {
+        ssize_t got = read(fd, (char *)buffer + done, length - done);
+        if (got <= 0)
+        {
+            return false;
+        }
+        done += (size_t)got;
+    }
+    return true;
+}
+
+bool writeExactly(int fd, const void *buffer, size_t length)
+{
+    for (size_t done = 0; done < length;)
+    {
+        ssize_t put = write(fd, (const char *)buffer + done, length - done);
+        if (put <= 0)
+        {
+            return false;
+        }
+        done += (size_t)put;
+    }
+    return true;
+}
+
+// the next response, its records in records; false when the connection broke
+// or the tag is not the one expected next
+bool nextResponse(int fd, uint32_t tag, ResponseHeader *header, void *records, size_t capacity)
+{
+    char discard[4096];
+    if (!readExactly(fd, header, sizeof(*header)) || header->tag != tag)
+    {
+        return false;
+    }
+    if (header->length <= capacity)
+    {
+        return readExactly(fd, records, header->length);
+    }
+    for (size_t left = header->length; left > 0;)
+    {
+        size_t part = left < sizeof(discard) ? left : sizeof(discard);
+        if (!readExactly(fd, discard, part))
+        {
+            return false;
+        }
+        left -= part;
+    }
+    return true;
+}
+
+// a socket connected to the server, retrying while it starts; -1 if it never
+// answers
+int connectServer()
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX, .sun_path = ServerSocket};
+    for (int attempt = 0; attempt < 500; attempt++)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+        {
+            return fd;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        usleep(20000);
+    }
+    return -1;
+}
+
+pid_t startServer()
+{
+    fflush(stdout);
+    pid_t server = fork();
+    if (server == 0)
+    {
+        FILE *log = freopen("server.out", "w", stdout);
+        (void)log;
+        execl(serverPath, serverPath, "-s", ServerSocket, "-w", "4", (char *)NULL);
+        _exit(127);
+    }
+    return server;
+}
+
+// one of every operation in a single pipeline, answered in order
+void expectOperations(int fd)
+{
+    Pipeline pipeline = {0};
+    for (int id = 1; id <= ServedGuests; id++)
+    {
+        struct Customer customer;
+        fillGuest(&customer, id, 0);
+        pipelineAdd(&pipeline, ProtoInsert, CustomerTable, 0, 0, &customer, sizeof(customer));
+    }
+    struct Customer duplicate;
+    fillGuest(&duplicate, 3, 9);
+    struct Room room = {.roomID = 1, .roomType = "Single", .price = 90, .availability = 1};
+    struct Reservation stay = {.reservationID = 1, .checkInDay = 20000, .checkOutDay = 20003,
+                               .customerID = 2, .roomID = 1};
+    struct Reservation overlapping = {.reservationID = 2, .checkInDay = 20002, .checkOutDay = 20004,
+                                      .customerID = 3, .roomID = 1};
+    struct Reservation nowhere = {.reservationID = 3, .checkInDay = 20000, .checkOutDay = 20001,
+                                  .customerID = 3, .roomID = 99};
+    const char *name = "Guest 7 version 0";
+    pipelineAdd(&pipeline, ProtoInsert, CustomerTable, 0, 0, &duplicate, sizeof(duplicate));
+    pipelineAdd(&pipeline, ProtoGet, CustomerTable, 5, 0, NULL, 0);
+    pipelineAdd(&pipeline, ProtoGet, CustomerTable, 999, 0, NULL, 0);
+    pipelineAdd(&pipeline, ProtoFindByName, CustomerTable, 0, 0, name, strlen(name));
+    pipelineAdd(&pipeline, ProtoCount, CustomerTable, 0, 0, NULL, 0);
+    pipelineAdd(&pipeline, ProtoScan, CustomerTable, 0, 8, NULL, 0);
+    pipelineAdd(&pipeline, ProtoScan, CustomerTable, 8, 100, NULL, 0);
+    pipelineAdd(&pipeline, ProtoInsert, RoomTable, 0, 0, &room, sizeof(room));
+    pipelineAdd(&pipeline, ProtoBook, CustomerTable, 0, 0, &stay, sizeof(stay));
+    pipelineAdd(&pipeline, ProtoBook, CustomerTable, 0, 0, &overlapping, sizeof(overlapping));
+    pipelineAdd(&pipeline, ProtoBook, CustomerTable, 0, 0, &nowhere, sizeof(nowhere));
+    pipelineAdd(&pipeline, ProtoDelete, CustomerTable, 4, 0, NULL, 0);
+    pipelineAdd(&pipeline, ProtoGet, CustomerTable, 4, 0, NULL, 0);
+    pipelineAdd(&pipeline, ProtoGet, TableCount + 5, 1, 0, NULL, 0);
+    if (!pipeline.data || !writeExactly(fd, pipeline.data, pipeline.length))
+    {
+        expect(false, "requests sent");
+        free(pipeline.data);
+        return;
+    }
+    free(pipeline.data);
+
+    struct
+    {
+        HotelStatus status;
+        uint32_t count;
+    } expected[] = {
+        {HotelDuplicate, 0}, {HotelOk, 1},  {HotelNotFound, 0}, {HotelOk, 1},       {HotelOk, ServedGuests},
+        {HotelOk, 8},        {HotelOk, 12}, {HotelOk, 0},       {HotelOk, 0},       {HotelConflict, 0},
+        {HotelNotFound, 0},  {HotelOk, 0},  {HotelNotFound, 0}, {HotelInvalid, 0},
+    };
+    struct Customer records[ProtoMaxRecords];
+    ResponseHeader header;
+    bool inOrder = true, answered = true, whole = true;
+    for (uint32_t tag = 1; tag <= ServedGuests && inOrder; tag++)
+    {
+        inOrder = nextResponse(fd, tag, &header, records, sizeof(records));
+        answered &= header.status == HotelOk;
+    }
+    int scanned = 0;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]) && inOrder; i++)
+    {
+        inOrder = nextResponse(fd, ServedGuests + 1 + (uint32_t)i, &header, records, sizeof(records));
+        answered &= header.status == expected[i].status && header.count == expected[i].count;
+        for (uint32_t r = 0; r < header.length / sizeof(struct Customer); r++)
+        {
+            whole &= wholeGuest(&records[r], records[r].customerID) && records[r].phone[0] == '0';
+        }
+        whole &= i != 1 || (header.length == sizeof(struct Customer) && records[0].customerID == 5);
+        whole &= i != 3 || (header.length == sizeof(struct Customer) && records[0].customerID == 7);
+        scanned += i == 5 || i == 6 ? (int)(header.length / sizeof(struct Customer)) : 0;
+    }
+    expect(inOrder, "responses in request order with their tags");
+    expect(answered, "every operation answered as expected");
+    expect(whole && scanned == ServedGuests, "records come back whole");
+}
+
+// connections pipelining many gets at once are each answered in order
+void *pipelineGets(void *arg)
+{
+    int fd = connectServer();
+    Pipeline pipeline = {0};
+    for (int i = 0; i < PipelinedGets; i++)
+    {
+        pipelineAdd(&pipeline, ProtoGet, CustomerTable, 1 + (i + (int)(size_t)arg) % ServedGuests, 0, NULL, 0);
+    }
+    bool ok = fd >= 0 && pipeline.data && writeExactly(fd, pipeline.data, pipeline.length);
+    for (int i = 0; i < PipelinedGets && ok; i++)
+    {
+        struct Customer customer;
+        ResponseHeader header;
+        int id = 1 + (i + (int)(size_t)arg) % ServedGuests;
+        ok = nextResponse(fd, (uint32_t)i + 1, &header, &customer, sizeof(customer));
+        ok = ok && (id == 4 ? header.status == HotelNotFound
+                            : header.status == HotelOk && customer.customerID == id && wholeGuest(&customer, id));
+    }
+    free(pipeline.data);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return ok ? arg : NULL;
+}
+
+bool testServer()
+{
+    hotelClose();
+    pid_t server = startServer();
+    int fd = server > 0 ? connectServer() : -1;
+    if (fd >= 0)
+    {
+        expectOperations(fd);
+        close(fd);
+
+        pthread_t threads[ServerConnections];
+        int started = 0, ordered = 0;
+        for (; started < ServerConnections; started++)
+        {
+            if (pthread_create(&threads[started], NULL, pipelineGets, (void *)(size_t)(started + 1)) != 0)
+            {
+                break;
+            }
+        }
+        for (int i = 0; i < started; i++)
+        {
+            void *result;
+            pthread_join(threads[i], &result);
+            ordered += result != NULL;
+        }
+        expect(ordered == ServerConnections, "pipelined connections answered in order");
+    }
+    expect(fd >= 0, "server answers");
+
+    // the server checkpoints on SIGTERM, so everything is there on reopen
+    int status = -1;
+    if (server > 0)
+    {
+        kill(server, SIGTERM);
+        waitpid(server, &status, 0);
+    }
+    expect(WIFEXITED(status) && WEXITSTATUS(status) == 0, "server stops cleanly");
+    if (hotelOpen(NULL) != HotelOk)
+    {
+        return false;
+    }
+    struct Reservation reservation;
+    expect(tableRecordCount(hotelTable(CustomerTable)) == ServedGuests - 1 &&
+               tableGet(hotelTable(ReservationTable), 1, &reservation) == HotelOk,
+           "served changes saved");
+    return true;
+}
+
+Test tests[] = {
+    {"joins", testJoins},
+    {"bookings", testBookings},
+    {"reads", testConcurrentReads},
+    {"checkpoints", testCheckpoints},
+    {"log", testLog},
+    {"cursors", testCursors},
+    {"imports", testImports},
+    {"updates", testUpdates},
+    {"loads", testLoads},
+    {"server", testServer},
+};
+
+void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-d directory] [-S server] [test]...\n"
+            "  -d  scratch directory, emptied before every test (default ./test-data)\n"
+            "  -S  hotelserver binary for the server test (default ./hotelserver)\n"
+            "  runs every test unless some are named\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *directory = "test-data";
+    const char *server = "hotelserver";
+    int opt;
+    while ((opt = getopt(argc, argv, "d:S:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            directory = optarg;
+            break;
+        case 'S':
+            server = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        return 1;
+    }
+    // the tests run inside the scratch directory
+    snprintf(serverPath, sizeof(serverPath), "%s%s%s", server[0] == '/' ? "" : cwd, server[0] == '/' ? "" : "/",
+             server);
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        bool named = optind == argc;
+        for (int a = optind; a < argc; a++)
+        {
+            named |= strcmp(argv[a], tests[i].name) == 0;
+        }
+        if (!named)
+        {
+            continue;
+        }
+        failed = 0;
+        bool ran = chdir(cwd) == 0 && freshDirectory(directory) && hotelOpen(NULL) == HotelOk;
+        if (ran)
+        {
+            ran = tests[i].run();
+            hotelClose();
+        }
+        expect(ran, "setup");
+        printf("%s %s\n", failed ? "FAIL" : "ok", tests[i].name);
+        failures += failed != 0;
+    }
+    return failures ? 1 : 0;
+}
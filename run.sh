@@ -1,2 +1,2 @@
-gcc HotelDatabaseFinalJazi.c
-./a.out
\ No newline at end of file
+make
+./hotel